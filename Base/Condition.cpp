@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////
+// Condition.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "Condition.h"
+#include <errno.h>
+#include <time.h>
+
+Condition::Condition()
+{
+    // Use monotonic clock, so that timed waits are not affected by wall clock changes
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+Condition::~Condition()
+{
+    pthread_cond_destroy(&mCond);
+}
+
+void Condition::Wait(CriticalSection& lock)
+{
+    pthread_cond_wait(&mCond, &lock.mLock);
+}
+
+bool Condition::Wait(CriticalSection& lock, long milliseconds)
+{
+    if (milliseconds < 0)
+    {
+        milliseconds = 0;
+    }
+
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (milliseconds % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int rc = pthread_cond_timedwait(&mCond, &lock.mLock, &deadline);
+    return rc != ETIMEDOUT;
+}
+
+void Condition::Signal()
+{
+    pthread_cond_signal(&mCond);
+}
+
+void Condition::Broadcast()
+{
+    pthread_cond_broadcast(&mCond);
+}
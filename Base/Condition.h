@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////////////////////////
+// Condition.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Condition_INCLUDED
+#define Condition_INCLUDED
+
+#include <pthread.h>
+#include "CriticalSection.h"
+
+// A condition variable to be used together with a CriticalSection.
+// The caller must hold the CriticalSection when calling Wait().
+class Condition
+{
+public:
+    Condition();
+    ~Condition();
+
+    // Releases the lock, waits until signaled and re-acquires the lock.
+    void Wait(CriticalSection& lock);
+
+    // Same as above, but gives up after the given milliseconds.
+    // Returns false if timed out.
+    bool Wait(CriticalSection& lock, long milliseconds);
+
+    // Wakes up one waiting thread.
+    void Signal();
+
+    // Wakes up all waiting threads.
+    void Broadcast();
+
+private:
+    Condition(const Condition&);
+    Condition& operator =(const Condition&);
+
+private:
+    pthread_cond_t mCond;
+};
+
+#endif // Condition_INCLUDED
@@ -26,6 +26,9 @@ private:
 
 private:
     LOCK mLock;
+
+    // Condition waits on the underlying mutex
+    friend class Condition;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////////
+// LatencyHistogram.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "LatencyHistogram.h"
+#include <cstdio>
+#include <cstring>
+
+LatencyHistogram::LatencyHistogram()
+{
+    Clear();
+}
+
+void LatencyHistogram::Add(Int64 microseconds)
+{
+    mCounts[GetBucket(microseconds)]++;
+    mTotal++;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        mCounts[i] += other.mCounts[i];
+    }
+    mTotal += other.mTotal;
+}
+
+void LatencyHistogram::Clear()
+{
+    memset(mCounts, 0, sizeof(mCounts));
+    mTotal = 0;
+}
+
+int LatencyHistogram::GetBucket(Int64 microseconds)
+{
+    if (microseconds < SUB_BUCKETS)
+    {
+        return microseconds > 0 ? int(microseconds) : 0;
+    }
+
+    // The highest bit tells the power of two, the next 3 the bucket within it
+    int power = 63 - __builtin_clzll(UInt64(microseconds));
+    int bucket = (power - 2) * SUB_BUCKETS + int((microseconds >> (power - 3)) & (SUB_BUCKETS - 1));
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+Int64 LatencyHistogram::GetLowerBound(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    int power = bucket / SUB_BUCKETS + 2;
+    return (Int64(SUB_BUCKETS + bucket % SUB_BUCKETS)) << (power - 3);
+}
+
+Int64 LatencyHistogram::GetUpperBound(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket + 1;
+    }
+    int power = bucket / SUB_BUCKETS + 2;
+    return GetLowerBound(bucket) + (Int64(1) << (power - 3));
+}
+
+Int64 LatencyHistogram::GetPercentile(double percent) const
+{
+    if (mTotal == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value, from 1 to the total
+    UInt64 rank = UInt64(percent / 100 * mTotal + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    UInt64 count = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        count += mCounts[i];
+        if (count >= rank)
+        {
+            return GetUpperBound(i);
+        }
+    }
+    return GetUpperBound(BUCKETS - 1);
+}
+
+std::string LatencyHistogram::ToString() const
+{
+    std::string result;
+    char line[64];
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        if (mCounts[i] != 0)
+        {
+            snprintf(line, sizeof(line), "%lld-%lld: %u\n", (long long)GetLowerBound(i),
+                    (long long)GetUpperBound(i), mCounts[i]);
+            result += line;
+        }
+    }
+    return result;
+}
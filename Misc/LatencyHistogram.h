@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////
+// LatencyHistogram.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef LatencyHistogram_INCLUDED
+#define LatencyHistogram_INCLUDED
+
+#include <string>
+#include "Types.h"
+
+// Counts latencies in microseconds, with a relative precision of 1/8:
+// each power of two is split in 8 buckets, up to 2^27 microseconds (about 2 minutes).
+// Values below 8 microseconds get a bucket each, larger ones go to the last bucket.
+// Adding a value is a few instructions, and the histogram is a fixed array,
+// so one can be kept per measured target. A LatencyHistogram is not thread-safe.
+class LatencyHistogram
+{
+public:
+    enum
+    {
+        SUB_BUCKETS = 8,
+        // 8 buckets of single values, then 8 per power of two from 2^3 to 2^26
+        BUCKETS = SUB_BUCKETS * 25
+    };
+
+    LatencyHistogram();
+
+    void Add(Int64 microseconds);
+
+    // Adds the counts of other
+    void Merge(const LatencyHistogram& other);
+
+    void Clear();
+
+    // Number of values added
+    UInt64 GetTotal() const
+    {
+        return mTotal;
+    }
+
+    UInt64 GetCount(int bucket) const
+    {
+        return mCounts[bucket];
+    }
+
+    // Values counted in bucket are from its lower bound to below its upper bound
+    static Int64 GetLowerBound(int bucket);
+    static Int64 GetUpperBound(int bucket);
+
+    static int GetBucket(Int64 microseconds);
+
+    // Returns the value below which percent of the values are, e.g. 99 for the 99th
+    // percentile, as the upper bound of its bucket. Returns 0 if empty.
+    Int64 GetPercentile(double percent) const;
+
+    // Lists the buckets not empty, as "lower-upper: count" lines
+    std::string ToString() const;
+
+private:
+    UInt32 mCounts[BUCKETS];
+    UInt64 mTotal;
+};
+
+#endif // LatencyHistogram_INCLUDED
@@ -24,6 +24,19 @@ void Statistic::Increase(const std::string &key, long increase)
     AsyncSave();
 }
 
+void Statistic::Set(const std::string &key, long value)
+{
+    AutoCriticalSection autoLock(&mCriticalSection);
+    std::map<std::string, long>::iterator iter = mStatistic.find(key);
+    if (iter != mStatistic.end() && iter->second == value)
+    {
+        return;
+    }
+    mStatistic[key] = value;
+
+    AsyncSave();
+}
+
 long Statistic::Value(const std::string &key) const
 {
     AutoCriticalSection autoLock(&mCriticalSection);
@@ -16,6 +16,8 @@ public:
     Statistic(const std::string &filePath = "");
 
     void Increase(const std::string &key, long increase = 1);
+    // Sets a gauge, e.g. a rate, rather than counting
+    void Set(const std::string &key, long value);
     long Value(const std::string &key) const;
     void Reset(const std::string &key = "");
     std::string ToJsonString() const;
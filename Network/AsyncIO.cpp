@@ -0,0 +1,999 @@
+//////////////////////////////////////////////////////////////////////////
+// AsyncIO.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AsyncIO.h"
+#include "Log.h"
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <cstring>
+#include <sys/epoll.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup)
+#define ASYNCIO_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// One submitted operation
+struct AsyncOperation
+{
+    enum Type
+    {
+        OpAccept, OpReceive, OpSend, OpRead, OpWrite
+    };
+
+    Type type;
+    int fd;
+    char* buffer;
+    int length;
+    int flags;
+    Int64 offset;
+    AsyncIOCallback callback;
+    void* param;
+};
+
+// An operation and its result, waiting for its callback to be invoked
+typedef std::pair<AsyncOperation*, int> AsyncCompletion;
+
+static AsyncOperation* NewOperation(AsyncOperation::Type type, int fd,
+        const void* buffer, int length, int flags, Int64 offset,
+        AsyncIOCallback callback, void* param)
+{
+    AsyncOperation* op = new AsyncOperation;
+    op->type = type;
+    op->fd = fd;
+    op->buffer = const_cast<char*>(reinterpret_cast<const char*>(buffer));
+    op->length = length;
+    op->flags = flags;
+    op->offset = offset;
+    op->callback = callback;
+    op->param = param;
+    return op;
+}
+
+// Invokes the callbacks and releases the operations
+static int InvokeCallbacks(std::vector<AsyncCompletion>& completions)
+{
+    for (std::vector<AsyncCompletion>::iterator iter = completions.begin();
+            iter != completions.end(); ++iter)
+    {
+        if (iter->first->callback)
+        {
+            iter->first->callback(iter->second, iter->first->param);
+        }
+        delete iter->first;
+    }
+
+    return (int)completions.size();
+}
+
+// Converts timeout to milliseconds, rounding up
+static int TimeoutToMilliseconds(const Timespan& timeout)
+{
+    Int64 us = timeout.GetTotalMicroseconds();
+    if (us <= 0)
+    {
+        return 0;
+    }
+
+    return int((us + 999) / 1000);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// EpollAsyncIO
+// Waits for readiness with epoll, then executes the operations in non-blocking mode.
+class EpollAsyncIO: public AsyncIO
+{
+public:
+    EpollAsyncIO();
+    ~EpollAsyncIO();
+
+    bool Init(unsigned int queueDepth);
+
+    Backend GetBackend() const
+    {
+        return BackendEpoll;
+    }
+
+    bool Accept(Socket& listener, AsyncIOCallback callback, void* param);
+    bool Receive(Socket& sock, void* buffer, int length,
+            AsyncIOCallback callback, void* param, int flags);
+    bool Send(Socket& sock, const void* buffer, int length,
+            AsyncIOCallback callback, void* param, int flags);
+    bool Read(int fd, void* buffer, int length, Int64 offset,
+            AsyncIOCallback callback, void* param);
+    bool Write(int fd, const void* buffer, int length, Int64 offset,
+            AsyncIOCallback callback, void* param);
+    void Cancel(int fd);
+    bool RegisterBuffers(const iovec* buffers, int count);
+    int Poll(const Timespan& timeout);
+    int GetPending() const;
+
+private:
+    // Pending operations of one socket descriptor
+    struct PendingOps
+    {
+        PendingOps() : events(0)
+        {
+        }
+
+        std::deque<AsyncOperation*> readOps;
+        std::deque<AsyncOperation*> writeOps;
+        // Events currently registered in epoll
+        UInt32 events;
+    };
+
+    bool SubmitSocketOp(AsyncOperation* op, bool isRead);
+    void UpdateInterest(int fd);
+    void ProcessQueue(std::deque<AsyncOperation*>& ops,
+            std::vector<AsyncCompletion>& completions);
+
+    // Executes the system call of an operation, returns -errno on failure
+    static int Execute(const AsyncOperation* op);
+
+private:
+    int mEpollFd;
+    std::map<int, PendingOps> mFds;
+    // File operations, executed in Poll()
+    std::deque<AsyncOperation*> mFileOps;
+    // Cancelled operations, their callbacks are invoked in Poll()
+    std::vector<AsyncCompletion> mCancelled;
+    std::vector<epoll_event> mEvents;
+    int mPending;
+};
+
+EpollAsyncIO::EpollAsyncIO() :
+    mEpollFd(-1), mPending(0)
+{
+}
+
+EpollAsyncIO::~EpollAsyncIO()
+{
+    for (std::map<int, PendingOps>::iterator iter = mFds.begin();
+            iter != mFds.end(); ++iter)
+    {
+        for (size_t i = 0; i < iter->second.readOps.size(); i++)
+        {
+            delete iter->second.readOps[i];
+        }
+        for (size_t i = 0; i < iter->second.writeOps.size(); i++)
+        {
+            delete iter->second.writeOps[i];
+        }
+    }
+    for (size_t i = 0; i < mFileOps.size(); i++)
+    {
+        delete mFileOps[i];
+    }
+    for (size_t i = 0; i < mCancelled.size(); i++)
+    {
+        delete mCancelled[i].first;
+    }
+
+    if (mEpollFd >= 0)
+    {
+        ::close(mEpollFd);
+    }
+}
+
+bool EpollAsyncIO::Init(unsigned int queueDepth)
+{
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0)
+    {
+        LOG(LogError, "epoll_create1 failed: %d", errno);
+        return false;
+    }
+
+    mEvents.resize(queueDepth > 0 ? queueDepth : 1);
+    return true;
+}
+
+bool EpollAsyncIO::Accept(Socket& listener, AsyncIOCallback callback, void* param)
+{
+    return SubmitSocketOp(NewOperation(AsyncOperation::OpAccept, listener.Sockfd(),
+            NULL, 0, 0, 0, callback, param), true);
+}
+
+bool EpollAsyncIO::Receive(Socket& sock, void* buffer, int length,
+        AsyncIOCallback callback, void* param, int flags)
+{
+    return SubmitSocketOp(NewOperation(AsyncOperation::OpReceive, sock.Sockfd(),
+            buffer, length, flags, 0, callback, param), true);
+}
+
+bool EpollAsyncIO::Send(Socket& sock, const void* buffer, int length,
+        AsyncIOCallback callback, void* param, int flags)
+{
+    return SubmitSocketOp(NewOperation(AsyncOperation::OpSend, sock.Sockfd(),
+            buffer, length, flags, 0, callback, param), false);
+}
+
+bool EpollAsyncIO::Read(int fd, void* buffer, int length, Int64 offset,
+        AsyncIOCallback callback, void* param)
+{
+    mFileOps.push_back(NewOperation(AsyncOperation::OpRead, fd,
+            buffer, length, 0, offset, callback, param));
+    mPending++;
+    return true;
+}
+
+bool EpollAsyncIO::Write(int fd, const void* buffer, int length, Int64 offset,
+        AsyncIOCallback callback, void* param)
+{
+    mFileOps.push_back(NewOperation(AsyncOperation::OpWrite, fd,
+            buffer, length, 0, offset, callback, param));
+    mPending++;
+    return true;
+}
+
+void EpollAsyncIO::Cancel(int fd)
+{
+    std::map<int, PendingOps>::iterator iter = mFds.find(fd);
+    if (iter != mFds.end())
+    {
+        PendingOps& ops = iter->second;
+        for (size_t i = 0; i < ops.readOps.size(); i++)
+        {
+            mCancelled.push_back(AsyncCompletion(ops.readOps[i], -ECANCELED));
+        }
+        for (size_t i = 0; i < ops.writeOps.size(); i++)
+        {
+            mCancelled.push_back(AsyncCompletion(ops.writeOps[i], -ECANCELED));
+        }
+        ops.readOps.clear();
+        ops.writeOps.clear();
+        UpdateInterest(fd);
+    }
+
+    std::deque<AsyncOperation*>::iterator fileOp = mFileOps.begin();
+    while (fileOp != mFileOps.end())
+    {
+        if ((*fileOp)->fd == fd)
+        {
+            mCancelled.push_back(AsyncCompletion(*fileOp, -ECANCELED));
+            fileOp = mFileOps.erase(fileOp);
+        }
+        else
+        {
+            ++fileOp;
+        }
+    }
+}
+
+bool EpollAsyncIO::RegisterBuffers(const iovec* buffers, int count)
+{
+    // Nothing to register for readiness based I/O
+    return true;
+}
+
+int EpollAsyncIO::Poll(const Timespan& timeout)
+{
+    std::vector<AsyncCompletion> completions;
+    completions.swap(mCancelled);
+
+    // Regular files are always ready
+    while (!mFileOps.empty())
+    {
+        AsyncOperation* op = mFileOps.front();
+        mFileOps.pop_front();
+        completions.push_back(AsyncCompletion(op, Execute(op)));
+    }
+
+    int timeoutMs = completions.empty() ? TimeoutToMilliseconds(timeout) : 0;
+    int n = 0;
+    if (!mFds.empty() || timeoutMs > 0)
+    {
+        n = epoll_wait(mEpollFd, &mEvents[0], (int)mEvents.size(), timeoutMs);
+        if (n < 0 && errno != EINTR)
+        {
+            LOG(LogError, "epoll_wait failed: %d", errno);
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        int fd = mEvents[i].data.fd;
+        std::map<int, PendingOps>::iterator iter = mFds.find(fd);
+        if (iter == mFds.end())
+        {
+            continue;
+        }
+
+        // On error/hang up, let the system calls report it
+        UInt32 events = mEvents[i].events;
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        {
+            ProcessQueue(iter->second.readOps, completions);
+        }
+        if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+        {
+            ProcessQueue(iter->second.writeOps, completions);
+        }
+        UpdateInterest(fd);
+    }
+
+    mPending -= (int)completions.size();
+
+    // Callbacks may submit or cancel operations, invoke them at last
+    return InvokeCallbacks(completions);
+}
+
+int EpollAsyncIO::GetPending() const
+{
+    return mPending;
+}
+
+bool EpollAsyncIO::SubmitSocketOp(AsyncOperation* op, bool isRead)
+{
+    if (op->fd == INVALID_SOCKET_T)
+    {
+        delete op;
+        return false;
+    }
+
+    std::map<int, PendingOps>::iterator iter = mFds.find(op->fd);
+    if (iter == mFds.end())
+    {
+        // Operations are executed when ready, they must never block
+        int flags = fcntl(op->fd, F_GETFL, 0);
+        if (!(flags & O_NONBLOCK))
+        {
+            fcntl(op->fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        iter = mFds.insert(std::make_pair(op->fd, PendingOps())).first;
+    }
+
+    if (isRead)
+    {
+        iter->second.readOps.push_back(op);
+    }
+    else
+    {
+        iter->second.writeOps.push_back(op);
+    }
+    mPending++;
+
+    UpdateInterest(op->fd);
+    return true;
+}
+
+void EpollAsyncIO::UpdateInterest(int fd)
+{
+    std::map<int, PendingOps>::iterator iter = mFds.find(fd);
+    if (iter == mFds.end())
+    {
+        return;
+    }
+
+    PendingOps& ops = iter->second;
+    UInt32 wanted = (ops.readOps.empty() ? 0 : EPOLLIN)
+            | (ops.writeOps.empty() ? 0 : EPOLLOUT);
+    if (wanted == ops.events)
+    {
+        if (wanted == 0)
+        {
+            mFds.erase(iter);
+        }
+        return;
+    }
+
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = wanted;
+    ev.data.fd = fd;
+
+    int rc;
+    if (ops.events == 0)
+    {
+        rc = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    else if (wanted == 0)
+    {
+        rc = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, &ev);
+    }
+    else
+    {
+        rc = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    if (rc != 0)
+    {
+        LOG(LogError, "epoll_ctl failed for %d: %d", fd, errno);
+    }
+
+    ops.events = wanted;
+    if (wanted == 0)
+    {
+        mFds.erase(iter);
+    }
+}
+
+void EpollAsyncIO::ProcessQueue(std::deque<AsyncOperation*>& ops,
+        std::vector<AsyncCompletion>& completions)
+{
+    while (!ops.empty())
+    {
+        AsyncOperation* op = ops.front();
+        int rc = Execute(op);
+        if (rc == -EAGAIN || rc == -EWOULDBLOCK)
+        {
+            break;
+        }
+
+        ops.pop_front();
+        completions.push_back(AsyncCompletion(op, rc));
+    }
+}
+
+int EpollAsyncIO::Execute(const AsyncOperation* op)
+{
+    int rc;
+    do
+    {
+        switch (op->type)
+        {
+        case AsyncOperation::OpAccept:
+            rc = accept(op->fd, NULL, NULL);
+            break;
+        case AsyncOperation::OpReceive:
+            rc = recv(op->fd, op->buffer, op->length, op->flags);
+            break;
+        case AsyncOperation::OpSend:
+            rc = send(op->fd, op->buffer, op->length, op->flags | MSG_NOSIGNAL);
+            break;
+        case AsyncOperation::OpRead:
+            rc = pread(op->fd, op->buffer, op->length, op->offset);
+            break;
+        case AsyncOperation::OpWrite:
+            rc = pwrite(op->fd, op->buffer, op->length, op->offset);
+            break;
+        default:
+            errno = EINVAL;
+            rc = -1;
+            break;
+        }
+    }
+    while (rc < 0 && errno == EINTR);
+
+    return rc < 0 ? -errno : rc;
+}
+
+#if defined(ASYNCIO_HAS_IO_URING)
+//////////////////////////////////////////////////////////////////////////
+// IOUringAsyncIO
+// Submits operations to an io_uring instance through the raw system calls.
+// Submissions are batched: they reach the kernel in the next Poll().
+class IOUringAsyncIO: public AsyncIO
+{
+public:
+    IOUringAsyncIO();
+    ~IOUringAsyncIO();
+
+    bool Init(unsigned int queueDepth);
+
+    Backend GetBackend() const
+    {
+        return BackendIOUring;
+    }
+
+    bool Accept(Socket& listener, AsyncIOCallback callback, void* param);
+    bool Receive(Socket& sock, void* buffer, int length,
+            AsyncIOCallback callback, void* param, int flags);
+    bool Send(Socket& sock, const void* buffer, int length,
+            AsyncIOCallback callback, void* param, int flags);
+    bool Read(int fd, void* buffer, int length, Int64 offset,
+            AsyncIOCallback callback, void* param);
+    bool Write(int fd, const void* buffer, int length, Int64 offset,
+            AsyncIOCallback callback, void* param);
+    void Cancel(int fd);
+    bool RegisterBuffers(const iovec* buffers, int count);
+    int Poll(const Timespan& timeout);
+    int GetPending() const;
+
+private:
+    // Returns a cleared submission queue entry, or NULL if the queue is full
+    io_uring_sqe* GetSqe();
+    bool Submit(AsyncOperation* op, UInt8 opcode, UInt64 offset, int bufIndex);
+    int Enter(unsigned int toSubmit, unsigned int minComplete);
+    int Reap(std::vector<AsyncCompletion>& completions);
+    bool IsOpSupported();
+    // Returns the index of the registered buffer containing [buffer, buffer + length), or -1
+    int FindBuffer(const void* buffer, int length) const;
+
+    static int Setup(unsigned int entries, io_uring_params* params);
+    static int Register(int fd, unsigned int opcode, void* arg, unsigned int nrArgs);
+
+private:
+    int mRingFd;
+
+    void* mSqRing;
+    size_t mSqRingSize;
+    void* mCqRing;
+    size_t mCqRingSize;
+    io_uring_sqe* mSqes;
+    size_t mSqesSize;
+
+    unsigned int* mSqHead;
+    unsigned int* mSqTail;
+    unsigned int mSqMask;
+    unsigned int mSqEntries;
+    unsigned int* mSqArray;
+
+    unsigned int* mCqHead;
+    unsigned int* mCqTail;
+    unsigned int mCqMask;
+    io_uring_cqe* mCqes;
+
+    // Prepared while not yet submitted entries
+    unsigned int mToSubmit;
+    std::set<AsyncOperation*> mInFlight;
+    std::vector<iovec> mBuffers;
+    // Read by the kernel when the timeout entry of Poll() is submitted, which may be
+    // a later call if the entry stays queued, so it must outlive Poll()
+    __kernel_timespec mTimeoutSpec;
+};
+
+// user_data of entries without operation
+static const UInt64 TimeoutUserData = 0;
+static const UInt64 CancelUserData = 1;
+
+IOUringAsyncIO::IOUringAsyncIO() :
+    mRingFd(-1), mSqRing(MAP_FAILED), mSqRingSize(0), mCqRing(MAP_FAILED), mCqRingSize(0),
+    mSqes((io_uring_sqe*)MAP_FAILED), mSqesSize(0), mSqHead(NULL), mSqTail(NULL),
+    mSqMask(0), mSqEntries(0), mSqArray(NULL), mCqHead(NULL), mCqTail(NULL),
+    mCqMask(0), mCqes(NULL), mToSubmit(0)
+{
+    mTimeoutSpec.tv_sec = 0;
+    mTimeoutSpec.tv_nsec = 0;
+}
+
+IOUringAsyncIO::~IOUringAsyncIO()
+{
+    // Closing the ring cancels the operations in the kernel
+    if (mRingFd >= 0)
+    {
+        ::close(mRingFd);
+    }
+
+    if ((void*)mSqes != MAP_FAILED)
+    {
+        munmap(mSqes, mSqesSize);
+    }
+    if (mCqRing != MAP_FAILED && mCqRing != mSqRing)
+    {
+        munmap(mCqRing, mCqRingSize);
+    }
+    if (mSqRing != MAP_FAILED)
+    {
+        munmap(mSqRing, mSqRingSize);
+    }
+
+    for (std::set<AsyncOperation*>::iterator iter = mInFlight.begin();
+            iter != mInFlight.end(); ++iter)
+    {
+        delete *iter;
+    }
+}
+
+int IOUringAsyncIO::Setup(unsigned int entries, io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int IOUringAsyncIO::Register(int fd, unsigned int opcode, void* arg, unsigned int nrArgs)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+bool IOUringAsyncIO::Init(unsigned int queueDepth)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    mRingFd = Setup(queueDepth > 0 ? queueDepth : 1, &params);
+    if (mRingFd < 0)
+    {
+        LOG(LogDebug, "io_uring_setup failed: %d", errno);
+        return false;
+    }
+
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap && mCqRingSize > mSqRingSize)
+    {
+        mSqRingSize = mCqRingSize;
+    }
+
+    mSqRing = mmap(NULL, mSqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+    if (mSqRing == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (singleMmap)
+    {
+        mCqRing = mSqRing;
+    }
+    else
+    {
+        mCqRing = mmap(NULL, mCqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+        if (mCqRing == MAP_FAILED)
+        {
+            return false;
+        }
+    }
+
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    mSqes = (io_uring_sqe*)mmap(NULL, mSqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+    if ((void*)mSqes == MAP_FAILED)
+    {
+        return false;
+    }
+
+    char* sq = (char*)mSqRing;
+    mSqHead = (unsigned int*)(sq + params.sq_off.head);
+    mSqTail = (unsigned int*)(sq + params.sq_off.tail);
+    mSqMask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+    mSqEntries = *(unsigned int*)(sq + params.sq_off.ring_entries);
+    mSqArray = (unsigned int*)(sq + params.sq_off.array);
+
+    char* cq = (char*)mCqRing;
+    mCqHead = (unsigned int*)(cq + params.cq_off.head);
+    mCqTail = (unsigned int*)(cq + params.cq_off.tail);
+    mCqMask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+    mCqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return IsOpSupported();
+}
+
+bool IOUringAsyncIO::IsOpSupported()
+{
+    // Old kernels have io_uring without networking operations
+    const int maxOps = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + maxOps * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(&buffer[0]);
+    if (Register(mRingFd, IORING_REGISTER_PROBE, probe, maxOps) < 0)
+    {
+        LOG(LogDebug, "io_uring probe failed: %d", errno);
+        return false;
+    }
+
+    const UInt8 required[] =
+    {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ,
+        IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED,
+        IORING_OP_TIMEOUT, IORING_OP_ASYNC_CANCEL
+    };
+    for (size_t i = 0; i < sizeof(required) / sizeof(required[0]); i++)
+    {
+        if (required[i] > probe->last_op ||
+                !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED))
+        {
+            LOG(LogDebug, "io_uring operation %d is not supported", required[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool IOUringAsyncIO::Accept(Socket& listener, AsyncIOCallback callback, void* param)
+{
+    AsyncOperation* op = NewOperation(AsyncOperation::OpAccept, listener.Sockfd(),
+            NULL, 0, 0, 0, callback, param);
+    return Submit(op, IORING_OP_ACCEPT, 0, -1);
+}
+
+bool IOUringAsyncIO::Receive(Socket& sock, void* buffer, int length,
+        AsyncIOCallback callback, void* param, int flags)
+{
+    AsyncOperation* op = NewOperation(AsyncOperation::OpReceive, sock.Sockfd(),
+            buffer, length, flags, 0, callback, param);
+    return Submit(op, IORING_OP_RECV, 0, -1);
+}
+
+bool IOUringAsyncIO::Send(Socket& sock, const void* buffer, int length,
+        AsyncIOCallback callback, void* param, int flags)
+{
+    AsyncOperation* op = NewOperation(AsyncOperation::OpSend, sock.Sockfd(),
+            buffer, length, flags | MSG_NOSIGNAL, 0, callback, param);
+    return Submit(op, IORING_OP_SEND, 0, -1);
+}
+
+bool IOUringAsyncIO::Read(int fd, void* buffer, int length, Int64 offset,
+        AsyncIOCallback callback, void* param)
+{
+    AsyncOperation* op = NewOperation(AsyncOperation::OpRead, fd,
+            buffer, length, 0, offset, callback, param);
+    int bufIndex = FindBuffer(buffer, length);
+    return Submit(op, bufIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ,
+            (UInt64)offset, bufIndex);
+}
+
+bool IOUringAsyncIO::Write(int fd, const void* buffer, int length, Int64 offset,
+        AsyncIOCallback callback, void* param)
+{
+    AsyncOperation* op = NewOperation(AsyncOperation::OpWrite, fd,
+            buffer, length, 0, offset, callback, param);
+    int bufIndex = FindBuffer(buffer, length);
+    return Submit(op, bufIndex >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE,
+            (UInt64)offset, bufIndex);
+}
+
+void IOUringAsyncIO::Cancel(int fd)
+{
+    for (std::set<AsyncOperation*>::iterator iter = mInFlight.begin();
+            iter != mInFlight.end(); ++iter)
+    {
+        if ((*iter)->fd != fd)
+        {
+            continue;
+        }
+
+        io_uring_sqe* sqe = GetSqe();
+        if (!sqe)
+        {
+            LOG(LogError, "io_uring submission queue is full, cannot cancel %d", fd);
+            break;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (UInt64)(uintptr_t)(*iter);
+        sqe->user_data = CancelUserData;
+    }
+
+    // Cancel promptly, the descriptor is usually closed right after
+    Enter(mToSubmit, 0);
+}
+
+bool IOUringAsyncIO::RegisterBuffers(const iovec* buffers, int count)
+{
+    if (!mBuffers.empty())
+    {
+        Register(mRingFd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        mBuffers.clear();
+    }
+
+    if (count <= 0 || buffers == NULL)
+    {
+        return true;
+    }
+
+    if (Register(mRingFd, IORING_REGISTER_BUFFERS, const_cast<iovec*>(buffers), count) < 0)
+    {
+        LOG(LogError, "io_uring buffer registration failed: %d", errno);
+        return false;
+    }
+
+    mBuffers.assign(buffers, buffers + count);
+    return true;
+}
+
+int IOUringAsyncIO::Poll(const Timespan& timeout)
+{
+    std::vector<AsyncCompletion> completions;
+    Reap(completions);
+
+    if (!completions.empty() || timeout <= 0)
+    {
+        Enter(mToSubmit, 0);
+        Reap(completions);
+        return InvokeCallbacks(completions);
+    }
+
+    // The timeout entry completes when it expires, or when another entry completes.
+    // The kernel copies the timespec when the entry is submitted.
+    mTimeoutSpec.tv_sec = timeout.GetTotalSeconds();
+    mTimeoutSpec.tv_nsec = (long long)timeout.GetUseconds() * 1000;
+    io_uring_sqe* sqe = GetSqe();
+    if (sqe)
+    {
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (UInt64)(uintptr_t)&mTimeoutSpec;
+        sqe->len = 1;
+        sqe->off = 1;
+        sqe->user_data = TimeoutUserData;
+        Enter(mToSubmit, 1);
+    }
+    else
+    {
+        Enter(mToSubmit, 0);
+    }
+
+    Reap(completions);
+    return InvokeCallbacks(completions);
+}
+
+int IOUringAsyncIO::GetPending() const
+{
+    return (int)mInFlight.size();
+}
+
+io_uring_sqe* IOUringAsyncIO::GetSqe()
+{
+    unsigned int tail = *mSqTail;
+    unsigned int head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+    if (tail - head >= mSqEntries)
+    {
+        // Full, hand the prepared entries to the kernel
+        Enter(mToSubmit, 0);
+        head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= mSqEntries)
+        {
+            return NULL;
+        }
+    }
+
+    unsigned int index = tail & mSqMask;
+    io_uring_sqe* sqe = &mSqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    mSqArray[index] = index;
+    __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+    mToSubmit++;
+    return sqe;
+}
+
+bool IOUringAsyncIO::Submit(AsyncOperation* op, UInt8 opcode, UInt64 offset, int bufIndex)
+{
+    if (op->fd < 0)
+    {
+        delete op;
+        return false;
+    }
+
+    io_uring_sqe* sqe = GetSqe();
+    if (!sqe)
+    {
+        LOG(LogError, "io_uring submission queue is full");
+        delete op;
+        return false;
+    }
+
+    sqe->opcode = opcode;
+    sqe->fd = op->fd;
+    sqe->addr = (UInt64)(uintptr_t)op->buffer;
+    sqe->len = (UInt32)op->length;
+    sqe->off = offset;
+    if (opcode == IORING_OP_RECV || opcode == IORING_OP_SEND)
+    {
+        sqe->msg_flags = (UInt32)op->flags;
+    }
+    if (bufIndex >= 0)
+    {
+        sqe->buf_index = (UInt16)bufIndex;
+    }
+    sqe->user_data = (UInt64)(uintptr_t)op;
+
+    mInFlight.insert(op);
+    return true;
+}
+
+int IOUringAsyncIO::Enter(unsigned int toSubmit, unsigned int minComplete)
+{
+    if (toSubmit == 0 && minComplete == 0)
+    {
+        return 0;
+    }
+
+    int rc = (int)syscall(__NR_io_uring_enter, mRingFd, toSubmit, minComplete,
+            minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (rc < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            LOG(LogError, "io_uring_enter failed: %d", errno);
+        }
+        return -1;
+    }
+
+    mToSubmit -= (unsigned int)rc;
+    return rc;
+}
+
+int IOUringAsyncIO::Reap(std::vector<AsyncCompletion>& completions)
+{
+    int count = 0;
+    unsigned int head = *mCqHead;
+    unsigned int tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        io_uring_cqe* cqe = &mCqes[head & mCqMask];
+        if (cqe->user_data != TimeoutUserData && cqe->user_data != CancelUserData)
+        {
+            AsyncOperation* op = (AsyncOperation*)(uintptr_t)cqe->user_data;
+            mInFlight.erase(op);
+            completions.push_back(AsyncCompletion(op, cqe->res));
+            count++;
+        }
+        head++;
+    }
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+int IOUringAsyncIO::FindBuffer(const void* buffer, int length) const
+{
+    const char* begin = (const char*)buffer;
+    for (size_t i = 0; i < mBuffers.size(); i++)
+    {
+        const char* base = (const char*)mBuffers[i].iov_base;
+        if (begin >= base && begin + length <= base + mBuffers[i].iov_len)
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+#endif // ASYNCIO_HAS_IO_URING
+
+//////////////////////////////////////////////////////////////////////////
+// AsyncIO
+AsyncIO::AsyncIO()
+{
+}
+
+AsyncIO::~AsyncIO()
+{
+}
+
+AsyncIO* AsyncIO::Create(Backend backend, unsigned int queueDepth)
+{
+#if defined(ASYNCIO_HAS_IO_URING)
+    if (backend == BackendAuto || backend == BackendIOUring)
+    {
+        IOUringAsyncIO* uring = new IOUringAsyncIO;
+        if (uring->Init(queueDepth))
+        {
+            return uring;
+        }
+        delete uring;
+
+        if (backend == BackendIOUring)
+        {
+            return NULL;
+        }
+        LOG(LogInfo, "io_uring is not available, fall back to epoll");
+    }
+#else
+    if (backend == BackendIOUring)
+    {
+        return NULL;
+    }
+#endif
+
+    EpollAsyncIO* epoll = new EpollAsyncIO;
+    if (!epoll->Init(queueDepth))
+    {
+        delete epoll;
+        return NULL;
+    }
+
+    return epoll;
+}
+
+bool AsyncIO::IsIOUringSupported()
+{
+#if defined(ASYNCIO_HAS_IO_URING)
+    IOUringAsyncIO uring;
+    return uring.Init(2);
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////
+// AsyncIO.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef AsyncIO_INCLUDED
+#define AsyncIO_INCLUDED
+
+#include <sys/uio.h>
+#include "Types.h"
+#include "Socket.h"
+#include "Timespan.h"
+
+// Completion callback of an asynchronous operation.
+// result is the return value of the corresponding system call
+// (bytes transferred, or the accepted socket descriptor),
+// or a negative errno value (e.g. -ECANCELED) on failure.
+// param is the data passed when the operation was submitted.
+typedef void (*AsyncIOCallback)(int result, void* param);
+
+// Asynchronous socket and file I/O.
+// Operations are submitted with Accept/Receive/Send/Read/Write, and their
+// callbacks are invoked from Poll(), in the thread calling Poll().
+// Buffers must stay valid until the callback is invoked.
+// An AsyncIO is not thread-safe: submit and poll from the same (event) thread.
+//
+// Two backends are provided:
+//   * io_uring: operations are executed by the kernel, no readiness round trips.
+//     Buffers registered by RegisterBuffers() are used with fixed-buffer reads/writes.
+//   * epoll: readiness based, the operations are executed in Poll().
+//     Regular files are not pollable, so file reads/writes are executed in Poll() synchronously.
+// Create() picks io_uring when the running kernel supports it, else falls back to epoll.
+class AsyncIO
+{
+public:
+    enum Backend
+    {
+        BackendAuto, BackendIOUring, BackendEpoll
+    };
+
+    // Creates an AsyncIO for the requested backend.
+    // With BackendAuto, io_uring is used if available, else epoll.
+    // queueDepth is the number of operations which can be in flight without extra submission calls.
+    // Returns NULL if the requested backend is not available.
+    static AsyncIO* Create(Backend backend = BackendAuto, unsigned int queueDepth = 256);
+
+    // Returns true if the running kernel supports the io_uring backend.
+    static bool IsIOUringSupported();
+
+    virtual ~AsyncIO();
+
+    // Returns the backend actually used.
+    virtual Backend GetBackend() const = 0;
+
+    // Accepts a connection on the listening socket.
+    // The result is the new socket descriptor, which can be attached to a Socket.
+    virtual bool Accept(Socket& listener, AsyncIOCallback callback, void* param) = 0;
+
+    // Receives up to length bytes from the socket.
+    // The result is the number of bytes received, 0 means the peer has shut down.
+    virtual bool Receive(Socket& sock, void* buffer, int length,
+            AsyncIOCallback callback, void* param, int flags = 0) = 0;
+
+    // Sends up to length bytes through the socket.
+    // The result is the number of bytes sent, which may be less than length.
+    virtual bool Send(Socket& sock, const void* buffer, int length,
+            AsyncIOCallback callback, void* param, int flags = 0) = 0;
+
+    // Reads up to length bytes from the file at the given offset.
+    virtual bool Read(int fd, void* buffer, int length, Int64 offset,
+            AsyncIOCallback callback, void* param) = 0;
+
+    // Writes up to length bytes to the file at the given offset.
+    virtual bool Write(int fd, const void* buffer, int length, Int64 offset,
+            AsyncIOCallback callback, void* param) = 0;
+
+    // Cancels all pending operations of the descriptor.
+    // Their callbacks are invoked with -ECANCELED (or their result, if they already completed).
+    // Must be called before closing a descriptor with pending operations.
+    virtual void Cancel(int fd) = 0;
+
+    // Registers buffers with the kernel, so that reads/writes into them skip
+    // the page mapping on each operation. Replaces the previously registered buffers.
+    // Does nothing (and succeeds) on backends without buffer registration.
+    virtual bool RegisterBuffers(const iovec* buffers, int count) = 0;
+
+    // Waits up to timeout for completions and invokes their callbacks.
+    // A zero timeout only processes the completions already available.
+    // Returns the number of callbacks invoked, or -1 on error.
+    virtual int Poll(const Timespan& timeout) = 0;
+
+    // Returns the number of operations not completed yet.
+    virtual int GetPending() const = 0;
+
+protected:
+    AsyncIO();
+
+private:
+    AsyncIO(const AsyncIO&);
+    AsyncIO& operator =(const AsyncIO&);
+};
+
+#endif // AsyncIO_INCLUDED
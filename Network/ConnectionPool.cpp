@@ -0,0 +1,215 @@
+//////////////////////////////////////////////////////////////////////////
+// ConnectionPool.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "ConnectionPool.h"
+#include "Log.h"
+#include <cstring>
+
+ConnectionPool::ConnectionPool(int maxPerHost, const Timespan& idleTimeout,
+        const Timespan& connectTimeout) :
+    mMaxPerHost(maxPerHost > 0 ? maxPerHost : 1),
+    mIdleTimeout(idleTimeout),
+    mConnectTimeout(connectTimeout)
+{
+    std::memset(&mStats, 0, sizeof(mStats));
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    Clear();
+}
+
+Socket* ConnectionPool::Acquire(const SocketAddress& address,
+        const Timespan& waitTimeout, ErrorCode& errorCode)
+{
+    errorCode = ErrorOK;
+    if (address.GetAddr() == NULL)
+    {
+        errorCode = ErrorNetworkAddrNotAvailable;
+        return NULL;
+    }
+
+    std::string key = MakeKey(address);
+    Timestamp start;
+    bool waited = false;
+
+    {
+        AutoCriticalSection autoLock(&mCriticalSection);
+        for (;;)
+        {
+            HostConnections& host = mHosts[key];
+            PurgeIdle(host);
+
+            // Reuse the most recently released connection first,
+            // it is the least likely to have been closed by the peer.
+            while (!host.idle.empty())
+            {
+                Socket* sock = host.idle.back().sock;
+                host.idle.pop_back();
+                mStats.idle--;
+
+                if (IsAlive(sock))
+                {
+                    host.inUse++;
+                    mStats.inUse++;
+                    mStats.hits++;
+                    return sock;
+                }
+
+                LOG(LogDebug, "Drop dead pooled connection: %s", address.ToString().c_str());
+                mStats.evictions++;
+                delete sock;
+            }
+
+            if (host.inUse < mMaxPerHost)
+            {
+                // Reserve the slot, and connect out of the lock
+                host.inUse++;
+                mStats.inUse++;
+                mStats.misses++;
+                break;
+            }
+
+            if (!waited)
+            {
+                waited = true;
+                mStats.waits++;
+            }
+
+            Int64 remaining = waitTimeout.GetTotalMicroseconds() - start.GetElapsed();
+            if (remaining <= 0)
+            {
+                LOG(LogError, "Timed out waiting for pooled connection: %s",
+                        address.ToString().c_str());
+                mStats.waitTimeouts++;
+                errorCode = ErrorNetworkTimeout;
+                return NULL;
+            }
+
+            // Check again once anything is released, or the wait times out
+            mReleased.Wait(mCriticalSection, long(remaining / 1000) + 1);
+        }
+    }
+
+    Socket* sock = new Socket(SOCK_STREAM);
+    errorCode = sock->Connect(address, mConnectTimeout);
+    if (errorCode != ErrorOK)
+    {
+        delete sock;
+        Release(address, NULL, false);
+        return NULL;
+    }
+
+    return sock;
+}
+
+void ConnectionPool::Release(const SocketAddress& address, Socket* sock, bool reusable)
+{
+    {
+        AutoCriticalSection autoLock(&mCriticalSection);
+        std::map<std::string, HostConnections>::iterator iter =
+                mHosts.find(MakeKey(address));
+        if (iter != mHosts.end() && iter->second.inUse > 0)
+        {
+            iter->second.inUse--;
+            mStats.inUse--;
+
+            if (sock && reusable && sock->Sockfd() != INVALID_SOCKET_T &&
+                    mIdleTimeout > 0)
+            {
+                IdleConnection conn;
+                conn.sock = sock;
+                iter->second.idle.push_back(conn);
+                mStats.idle++;
+                sock = NULL;
+            }
+        }
+        else if (sock)
+        {
+            LOG(LogError, "Release a connection which is not from pool: %s",
+                    address.ToString().c_str());
+        }
+
+        // One slot of this host becomes available
+        mReleased.Broadcast();
+    }
+
+    if (sock)
+    {
+        delete sock;
+    }
+}
+
+void ConnectionPool::PurgeIdle()
+{
+    AutoCriticalSection autoLock(&mCriticalSection);
+    std::map<std::string, HostConnections>::iterator iter = mHosts.begin();
+    while (iter != mHosts.end())
+    {
+        PurgeIdle(iter->second);
+        if (iter->second.idle.empty() && iter->second.inUse == 0)
+        {
+            mHosts.erase(iter++);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+}
+
+void ConnectionPool::Clear()
+{
+    AutoCriticalSection autoLock(&mCriticalSection);
+    for (std::map<std::string, HostConnections>::iterator iter = mHosts.begin();
+            iter != mHosts.end(); ++iter)
+    {
+        std::list<IdleConnection>& idle = iter->second.idle;
+        for (std::list<IdleConnection>::iterator conn = idle.begin();
+                conn != idle.end(); ++conn)
+        {
+            delete conn->sock;
+        }
+        mStats.idle -= idle.size();
+        idle.clear();
+    }
+}
+
+ConnectionPoolStats ConnectionPool::GetStats() const
+{
+    AutoCriticalSection autoLock(&mCriticalSection);
+    return mStats;
+}
+
+std::string ConnectionPool::MakeKey(const SocketAddress& address)
+{
+    return std::string(reinterpret_cast<const char*>(address.GetAddr()),
+            address.GetLength());
+}
+
+bool ConnectionPool::IsAlive(Socket* sock)
+{
+    if (sock->Sockfd() == INVALID_SOCKET_T)
+    {
+        return false;
+    }
+
+    // An idle connection must have nothing to read.
+    // Readable means the peer has closed/reset it, or sent unexpected data.
+    return !sock->Poll(Timespan(0), Socket::SELECT_READ | Socket::SELECT_ERROR);
+}
+
+void ConnectionPool::PurgeIdle(HostConnections& host)
+{
+    // Idle list is ordered by release time, the oldest first
+    while (!host.idle.empty() &&
+            host.idle.front().releasedAt.IsElapsed(mIdleTimeout.GetTotalMicroseconds()))
+    {
+        delete host.idle.front().sock;
+        host.idle.pop_front();
+        mStats.idle--;
+        mStats.evictions++;
+    }
+}
@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////////////////////////////
+// ConnectionPool.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ConnectionPool_INCLUDED
+#define ConnectionPool_INCLUDED
+
+#include <map>
+#include <list>
+#include <string>
+#include "Types.h"
+#include "Socket.h"
+#include "SocketAddress.h"
+#include "Timespan.h"
+#include "Timestamp.h"
+#include "CriticalSection.h"
+#include "Condition.h"
+
+// Counters of a ConnectionPool.
+struct ConnectionPoolStats
+{
+    // Acquire() served by an idle pooled connection
+    UInt64 hits;
+    // Acquire() had to open a new connection
+    UInt64 misses;
+    // Acquire() had to wait because the host reached its connection limit
+    UInt64 waits;
+    // Acquire() gave up waiting for a free connection
+    UInt64 waitTimeouts;
+    // Idle connections dropped because they were expired or found dead
+    UInt64 evictions;
+    // Connections currently handed out to callers
+    int inUse;
+    // Connections currently idle in the pool
+    int idle;
+};
+
+// A thread-safe pool of connected outbound TCP sockets, keyed by SocketAddress.
+// Sockets are borrowed with Acquire() and must be given back with Release().
+// Idle sockets are closed after the idle timeout, and are checked for
+// liveness (peer has not closed nor sent unexpected data) before reuse.
+// The pool must outlive all the sockets borrowed from it.
+class ConnectionPool
+{
+public:
+    // maxPerHost limits the number of connections (idle and in use) per address.
+    // idleTimeout is how long a released connection is kept for reuse.
+    // connectTimeout is used when a new connection has to be established.
+    ConnectionPool(int maxPerHost = 8,
+            const Timespan& idleTimeout = Timespan(60, 0),
+            const Timespan& connectTimeout = Timespan(5, 0));
+
+    // Closes all idle connections.
+    ~ConnectionPool();
+
+    // Returns a connected socket for the given address, reusing an idle one if possible.
+    // If the address already has maxPerHost connections, waits up to waitTimeout
+    // for one to be released.
+    // Returns NULL on connect failure or wait timeout, errorCode tells why.
+    Socket* Acquire(const SocketAddress& address, const Timespan& waitTimeout,
+            ErrorCode& errorCode);
+
+    // Gives a socket acquired for address back to the pool.
+    // If reusable is false (e.g. protocol error, peer asked to close),
+    // the socket is closed instead of being kept.
+    void Release(const SocketAddress& address, Socket* sock, bool reusable = true);
+
+    // Closes idle connections which have been idle longer than the idle timeout.
+    // Acquire() purges the requested address only, call this periodically
+    // to purge addresses which are not used any more.
+    void PurgeIdle();
+
+    // Closes all idle connections.
+    void Clear();
+
+    // Returns a snapshot of the pool counters.
+    ConnectionPoolStats GetStats() const;
+
+    int GetMaxPerHost() const
+    {
+        return mMaxPerHost;
+    }
+
+    const Timespan& GetIdleTimeout() const
+    {
+        return mIdleTimeout;
+    }
+
+private:
+    struct IdleConnection
+    {
+        Socket* sock;
+        Timestamp releasedAt;
+    };
+
+    struct HostConnections
+    {
+        HostConnections() : inUse(0)
+        {
+        }
+
+        std::list<IdleConnection> idle;
+        int inUse;
+    };
+
+    // The raw native address is used as key, which avoids formatting addresses.
+    static std::string MakeKey(const SocketAddress& address);
+
+    // Returns true if an idle socket can be reused.
+    static bool IsAlive(Socket* sock);
+
+    // Closes the expired idle connections of one host. Lock must be held.
+    void PurgeIdle(HostConnections& host);
+
+private:
+    ConnectionPool(const ConnectionPool&);
+    ConnectionPool& operator =(const ConnectionPool&);
+
+private:
+    int mMaxPerHost;
+    Timespan mIdleTimeout;
+    Timespan mConnectTimeout;
+
+    std::map<std::string, HostConnections> mHosts;
+    ConnectionPoolStats mStats;
+
+    mutable CriticalSection mCriticalSection;
+    // Signaled whenever a connection is released
+    Condition mReleased;
+};
+
+#endif // ConnectionPool_INCLUDED
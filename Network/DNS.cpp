@@ -37,7 +37,7 @@ bool DNS::HostByAddress(const IPAddress& address, HostEntry& hostEntry)
         return false;
     }
 
-    static char fqname[1024];
+    char fqname[NI_MAXHOST];
     int rc = getnameinfo(sa.GetAddr(), sa.GetLength(), fqname,
             sizeof(fqname), NULL, 0, NI_NAMEREQD);
     if (rc == 0)
@@ -0,0 +1,588 @@
+//////////////////////////////////////////////////////////////////////////
+// DNSClient.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "DNSClient.h"
+#include "Log.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+// Largest message received; 512 bytes without EDNS, in case a server sends more
+static const size_t MAX_RECEIVE = 4096;
+static const size_t MAX_NAME_LENGTH = 255;
+static const size_t MAX_LABEL_LENGTH = 63;
+
+// Flags word of the header
+static const UInt16 FLAG_RESPONSE = 0x8000;
+static const UInt16 FLAG_TRUNCATED = 0x0200;
+static const UInt16 FLAG_RECURSION_DESIRED = 0x0100;
+static const UInt16 RESPONSE_CODE_MASK = 0x000f;
+
+static UInt16 ReadUInt16(const unsigned char* p)
+{
+    return UInt16((p[0] << 8) | p[1]);
+}
+
+static UInt32 ReadUInt32(const unsigned char* p)
+{
+    return (UInt32(p[0]) << 24) | (UInt32(p[1]) << 16) | (UInt32(p[2]) << 8) | p[3];
+}
+
+// Reads the possibly compressed name at offset, moving offset past it.
+// Returns false if it runs out of the message or loops.
+static bool ReadName(const unsigned char* data, size_t length, size_t& offset, std::string& name)
+{
+    name.clear();
+    size_t pos = offset;
+    bool jumped = false;
+    // Each jump goes to an earlier name, so a message can not hold more than this
+    int jumps = 0;
+    while (true)
+    {
+        if (pos >= length)
+        {
+            return false;
+        }
+        unsigned char labelLength = data[pos];
+        if ((labelLength & 0xc0) == 0xc0)
+        {
+            // Compression pointer to the rest of the name
+            if (pos + 1 >= length || ++jumps > int(MAX_NAME_LENGTH / 2))
+            {
+                return false;
+            }
+            if (!jumped)
+            {
+                offset = pos + 2;
+                jumped = true;
+            }
+            pos = ((labelLength & 0x3f) << 8) | data[pos + 1];
+            continue;
+        }
+        if (labelLength > MAX_LABEL_LENGTH)
+        {
+            return false;
+        }
+        if (labelLength == 0)
+        {
+            if (!jumped)
+            {
+                offset = pos + 1;
+            }
+            return true;
+        }
+        if (pos + 1 + labelLength > length || name.size() + labelLength + 1 > MAX_NAME_LENGTH)
+        {
+            return false;
+        }
+        if (!name.empty())
+        {
+            name += '.';
+        }
+        name.append(reinterpret_cast<const char*>(data + pos + 1), labelLength);
+        pos += 1 + labelLength;
+    }
+}
+
+static bool EqualsIgnoreCase(const std::string& a, const std::string& b)
+{
+    return a.size() == b.size() && strncasecmp(a.c_str(), b.c_str(), a.size()) == 0;
+}
+
+// Without the trailing dot of a fully qualified name
+static std::string StripDot(const std::string& name)
+{
+    if (!name.empty() && name[name.size() - 1] == '.')
+    {
+        return name.substr(0, name.size() - 1);
+    }
+    return name;
+}
+
+DNSClient::DNSClient() :
+    mSocket4(NULL), mSocket6(NULL), mTimeout(2 * Timespan::Second), mAttempts(3), mSendCount(0), mNextServer(0)
+{
+    Timestamp now;
+    mRandom = UInt32(now.GetEpochMicroseconds()) ^ (UInt32(getpid()) << 16);
+    if (mRandom == 0)
+    {
+        mRandom = 1;
+    }
+}
+
+DNSClient::~DNSClient()
+{
+    for (std::map<UInt16, PendingQuery*>::iterator iter = mPending.begin();
+            iter != mPending.end(); ++iter)
+    {
+        delete iter->second;
+    }
+    delete mSocket4;
+    delete mSocket6;
+}
+
+bool DNSClient::AddServer(const SocketAddress& server)
+{
+    Socket*& sock = server.GetAF() == AF_INET6 ? mSocket6 : mSocket4;
+    if (sock == NULL)
+    {
+        // The kernel picks a random source port on the first send
+        sock = new Socket(server.GetAF() == AF_INET6 ? IPAddress::IPv6 : IPAddress::IPv4,
+                SOCK_DGRAM);
+        if (sock->Sockfd() < 0)
+        {
+            delete sock;
+            sock = NULL;
+            return false;
+        }
+        mPoller.Add(sock, Socket::SELECT_READ);
+    }
+
+    Server entry;
+    entry.address = server;
+    entry.sock = sock;
+    mServers.push_back(entry);
+    return true;
+}
+
+bool DNSClient::LoadResolvConf(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        return false;
+    }
+
+    bool added = false;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream words(line);
+        std::string keyword;
+        std::string address;
+        if (!(words >> keyword >> address) || keyword != "nameserver")
+        {
+            continue;
+        }
+        // Drop an IPv6 zone, e.g. "fe80::1%eth0"
+        address = address.substr(0, address.find('%'));
+
+        bool hasError = false;
+        SocketAddress server(address, 53, hasError);
+        if (!hasError && AddServer(server))
+        {
+            added = true;
+        }
+    }
+    return added;
+}
+
+bool DNSClient::Query(const std::string& name, NSType type, DNSQueryCallback callback,
+        void* param)
+{
+    if (mServers.empty() || mPending.size() >= 0xffff)
+    {
+        return false;
+    }
+
+    PendingQuery* query = new PendingQuery;
+    query->id = NewID();
+    query->type = type;
+    query->name = StripDot(name);
+    query->callback = callback;
+    query->param = param;
+    query->server = mNextServer++ % mServers.size();
+    query->attempts = 0;
+    if (!BuildQuery(query->id, query->name, type, query->message))
+    {
+        delete query;
+        return false;
+    }
+
+    mPending[query->id] = query;
+    if (!Send(query))
+    {
+        // Counts as an attempt, the next server is tried when it times out
+        LOG(LogDebug, "Failed to send DNS query for %s", query->name.c_str());
+    }
+    return true;
+}
+
+int DNSClient::Process(const Timespan& timeout)
+{
+    int completed = 0;
+
+    // Wait no longer than the first deadline
+    Timestamp now;
+    Int64 wait = timeout.GetTotalMicroseconds();
+    if (!mDeadlines.empty())
+    {
+        Int64 untilDeadline = mDeadlines.front().time - now;
+        if (wait < 0 || untilDeadline < wait)
+        {
+            wait = untilDeadline < 0 ? 0 : untilDeadline;
+        }
+    }
+
+    if (mPoller.GetCount() > 0 && mPoller.PollNanoseconds(wait * 1000) > 0)
+    {
+        for (int i = 0; i < mPoller.GetCount(); i++)
+        {
+            if (mPoller.GetReady(i) != 0)
+            {
+                Receive(mPoller.GetSocket(i), completed);
+            }
+        }
+    }
+
+    // Attempts timed out; entries of completed queries or earlier attempts are stale
+    now.Update();
+    while (!mDeadlines.empty() && mDeadlines.front().time <= now)
+    {
+        Deadline deadline = mDeadlines.front();
+        mDeadlines.pop_front();
+        std::map<UInt16, PendingQuery*>::iterator iter = mPending.find(deadline.id);
+        if (iter != mPending.end() && iter->second->lastSend == deadline.send)
+        {
+            Retry(iter->second, completed);
+        }
+    }
+
+    return completed;
+}
+
+struct ResolveContext
+{
+    DNSResponse* response;
+    bool done;
+};
+
+static void OnResolved(const DNSResponse& response, void* param)
+{
+    ResolveContext* context = static_cast<ResolveContext*>(param);
+    *context->response = response;
+    context->done = true;
+}
+
+bool DNSClient::Resolve(const std::string& name, NSType type, DNSResponse& response)
+{
+    ResolveContext context = { &response, false };
+    if (!Query(name, type, OnResolved, &context))
+    {
+        return false;
+    }
+
+    while (!context.done)
+    {
+        Process(Timespan(mTimeout));
+    }
+    return response.success;
+}
+
+std::string DNSClient::GetReverseName(const IPAddress& address)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(address.GetAddr());
+    std::string name;
+    if (address.GetFamily() == IPAddress::IPv4)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u.in-addr.arpa",
+                bytes[3], bytes[2], bytes[1], bytes[0]);
+        name = buffer;
+    }
+    else
+    {
+        static const char HEX_DIGITS[] = "0123456789abcdef";
+        for (int i = 15; i >= 0; i--)
+        {
+            name += HEX_DIGITS[bytes[i] & 0xf];
+            name += '.';
+            name += HEX_DIGITS[bytes[i] >> 4];
+            name += '.';
+        }
+        name += "ip6.arpa";
+    }
+    return name;
+}
+
+bool DNSClient::BuildQuery(UInt16 id, const std::string& name, NSType type, std::string& message)
+{
+    DNSHeader header;
+    memset(&header, 0, sizeof(header));
+    header.id = htons(id);
+    header.flags = htons(FLAG_RECURSION_DESIRED);
+    header.qdCount = htons(1);
+    message.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // Labels, each prefixed with its length
+    std::string qname = StripDot(name);
+    if (qname.empty() || qname.size() > MAX_NAME_LENGTH - 2)
+    {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= qname.size())
+    {
+        size_t end = qname.find('.', start);
+        if (end == std::string::npos)
+        {
+            end = qname.size();
+        }
+        size_t labelLength = end - start;
+        if (labelLength == 0 || labelLength > MAX_LABEL_LENGTH)
+        {
+            return false;
+        }
+        message += char(labelLength);
+        message.append(qname, start, labelLength);
+        start = end + 1;
+    }
+    message += '\0';
+
+    DNSQuery query;
+    query.type = htons(UInt16(type));
+    query.classes = htons(NSClassInternet);
+    message.append(reinterpret_cast<const char*>(&query), sizeof(query));
+    return true;
+}
+
+bool DNSClient::ParseResponse(const char* buffer, size_t length, UInt16& id,
+        DNSResponse& response)
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(buffer);
+    if (length < sizeof(DNSHeader))
+    {
+        return false;
+    }
+
+    DNSHeader header;
+    memcpy(&header, data, sizeof(header));
+    id = ntohs(header.id);
+    UInt16 flags = ntohs(header.flags);
+    if ((flags & FLAG_RESPONSE) == 0)
+    {
+        return false;
+    }
+    response.truncated = (flags & FLAG_TRUNCATED) != 0;
+    response.responseCode = NSResponseCode(flags & RESPONSE_CODE_MASK);
+    response.answers.clear();
+
+    // The question, as asked
+    size_t offset = sizeof(DNSHeader);
+    if (ntohs(header.qdCount) != 1 || !ReadName(data, length, offset, response.name) ||
+            offset + sizeof(DNSQuery) > length)
+    {
+        return false;
+    }
+    DNSQuery query;
+    memcpy(&query, data + offset, sizeof(query));
+    response.type = NSType(ntohs(query.type));
+    offset += sizeof(DNSQuery);
+
+    int answerCount = ntohs(header.anCount);
+    for (int i = 0; i < answerCount; i++)
+    {
+        DNSRecord record;
+        // Name, then type, class, TTL and data length
+        if (!ReadName(data, length, offset, record.name) || offset + 10 > length)
+        {
+            // A truncated message may end early
+            break;
+        }
+        record.type = NSType(ReadUInt16(data + offset));
+        record.ttl = ReadUInt32(data + offset + 4);
+        size_t dataLength = ReadUInt16(data + offset + 8);
+        offset += 10;
+        if (offset + dataLength > length)
+        {
+            break;
+        }
+
+        size_t rdata = offset;
+        bool valid = true;
+        bool hasError = false;
+        switch (record.type)
+        {
+        case NSTypeHostAddr:
+        case NSTypeIP6Addr:
+            valid = dataLength == (record.type == NSTypeHostAddr ? 4u : 16u);
+            if (valid)
+            {
+                record.address = IPAddress(data + rdata, dataLength, hasError);
+                valid = !hasError;
+            }
+            break;
+        case NSTypeDomainPtr:
+        case NSTypeCanonicalName:
+            valid = ReadName(data, length, rdata, record.target);
+            break;
+        case NSTypeMX:
+            valid = dataLength >= 3;
+            if (valid)
+            {
+                record.preference = ReadUInt16(data + rdata);
+                rdata += 2;
+                valid = ReadName(data, length, rdata, record.target);
+            }
+            break;
+        case NSTypeText:
+            while (valid && rdata < offset + dataLength)
+            {
+                size_t textLength = data[rdata];
+                valid = rdata + 1 + textLength <= offset + dataLength;
+                if (valid)
+                {
+                    record.texts.push_back(std::string(
+                            reinterpret_cast<const char*>(data + rdata + 1), textLength));
+                }
+                rdata += 1 + textLength;
+            }
+            break;
+        default:
+            // Kept with its name, type and TTL only
+            break;
+        }
+        if (!valid)
+        {
+            return false;
+        }
+
+        response.answers.push_back(record);
+        offset += dataLength;
+    }
+
+    if (int(response.answers.size()) < answerCount && !response.truncated)
+    {
+        return false;
+    }
+    response.success = true;
+    return true;
+}
+
+UInt16 DNSClient::NewID()
+{
+    // xorshift, IDs are not predictable from the previous ones at a glance.
+    // Spoofing resistance mostly comes from the random source port.
+    UInt16 id;
+    do
+    {
+        mRandom ^= mRandom << 13;
+        mRandom ^= mRandom >> 17;
+        mRandom ^= mRandom << 5;
+        id = UInt16(mRandom >> 8);
+    }
+    while (mPending.find(id) != mPending.end());
+    return id;
+}
+
+bool DNSClient::Send(PendingQuery* query)
+{
+    query->attempts++;
+    Deadline deadline;
+    deadline.time.Update();
+    deadline.time += mTimeout;
+    deadline.id = query->id;
+    deadline.send = ++mSendCount;
+    query->lastSend = deadline.send;
+    mDeadlines.push_back(deadline);
+
+    const Server& server = mServers[query->server];
+    ssize_t rc;
+    do
+    {
+        rc = sendto(server.sock->Sockfd(), query->message.data(), query->message.size(),
+                MSG_DONTWAIT, server.address.GetAddr(), server.address.GetLength());
+    }
+    while (rc < 0 && errno == EINTR);
+    return rc == ssize_t(query->message.size());
+}
+
+void DNSClient::Retry(PendingQuery* query, int& completed)
+{
+    if (query->attempts >= mAttempts)
+    {
+        DNSResponse response;
+        response.name = query->name;
+        response.type = query->type;
+        response.timedOut = true;
+        Complete(query, response);
+        completed++;
+        return;
+    }
+
+    query->server = (query->server + 1) % mServers.size();
+    Send(query);
+}
+
+void DNSClient::Complete(PendingQuery* query, DNSResponse& response)
+{
+    mPending.erase(query->id);
+    query->callback(response, query->param);
+    delete query;
+}
+
+void DNSClient::Receive(Socket* sock, int& completed)
+{
+    char buffer[MAX_RECEIVE];
+    while (true)
+    {
+        char abuffer[SocketAddress::MAX_ADDRESS_LENGTH];
+        sockaddr* pSA = reinterpret_cast<sockaddr*>(abuffer);
+        socklen_t saLen = sizeof(abuffer);
+        ssize_t rc = recvfrom(sock->Sockfd(), buffer, sizeof(buffer), MSG_DONTWAIT, pSA, &saLen);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // EAGAIN: all read. Others, e.g. ICMP port unreachable, are left to the timeout.
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return;
+            }
+            continue;
+        }
+
+        UInt16 id;
+        DNSResponse response;
+        if (!DNSClient::ParseResponse(buffer, size_t(rc), id, response))
+        {
+            continue;
+        }
+        std::map<UInt16, PendingQuery*>::iterator iter = mPending.find(id);
+        if (iter == mPending.end())
+        {
+            continue;
+        }
+
+        // Only the server asked may answer, and only the question asked
+        PendingQuery* query = iter->second;
+        const SocketAddress& server = mServers[query->server].address;
+        bool hasError = false;
+        SocketAddress source(pSA, saLen, hasError);
+        IPAddress sourceHost;
+        IPAddress serverHost;
+        if (hasError || !source.GetHost(sourceHost) || !server.GetHost(serverHost) ||
+                sourceHost != serverHost || source.GetPort() != server.GetPort() ||
+                response.type != query->type || !EqualsIgnoreCase(response.name, query->name))
+        {
+            continue;
+        }
+
+        // Another server may do better
+        if ((response.responseCode == NSResponseServerFailure ||
+                response.responseCode == NSResponseRefused ||
+                response.responseCode == NSResponseNotImpl) && query->attempts < mAttempts)
+        {
+            Retry(query, completed);
+            continue;
+        }
+
+        Complete(query, response);
+        completed++;
+    }
+}
@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////////
+// DNSClient.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef DNSClient_INCLUDED
+#define DNSClient_INCLUDED
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include "Types.h"
+#include "Socket.h"
+#include "SocketAddress.h"
+#include "SocketPoller.h"
+#include "IPAddress.h"
+#include "Timespan.h"
+#include "Timestamp.h"
+#include "DNSHeaders.h"
+
+// A resource record of the answer section
+struct DNSRecord
+{
+    DNSRecord() : type(NSTypeHostAddr), ttl(0), preference(0)
+    {
+    }
+
+    std::string name;
+    NSType type;
+    UInt32 ttl;
+    // Of A and AAAA records
+    IPAddress address;
+    // Domain name of PTR and CNAME records, exchange of MX records
+    std::string target;
+    // Of MX records
+    UInt16 preference;
+    // Character strings of TXT records
+    std::vector<std::string> texts;
+};
+
+struct DNSResponse
+{
+    DNSResponse() : type(NSTypeHostAddr), success(false), timedOut(false),
+        responseCode(NSResponseNoError), truncated(false)
+    {
+    }
+
+    std::string name;
+    NSType type;
+    // Whether an answer was received. A name that does not exist is a successful answer,
+    // with responseCode NSResponseDomainError.
+    bool success;
+    // No server answered in time
+    bool timedOut;
+    NSResponseCode responseCode;
+    // The server had more to say than fits a UDP message
+    bool truncated;
+    // Answer records in the order received, e.g. a CNAME before the addresses it leads to
+    std::vector<DNSRecord> answers;
+};
+
+// Called once a query is answered, or has failed.
+typedef void (*DNSQueryCallback)(const DNSResponse& response, void* param);
+
+// A stub resolver speaking the DNS protocol over UDP, without the libc resolver.
+// Many queries are outstanding at once over one socket per address family,
+// answers are matched by ID, source and question. A query that gets no answer
+// in time, or a server failure, is sent again to the next server.
+// The client is driven by the caller: Query() sends, Process() receives, retries
+// and invokes the callbacks. A DNSClient is not thread-safe.
+class DNSClient
+{
+public:
+    DNSClient();
+    ~DNSClient();
+
+    // Adds a server to send queries to, usually on port 53.
+    bool AddServer(const SocketAddress& server);
+
+    // Adds the nameserver entries of a resolv.conf file.
+    bool LoadResolvConf(const std::string& path = "/etc/resolv.conf");
+
+    // Time to wait for an answer before trying the next server. Default is 2 seconds.
+    void SetTimeout(const Timespan& timeout)
+    {
+        mTimeout = timeout.GetTotalMicroseconds();
+    }
+
+    // Number of times a query is sent before failing. Default is 3.
+    void SetAttempts(int attempts)
+    {
+        mAttempts = attempts > 0 ? attempts : 1;
+    }
+
+    // Sends a query for the records of type (A, AAAA, MX, TXT, PTR, ...) of name.
+    // For PTR queries, see GetReverseName().
+    // Returns false if there is no server or name is not valid.
+    bool Query(const std::string& name, NSType type, DNSQueryCallback callback, void* param);
+
+    // Receives the answers arrived and sends again the queries timed out,
+    // waiting up to timeout for an answer if there is none yet.
+    // Callbacks are invoked from here. Returns the number of queries completed.
+    int Process(const Timespan& timeout);
+
+    // Returns the number of queries not completed yet.
+    int GetPending() const
+    {
+        return int(mPending.size());
+    }
+
+    // Sends a query and processes until it completes.
+    bool Resolve(const std::string& name, NSType type, DNSResponse& response);
+
+    // The name to query PTR records of address, e.g. "4.3.2.1.in-addr.arpa".
+    static std::string GetReverseName(const IPAddress& address);
+
+    // Builds the query message of name and type.
+    static bool BuildQuery(UInt16 id, const std::string& name, NSType type, std::string& message);
+
+    // Parses a response message: its ID, question and answer records.
+    static bool ParseResponse(const char* data, size_t length, UInt16& id, DNSResponse& response);
+
+private:
+    struct Server
+    {
+        SocketAddress address;
+        Socket* sock;
+    };
+
+    struct PendingQuery
+    {
+        UInt16 id;
+        NSType type;
+        std::string name;
+        std::string message;
+        DNSQueryCallback callback;
+        void* param;
+        // Server the last attempt went to, and the number of attempts
+        size_t server;
+        int attempts;
+        UInt64 lastSend;
+    };
+
+    // A sent attempt, queued in order of deadline: the timeout is the same for all.
+    // It is stale once its query completed or was sent again, IDs being reused.
+    struct Deadline
+    {
+        Timestamp time;
+        UInt16 id;
+        UInt64 send;
+    };
+
+    UInt16 NewID();
+    bool Send(PendingQuery* query);
+    // Sends the query to the next server, or fails it if out of attempts
+    void Retry(PendingQuery* query, int& completed);
+    void Complete(PendingQuery* query, DNSResponse& response);
+    void Receive(Socket* sock, int& completed);
+
+private:
+    DNSClient(const DNSClient&);
+    DNSClient& operator =(const DNSClient&);
+
+private:
+    std::vector<Server> mServers;
+    Socket* mSocket4;
+    Socket* mSocket6;
+    SocketPoller mPoller;
+
+    Int64 mTimeout;
+    int mAttempts;
+
+    std::map<UInt16, PendingQuery*> mPending;
+    std::deque<Deadline> mDeadlines;
+    // Numbers the attempts sent
+    UInt64 mSendCount;
+    UInt32 mRandom;
+    size_t mNextServer;
+};
+
+#endif // DNSClient_INCLUDED
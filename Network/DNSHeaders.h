@@ -3,8 +3,8 @@
 // Yuchuan Wang
 //////////////////////////////////////////////////////////////////////////
 
-#ifndef DNS_INCLUDED
-#define DNS_INCLUDED
+#ifndef DNSHeaders_INCLUDED
+#define DNSHeaders_INCLUDED
 
 
 struct DNSHeader
@@ -145,5 +145,5 @@ enum NSClassType
 	NSClassMax = 65536
 };
 
-#endif // DNS_INCLUDED
+#endif // DNSHeaders_INCLUDED
 
@@ -0,0 +1,368 @@
+//////////////////////////////////////////////////////////////////////////
+// DNSResolver.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "DNSResolver.h"
+#include "DNS.h"
+#include "Log.h"
+
+DNSResolver::DNSResolver(int threads) :
+    mThreadCount(threads > 0 ? threads : 1), mStopping(false),
+    mPositiveTTL(60 * Timespan::Second), mNegativeTTL(5 * Timespan::Second),
+    mRefreshAhead(10 * Timespan::Second), mMaxEntries(10000), mHits(0), mMisses(0)
+{
+}
+
+DNSResolver::~DNSResolver()
+{
+    Stop();
+}
+
+void DNSResolver::SetTTL(const Timespan& positive, const Timespan& negative)
+{
+    AutoCriticalSection autoLock(&mLock);
+    mPositiveTTL = positive.GetTotalMicroseconds();
+    mNegativeTTL = negative.GetTotalMicroseconds();
+}
+
+void DNSResolver::SetRefreshAhead(const Timespan& refreshAhead)
+{
+    AutoCriticalSection autoLock(&mLock);
+    mRefreshAhead = refreshAhead.GetTotalMicroseconds();
+}
+
+void DNSResolver::SetMaxEntries(size_t maxEntries)
+{
+    AutoCriticalSection autoLock(&mLock);
+    mMaxEntries = maxEntries;
+}
+
+bool DNSResolver::Resolve(const std::string& name, HostEntry& hostEntry)
+{
+    {
+        AutoCriticalSection autoLock(&mLock);
+        Timestamp now;
+        Entry* entry = FindValid(name, now);
+        if (entry == NULL)
+        {
+            mMisses++;
+        }
+
+        // Wait for the lookup of the same name running, if any
+        while (entry == NULL && mEntries[name].pending)
+        {
+            mResolved.Wait(mLock);
+            now.Update();
+            entry = FindValid(name, now);
+        }
+
+        if (entry != NULL)
+        {
+            hostEntry = entry->hostEntry;
+            return entry->found;
+        }
+
+        Entry& newEntry = mEntries[name];
+        newEntry.pending = true;
+        newEntry.lastUsed = now;
+    }
+
+    // Run by the calling thread, rather than handed over to a resolver thread
+    return Lookup(name, hostEntry);
+}
+
+bool DNSResolver::ResolveOne(const std::string& name, IPAddress& ipAddr)
+{
+    HostEntry entry;
+    if (Resolve(name, entry) && !entry.GetAddresses().empty())
+    {
+        ipAddr = entry.GetAddresses()[0];
+        return true;
+    }
+    return false;
+}
+
+bool DNSResolver::ResolveAsync(const std::string& name, DNSResolveCallback callback, void* param)
+{
+    HostEntry hostEntry;
+    bool found;
+    {
+        AutoCriticalSection autoLock(&mLock);
+        if (mStopping)
+        {
+            return false;
+        }
+
+        Timestamp now;
+        Entry* entry = FindValid(name, now);
+        if (entry == NULL)
+        {
+            mMisses++;
+            Entry& newEntry = mEntries[name];
+            newEntry.lastUsed = now;
+            if (!newEntry.pending)
+            {
+                if (!Enqueue(name))
+                {
+                    return false;
+                }
+                newEntry.pending = true;
+            }
+            Waiter waiter = { callback, param };
+            newEntry.waiters.push_back(waiter);
+            return true;
+        }
+
+        hostEntry = entry->hostEntry;
+        found = entry->found;
+    }
+
+    callback(name, found, hostEntry, param);
+    return true;
+}
+
+void DNSResolver::Invalidate(const std::string& name)
+{
+    AutoCriticalSection autoLock(&mLock);
+    std::map<std::string, Entry>::iterator iter = mEntries.find(name);
+    if (iter == mEntries.end())
+    {
+        return;
+    }
+
+    // An entry being looked up is kept for its waiters, it gets a fresh result
+    if (iter->second.pending)
+    {
+        iter->second.resolved = false;
+    }
+    else
+    {
+        mEntries.erase(iter);
+    }
+}
+
+void DNSResolver::Clear()
+{
+    AutoCriticalSection autoLock(&mLock);
+    std::map<std::string, Entry>::iterator iter = mEntries.begin();
+    while (iter != mEntries.end())
+    {
+        if (iter->second.pending)
+        {
+            iter->second.resolved = false;
+            ++iter;
+        }
+        else
+        {
+            mEntries.erase(iter++);
+        }
+    }
+}
+
+void DNSResolver::Stop()
+{
+    {
+        AutoCriticalSection autoLock(&mLock);
+        if (mStopping)
+        {
+            return;
+        }
+        mStopping = true;
+        mWorkReady.Broadcast();
+    }
+
+    for (size_t i = 0; i < mThreads.size(); i++)
+    {
+        pthread_join(mThreads[i], NULL);
+    }
+    mThreads.clear();
+
+    // Fail the lookups left in the queue
+    std::vector<std::pair<std::string, Waiter> > failed;
+    {
+        AutoCriticalSection autoLock(&mLock);
+        for (size_t i = 0; i < mQueue.size(); i++)
+        {
+            Entry& entry = mEntries[mQueue[i]];
+            entry.pending = false;
+            for (size_t j = 0; j < entry.waiters.size(); j++)
+            {
+                failed.push_back(std::make_pair(mQueue[i], entry.waiters[j]));
+            }
+            entry.waiters.clear();
+        }
+        mQueue.clear();
+        mResolved.Broadcast();
+    }
+
+    HostEntry none;
+    for (size_t i = 0; i < failed.size(); i++)
+    {
+        failed[i].second.callback(failed[i].first, false, none, failed[i].second.param);
+    }
+}
+
+DNSResolver& DNSResolver::GetDefault()
+{
+    static DNSResolver resolver;
+    return resolver;
+}
+
+DNSResolver::Entry* DNSResolver::FindValid(const std::string& name, const Timestamp& now)
+{
+    std::map<std::string, Entry>::iterator iter = mEntries.find(name);
+    if (iter == mEntries.end())
+    {
+        return NULL;
+    }
+
+    Entry& entry = iter->second;
+    if (!entry.resolved || entry.expires <= now)
+    {
+        return NULL;
+    }
+
+    mHits++;
+    entry.lastUsed = now;
+    // Refresh a name in use before it expires, it is served from the cache meanwhile
+    if (entry.found && !entry.pending && entry.expires - now < mRefreshAhead && Enqueue(name))
+    {
+        entry.pending = true;
+    }
+    return &entry;
+}
+
+bool DNSResolver::Enqueue(const std::string& name)
+{
+    if (mStopping)
+    {
+        return false;
+    }
+
+    // Resolver threads are started on first use
+    while (mThreads.size() < size_t(mThreadCount))
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, WorkerProc, this) != 0)
+        {
+            LOG(LogError, "Failed to start DNS resolver thread");
+            break;
+        }
+        mThreads.push_back(thread);
+    }
+    if (mThreads.empty())
+    {
+        return false;
+    }
+
+    mQueue.push_back(name);
+    mWorkReady.Signal();
+    return true;
+}
+
+bool DNSResolver::Lookup(const std::string& name, HostEntry& hostEntry)
+{
+    HostEntry result;
+    bool found = DNS::Resolve(name, result);
+
+    std::vector<Waiter> waiters;
+    {
+        AutoCriticalSection autoLock(&mLock);
+        Timestamp now;
+        Entry& entry = mEntries[name];
+        // A failed refresh keeps the previous result until it expires
+        if (found || !entry.resolved || !entry.found || entry.expires <= now)
+        {
+            entry.resolved = true;
+            entry.found = found;
+            entry.hostEntry = result;
+            entry.expires = now + (found ? mPositiveTTL : mNegativeTTL);
+        }
+        entry.pending = false;
+        waiters.swap(entry.waiters);
+        found = entry.found;
+        hostEntry = entry.hostEntry;
+
+        mResolved.Broadcast();
+        Trim(now);
+    }
+
+    for (size_t i = 0; i < waiters.size(); i++)
+    {
+        waiters[i].callback(name, found, hostEntry, waiters[i].param);
+    }
+    return found;
+}
+
+void DNSResolver::Trim(const Timestamp& now)
+{
+    if (mEntries.size() <= mMaxEntries)
+    {
+        return;
+    }
+
+    // Entries being looked up are kept for their waiters
+    std::map<std::string, Entry>::iterator iter = mEntries.begin();
+    while (iter != mEntries.end())
+    {
+        if (!iter->second.pending && (!iter->second.resolved || iter->second.expires <= now))
+        {
+            mEntries.erase(iter++);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    while (mEntries.size() > mMaxEntries)
+    {
+        std::map<std::string, Entry>::iterator oldest = mEntries.end();
+        for (iter = mEntries.begin(); iter != mEntries.end(); ++iter)
+        {
+            if (!iter->second.pending &&
+                    (oldest == mEntries.end() || iter->second.lastUsed < oldest->second.lastUsed))
+            {
+                oldest = iter;
+            }
+        }
+        if (oldest == mEntries.end())
+        {
+            break;
+        }
+        mEntries.erase(oldest);
+    }
+}
+
+void* DNSResolver::WorkerProc(void* param)
+{
+    static_cast<DNSResolver*>(param)->Work();
+    return NULL;
+}
+
+void DNSResolver::Work()
+{
+    mLock.Lock();
+    while (true)
+    {
+        while (!mStopping && mQueue.empty())
+        {
+            mWorkReady.Wait(mLock);
+        }
+        if (mStopping)
+        {
+            break;
+        }
+
+        std::string name = mQueue.front();
+        mQueue.pop_front();
+        mLock.Unlock();
+
+        HostEntry hostEntry;
+        Lookup(name, hostEntry);
+
+        mLock.Lock();
+    }
+    mLock.Unlock();
+}
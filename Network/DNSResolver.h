@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////////////////////////
+// DNSResolver.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef DNSResolver_INCLUDED
+#define DNSResolver_INCLUDED
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Types.h"
+#include "Timespan.h"
+#include "Timestamp.h"
+#include "CriticalSection.h"
+#include "Condition.h"
+#include "IPAddress.h"
+#include "HostEntry.h"
+
+// Called with the result of an asynchronous lookup.
+typedef void (*DNSResolveCallback)(const std::string& name, bool found,
+        const HostEntry& hostEntry, void* param);
+
+// Resolves host names like DNS::Resolve, through a cache.
+// - Results are kept for a positive TTL, failures for a (shorter) negative TTL.
+// - Concurrent lookups of the same name are coalesced into one.
+// - An entry used shortly before it expires is refreshed in the background,
+//   so names in steady use never wait for a lookup.
+// - ResolveAsync does not block: lookups run on a few resolver threads,
+//   started on the first asynchronous lookup.
+// All methods are thread-safe.
+class DNSResolver
+{
+public:
+    // threads is the number of resolver threads for asynchronous lookups and refreshes.
+    DNSResolver(int threads = 4);
+
+    // Stops the resolver threads, see Stop().
+    virtual ~DNSResolver();
+
+    // How long results are kept. Defaults are 60 seconds, and 5 seconds for failures.
+    void SetTTL(const Timespan& positive, const Timespan& negative);
+
+    // Entries used within this time before they expire are refreshed. Default is 10 seconds.
+    void SetRefreshAhead(const Timespan& refreshAhead);
+
+    // Entries beyond this number are dropped, expired and least recently used first.
+    // Default is 10000.
+    void SetMaxEntries(size_t maxEntries);
+
+    // Resolves name, waiting if it is not cached.
+    bool Resolve(const std::string& name, HostEntry& hostEntry);
+
+    // Resolves name and returns its first address.
+    bool ResolveOne(const std::string& name, IPAddress& ipAddr);
+
+    // Resolves name without blocking. The callback is invoked right away from the calling
+    // thread if the name is cached, otherwise from the thread completing the lookup.
+    // Callbacks must not block. Returns false if the resolver is stopped.
+    bool ResolveAsync(const std::string& name, DNSResolveCallback callback, void* param);
+
+    // Forgets the cached result of name, or of all names.
+    void Invalidate(const std::string& name);
+    void Clear();
+
+    // Stops the resolver threads. Asynchronous lookups not completed yet
+    // get their callbacks invoked with found false.
+    void Stop();
+
+    UInt64 GetHits() const
+    {
+        return mHits;
+    }
+
+    UInt64 GetMisses() const
+    {
+        return mMisses;
+    }
+
+    // A resolver shared by the whole process
+    static DNSResolver& GetDefault();
+
+private:
+    struct Waiter
+    {
+        DNSResolveCallback callback;
+        void* param;
+    };
+
+    struct Entry
+    {
+        Entry() : resolved(false), found(false), pending(false)
+        {
+        }
+
+        // Whether hostEntry and found hold a result
+        bool resolved;
+        bool found;
+        HostEntry hostEntry;
+        Timestamp expires;
+        Timestamp lastUsed;
+        // A lookup is running, for a miss or a refresh
+        bool pending;
+        std::vector<Waiter> waiters;
+    };
+
+    // Looks up name in the cache, with the lock held.
+    // Returns the entry if it holds a valid result, scheduling a refresh if due.
+    Entry* FindValid(const std::string& name, const Timestamp& now);
+    // Queues a lookup of name for the resolver threads, with the lock held
+    bool Enqueue(const std::string& name);
+    // Runs the lookup of name, stores its result and calls the waiters back
+    bool Lookup(const std::string& name, HostEntry& hostEntry);
+    // Drops entries beyond the limit, with the lock held
+    void Trim(const Timestamp& now);
+
+    static void* WorkerProc(void* param);
+    void Work();
+
+private:
+    DNSResolver(const DNSResolver&);
+    DNSResolver& operator =(const DNSResolver&);
+
+private:
+    int mThreadCount;
+    std::vector<pthread_t> mThreads;
+    bool mStopping;
+
+    Int64 mPositiveTTL;
+    Int64 mNegativeTTL;
+    Int64 mRefreshAhead;
+    size_t mMaxEntries;
+
+    CriticalSection mLock;
+    // Signaled when a lookup is queued
+    Condition mWorkReady;
+    // Broadcast when a lookup completes
+    Condition mResolved;
+    std::map<std::string, Entry> mEntries;
+    std::deque<std::string> mQueue;
+
+    UInt64 mHits;
+    UInt64 mMisses;
+};
+
+#endif // DNSResolver_INCLUDED
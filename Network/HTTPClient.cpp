@@ -5,9 +5,153 @@
 
 #include <vector>
 #include <cstdlib>
+#include <pthread.h>
 #include <curl/curl.h>
-#include "StringUtilities.h"
+#include "CriticalSection.h"
 #include "HTTPClient.h"
+#include "HTTPMultiClient.h"
+#include "HTTPHeaderParser.h"
+
+// Curl handles and caches shared by all HTTPClient instances.
+// Idle easy handles are kept for reuse, each with the live connections (keep-alive)
+// of its connection cache; a handle is used by one thread at a time, so its
+// connections are never used concurrently. All handles share one CURLSH for
+// TLS sessions and DNS entries only: curl does not allow a shared connection cache
+// to be used from several threads at once.
+class CurlSharedState
+{
+public:
+    static CurlSharedState& Instance()
+    {
+        static CurlSharedState instance;
+        return instance;
+    }
+
+    // Returns an easy handle with default options, attached to the share.
+    CURL* Acquire()
+    {
+        {
+            AutoCriticalSection autoLock(&mCriticalSection);
+            if (!mIdle.empty())
+            {
+                CURL* curl = mIdle.back();
+                mIdle.pop_back();
+                return curl;
+            }
+        }
+
+        CURL* curl = curl_easy_init();
+        if (curl != NULL && mShare != NULL)
+        {
+            curl_easy_setopt(curl, CURLOPT_SHARE, mShare);
+        }
+        return curl;
+    }
+
+    // Gives the handle back for reuse, or cleans it up when enough are idle.
+    void Release(CURL* curl)
+    {
+        // Drops the options of the finished request, keeps connections and caches
+        curl_easy_reset(curl);
+        {
+            AutoCriticalSection autoLock(&mCriticalSection);
+            if (int(mIdle.size()) < mMaxIdle)
+            {
+                mIdle.push_back(curl);
+                return;
+            }
+        }
+
+        curl_easy_cleanup(curl);
+    }
+
+    void SetMaxIdle(int maxIdle)
+    {
+        std::vector<CURL*> extra;
+        {
+            AutoCriticalSection autoLock(&mCriticalSection);
+            mMaxIdle = maxIdle > 0 ? maxIdle : 0;
+            while (int(mIdle.size()) > mMaxIdle)
+            {
+                extra.push_back(mIdle.back());
+                mIdle.pop_back();
+            }
+        }
+
+        for (size_t i = 0; i < extra.size(); i++)
+        {
+            curl_easy_cleanup(extra[i]);
+        }
+    }
+
+    int GetMaxIdle()
+    {
+        AutoCriticalSection autoLock(&mCriticalSection);
+        return mMaxIdle;
+    }
+
+private:
+    CurlSharedState() : mShare(NULL), mMaxIdle(8)
+    {
+        // Initialize global curl, once and before any other curl call.
+        curl_global_init(CURL_GLOBAL_ALL);
+
+        mShare = curl_share_init();
+        if (mShare != NULL)
+        {
+            curl_share_setopt(mShare, CURLSHOPT_LOCKFUNC, LockShare);
+            curl_share_setopt(mShare, CURLSHOPT_UNLOCKFUNC, UnlockShare);
+            curl_share_setopt(mShare, CURLSHOPT_USERDATA, this);
+            curl_share_setopt(mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
+    }
+
+    ~CurlSharedState()
+    {
+        for (size_t i = 0; i < mIdle.size(); i++)
+        {
+            curl_easy_cleanup(mIdle[i]);
+        }
+        mIdle.clear();
+
+        if (mShare != NULL)
+        {
+            curl_share_cleanup(mShare);
+        }
+    }
+
+    static void LockShare(CURL* curl, curl_lock_data data, curl_lock_access access, void* userPtr)
+    {
+        CurlSharedState* state = static_cast<CurlSharedState*>(userPtr);
+        state->mShareLocks[data].Lock();
+    }
+
+    static void UnlockShare(CURL* curl, curl_lock_data data, void* userPtr)
+    {
+        CurlSharedState* state = static_cast<CurlSharedState*>(userPtr);
+        state->mShareLocks[data].Unlock();
+    }
+
+private:
+    CURLSH* mShare;
+    // One lock per kind of shared data, as curl asks for
+    CriticalSection mShareLocks[CURL_LOCK_DATA_LAST];
+
+    CriticalSection mCriticalSection;
+    std::vector<CURL*> mIdle;
+    int mMaxIdle;
+};
+
+void HTTPClient::SetMaxIdleConnections(int maxIdle)
+{
+    CurlSharedState::Instance().SetMaxIdle(maxIdle);
+}
+
+int HTTPClient::GetMaxIdleConnections()
+{
+    return CurlSharedState::Instance().GetMaxIdle();
+}
 
 bool HTTPClient::Access()
 {
@@ -34,19 +178,65 @@ bool HTTPClient::Access(std::string &respBody,
         std::map<std::string, std::string>& respheaders,
         std::string &dstIpStr, int &duration, std::string &errMsg)
 {
-    // Initialize global curl.
-    static bool curlGlobalInited = false;
-    if (!curlGlobalInited)
+    // Get a curl handle, reusing the connections and caches of previous requests
+    CurlSharedState& sharedState = CurlSharedState::Instance();
+    CURL *curl = sharedState.Acquire();
+    if (curl == NULL)
     {
-        curl_global_init(CURL_GLOBAL_ALL);
-        curlGlobalInited = true;
+        return false;
     }
 
-    // Initialize a new curl handle
-    CURL *curl = curl_easy_init();
-    if (curl == NULL)
+    std::string respHeaderData;
+    BodyTarget bodyTarget;
+    struct curl_slist *headerList = Setup(curl, respHeaderData, respBody, bodyTarget);
+
+    // Access the URL
+    CURLcode performCode = curl_easy_perform(curl);
+
+    int statusCode = 0;
+    bool ret = Complete(curl, performCode, respHeaderData, statusCode, respheaders,
+            dstIpStr, duration, errMsg);
+    if (mSink)
     {
-        return false;
+        mSink->Finish(ret);
+    }
+
+    // Release resources, the handle keeps its connection for the next request
+    sharedState.Release(curl);
+    curl_slist_free_all(headerList);
+
+    return ret;
+}
+
+bool HTTPClient::Submit(HTTPMultiClient& multiClient,
+        HTTPCompletionCallback callback, void* param) const
+{
+    return multiClient.Submit(*this, callback, param);
+}
+
+void* HTTPClient::AcquireHandle()
+{
+    return CurlSharedState::Instance().Acquire();
+}
+
+void HTTPClient::ReleaseHandle(void* curl)
+{
+    CurlSharedState::Instance().Release(curl);
+}
+
+struct curl_slist* HTTPClient::Setup(void* curl, std::string& respHeaderData,
+        std::string& respBody, BodyTarget& bodyTarget) const
+{
+    // Keep connections alive for later requests, or close them if reuse is disabled
+    long maxIdle = CurlSharedState::Instance().GetMaxIdle();
+    if (maxIdle > 0)
+    {
+        curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, maxIdle);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    }
+    else
+    {
+        curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
     }
 
     // Set URL
@@ -88,14 +278,22 @@ bool HTTPClient::Access(std::string &respBody,
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
 
     // Set callback and buff for response status line and header
-    std::string respHeaderData;
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ResponseCallback);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &respHeaderData);
 
-    // Set callback and buff for response body
+    // Set callback and buff (or sink) for response body
     respBody.clear();
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ResponseCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &respBody);
+    bodyTarget.curl = curl;
+    bodyTarget.sink = mSink;
+    bodyTarget.body = &respBody;
+    bodyTarget.started = false;
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BodyCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &bodyTarget);
+    if (mSink)
+    {
+        // An error page is not the content a sink expects, e.g. a file being downloaded
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    }
 
     if (mUseSystemProxySettings)
     {
@@ -138,42 +336,41 @@ bool HTTPClient::Access(std::string &respBody,
     curl_easy_setopt(curl, CURLOPT_VERBOSE, mVerbose);
     curl_easy_setopt(curl, CURLOPT_NOPROGRESS, mNoProgress);
 
-    // Access the URL
-    CURLcode performCode = curl_easy_perform(curl);
+    return headerList;
+}
 
+bool HTTPClient::Complete(void* curl, int performCode, const std::string& respHeaderData,
+        int& statusCode, std::map<std::string, std::string>& respheaders,
+        std::string& dstIpStr, int& duration, std::string& errMsg)
+{
     // Get info of previous finished http request
     char *dstIp = NULL;
     curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &dstIp);
-    dstIpStr = dstIp;
+    dstIpStr = dstIp ? dstIp : "";
 
     double totalTime;
     curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &totalTime);
     duration = int(totalTime);
 
-    // Release resources
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headerList);
-
     // Return true/false accordingly
     std::string version = "";
-    int statusCode = 0;
+    statusCode = 0;
     std::string statusString = "";
 
-    std::map<std::string, std::string> headerMap;
     if (performCode == CURLE_OK &&
-            ParseResponseMetaData(respHeaderData, version, statusCode, statusString, headerMap) &&
+            ParseResponseMetaData(respHeaderData, version, statusCode, statusString, respheaders) &&
             statusCode == 200)
     {
         return true;
     }
     else
     {
-        errMsg = curl_easy_strerror(performCode);
+        errMsg = curl_easy_strerror(CURLcode(performCode));
         return false;
     }
 }
 
-// Callback used for curl option: CURLOPT_WRITEFUNCTION and CURLOPT_HEADERFUNCTION
+// Callback used for curl option: CURLOPT_HEADERFUNCTION
 size_t HTTPClient::ResponseCallback(void *buf, size_t size, size_t n, void *userBuf)
 {
     size_t realsize = (size * n);
@@ -181,105 +378,69 @@ size_t HTTPClient::ResponseCallback(void *buf, size_t size, size_t n, void *user
 
     if (userData && buf)
     {
-        (*userData) += std::string((char *)buf, realsize);
+        userData->append((char *)buf, realsize);
     }
 
     return realsize;
 }
 
-// Parse response metaData (<status line, header>).
-// NOTE: The metaData may contain more then one response data. Only need to parse the last one
-bool HTTPClient::ParseResponseMetaData(const std::string& metaData,
-        std::string& version,
-        int& statusCode,
-        std::string& statusStr,
-        std::map<std::string, std::string>& headerMap)
+// Callback used for curl option: CURLOPT_WRITEFUNCTION
+size_t HTTPClient::BodyCallback(void *buf, size_t size, size_t n, void *userData)
 {
-    const std::string CRLF = "\r\n";
-    const std::string doubleCRLF = "\r\n\r\n";
-
-    // Get the last response metaData.
-    // NOTE: Since the input metaData may contain more then one response data.
-    //      Currently, only need to parse the last one.
-    size_t lastMetaEnd = metaData.rfind(doubleCRLF);
-    if (lastMetaEnd == std::string::npos)
-    {
-        return false;
-    }
+    size_t realsize = (size * n);
+    BodyTarget *target = (BodyTarget *)userData;
 
-    size_t lastMetaBegin = metaData.rfind(doubleCRLF, lastMetaEnd - doubleCRLF.length());
-    if (lastMetaBegin == std::string::npos)
-    {
-        // Maybe there is only one response meta data
-        lastMetaBegin = 0;
-    }
-    else
+    if (!target->started)
     {
-        lastMetaBegin += doubleCRLF.length();
+        // Headers are complete once the body starts
+        target->started = true;
+        curl_off_t contentLength = -1;
+        curl_easy_getinfo(target->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+        if (target->sink)
+        {
+            target->sink->OnContentLength(contentLength);
+        }
+        else if (contentLength > 0 && contentLength <= HTTPStringSink::MAX_RESERVE)
+        {
+            target->body->reserve(size_t(contentLength));
+        }
     }
 
-    std::string lastMeta = metaData.substr(lastMetaBegin, lastMetaEnd - lastMetaBegin);
-
-    // Get status line
-    size_t statusLineBegin = 0;
-    size_t statusLineEnd = lastMeta.find(CRLF);
-    if (statusLineEnd == std::string::npos)
+    if (target->sink)
     {
-        return false;
+        // Returning less than realsize aborts the transfer
+        return target->sink->Write((const char *)buf, realsize) ? realsize : 0;
     }
 
-    std::string statusLine = lastMeta.substr(statusLineBegin, statusLineEnd - statusLineBegin);
+    target->body->append((const char *)buf, realsize);
+    return realsize;
+}
 
-    // Parse status line
-    std::vector<std::string> splitResult;
-    if (!StringUtilities::SplitString(statusLine, " ", true, splitResult) ||
-            splitResult.size() < 3)
+// Parse response metaData (<status line, header>).
+// NOTE: The metaData may contain more then one response data. Only need to parse the last one
+bool HTTPClient::ParseResponseMetaData(const std::string& metaData,
+        std::string& version,
+        int& statusCode,
+        std::string& statusStr,
+        std::map<std::string, std::string>& headerMap)
+{
+    // Single pass over the data, fields are views into metaData
+    HTTPHeaderParser parser;
+    if (!parser.ParseResponse(metaData.data(), metaData.size()))
     {
         return false;
     }
 
-    version = splitResult[0];
-    statusCode = atoi(splitResult[1].c_str());
-    statusStr = splitResult[2];
-
-    for (size_t i = 3; i < splitResult.size(); i++)
-    {
-        statusStr += " " + splitResult[i];
-    }
-
-    // Get and parse header
-    std::string header = lastMeta.substr(statusLineEnd + CRLF.length());
+    version = parser.GetVersion().ToString();
+    statusCode = parser.GetStatusCode();
+    statusStr = parser.GetReason().ToString();
 
     headerMap.clear();
-    size_t fieldStart = 0;
-    size_t fieldEnd = 0;
-
-    while (fieldStart < header.length())
+    for (int i = 0; i < parser.GetFieldCount(); i++)
     {
-        fieldEnd = header.find(CRLF, fieldStart);
-        if (fieldEnd == std::string::npos)
-        {
-            // Maybe it is the last header
-            fieldEnd = header.length();
-        }
-        else if (fieldEnd == fieldStart)
-        {
-            // Empty header (maybe \r\n\r\n), go for next header
-            fieldStart = fieldEnd + CRLF.length();
-            continue;
-        }
-
-        std::string field = header.substr(fieldStart, fieldEnd - fieldStart);
-
-        size_t pos = field.find(":");
-        if (pos != std::string::npos)
-        {
-            std::string key = field.substr(0, pos);
-            std::string val = field.substr(pos + 2, (field.length() - (pos + 2))); // 2 is for ": ".
-            headerMap.insert(std::map<std::string, std::string>::value_type(key, val));
-        }
-
-        fieldStart = fieldEnd + CRLF.length();
+        const HTTPHeaderField& field = parser.GetField(i);
+        headerMap.insert(std::map<std::string, std::string>::value_type(
+                field.name.ToString(), field.value.ToString()));
     }
 
     return true;
@@ -9,6 +9,31 @@
 #include <list>
 #include <map>
 #include <string>
+#include "HTTPResponseSink.h"
+
+struct curl_slist;
+class HTTPMultiClient;
+
+// Result of a request submitted to an HTTPMultiClient.
+struct HTTPResult
+{
+    HTTPResult() : success(false), statusCode(0), duration(0)
+    {
+    }
+
+    // Same meaning as the return value of HTTPClient::Access
+    bool success;
+    int statusCode;
+    std::string body;
+    std::map<std::string, std::string> headers;
+    std::string dstIp;
+    int duration;
+    std::string errMsg;
+};
+
+// Invoked once a submitted request completes, fails, or is aborted.
+// param is the data passed to Submit.
+typedef void (*HTTPCompletionCallback)(HTTPResult& result, void* param);
 
 class HTTPClient
 {
@@ -16,7 +41,7 @@ public:
     HTTPClient() :
         mTimeout(0), mEnableProxy(false),
         mProxyPort(0), mUseSystemProxySettings(false),
-        mVerbose(0), mNoProgress(1){};
+        mVerbose(0), mNoProgress(1), mSink(NULL){};
 
     HTTPClient &SetUrl(const std::string &url)
     {
@@ -91,6 +116,22 @@ public:
         mNoProgress = noProgress;
         return *this;
     }
+    // Streams the response body to sink instead of the respBody string,
+    // which is then left empty. The sink must outlive the request.
+    // The body of an error status (400 and above) is not passed to the sink,
+    // the request fails instead. NULL buffers the body in memory again.
+    HTTPClient &SetSink(HTTPResponseSink *sink)
+    {
+        mSink = sink;
+        return *this;
+    }
+
+    // Sets the max number of idle connections kept alive for reuse by all clients.
+    // Idle curl handles keep their live connections across Access calls, and are
+    // handed to one request at a time; TLS sessions and DNS results are shared by
+    // all clients. 0 disables connection reuse. Default is 8.
+    static void SetMaxIdleConnections(int maxIdle);
+    static int GetMaxIdleConnections();
 
     bool Access();
     bool Access(std::string &respBody);
@@ -98,8 +139,39 @@ public:
     bool Access(std::string &respBody, std::map<std::string, std::string>& respheaders,
             std::string &dstIpStr, int &duration, std::string &errMsg);
 
+    // Submits a copy of this request to multiClient, which runs it concurrently
+    // with the other submitted requests and invokes callback from its event thread.
+    // Returns false if the request could not be queued.
+    bool Submit(HTTPMultiClient& multiClient, HTTPCompletionCallback callback,
+            void* param) const;
+
 private:
+    friend class HTTPMultiClient;
+
+    // Where the body of a running request goes
+    struct BodyTarget
+    {
+        void* curl;
+        HTTPResponseSink* sink;
+        std::string* body;
+        bool started;
+    };
+
+    // Get/give back a curl handle sharing connections and caches with all clients
+    static void* AcquireHandle();
+    static void ReleaseHandle(void* curl);
+
+    // Sets the options of this request on the curl handle.
+    // Returns the header list, to be freed once the request completes.
+    struct curl_slist* Setup(void* curl, std::string& respHeaderData,
+            std::string& respBody, BodyTarget& bodyTarget) const;
+    // Collects the outcome of a finished request.
+    static bool Complete(void* curl, int performCode, const std::string& respHeaderData,
+            int& statusCode, std::map<std::string, std::string>& respheaders,
+            std::string& dstIpStr, int& duration, std::string& errMsg);
+
     static size_t ResponseCallback(void *buf, size_t size, size_t n, void *userBuf);
+    static size_t BodyCallback(void *buf, size_t size, size_t n, void *userData);
     static bool ParseResponseMetaData(const std::string& metaData,
             std::string& version,
             int& statusCode,
@@ -127,6 +199,9 @@ private:
     // Debug related
     int mVerbose;
     int mNoProgress;
+
+    // Response related
+    HTTPResponseSink *mSink;
 };
 
 #endif /* HTTPCLIENT_H_ */
@@ -0,0 +1,285 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPCompressor.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "HTTPCompressor.h"
+#include "MD5Hash.h"
+#include <cstring>
+
+// Output is produced in steps of this size
+static const size_t OUTPUT_STEP = 16 * 1024;
+
+// HTTPCompressor
+HTTPCompressor::HTTPCompressor() : mInitialized(false)
+{
+    memset(&mStream, 0, sizeof(mStream));
+}
+
+HTTPCompressor::~HTTPCompressor()
+{
+    if (mInitialized)
+    {
+        deflateEnd(&mStream);
+    }
+}
+
+bool HTTPCompressor::Init(HTTPContentEncoding encoding, int level)
+{
+    if (mInitialized)
+    {
+        deflateEnd(&mStream);
+        mInitialized = false;
+    }
+    if (encoding == EncodingIdentity)
+    {
+        return false;
+    }
+
+    memset(&mStream, 0, sizeof(mStream));
+    // 15 is the largest window, +16 asks for the gzip wrapper instead of the zlib one
+    int windowBits = encoding == EncodingGzip ? 15 + 16 : 15;
+    mInitialized = deflateInit2(&mStream, level, Z_DEFLATED, windowBits, 8,
+            Z_DEFAULT_STRATEGY) == Z_OK;
+    return mInitialized;
+}
+
+bool HTTPCompressor::Write(const char* data, size_t length, std::string& out)
+{
+    return Deflate(data, length, out, Z_NO_FLUSH);
+}
+
+bool HTTPCompressor::Finish(std::string& out)
+{
+    bool result = Deflate(NULL, 0, out, Z_FINISH);
+    deflateEnd(&mStream);
+    mInitialized = false;
+    return result;
+}
+
+bool HTTPCompressor::Deflate(const char* data, size_t length, std::string& out, int flush)
+{
+    if (!mInitialized)
+    {
+        return false;
+    }
+
+    mStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    mStream.avail_in = uInt(length);
+    while (true)
+    {
+        // Deflate straight into the end of out
+        size_t start = out.size();
+        out.resize(start + OUTPUT_STEP);
+        mStream.next_out = reinterpret_cast<Bytef*>(&out[start]);
+        mStream.avail_out = uInt(OUTPUT_STEP);
+        int rc = deflate(&mStream, flush);
+        out.resize(start + OUTPUT_STEP - mStream.avail_out);
+        if (rc == Z_STREAM_ERROR)
+        {
+            return false;
+        }
+        if (rc == Z_STREAM_END || (mStream.avail_out != 0 && mStream.avail_in == 0))
+        {
+            return true;
+        }
+    }
+}
+
+bool HTTPCompressor::Compress(HTTPContentEncoding encoding, const char* data, size_t length,
+        std::string& out, int level)
+{
+    HTTPCompressor compressor;
+    if (!compressor.Init(encoding, level))
+    {
+        return false;
+    }
+    out.reserve(out.size() + deflateBound(&compressor.mStream, uLong(length)));
+    return compressor.Deflate(data, length, out, Z_FINISH);
+}
+
+// Parses the q-value of a coding, from "q=0.5"; returns 1 if none
+static int ParseQuality(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ';'))
+    {
+        p++;
+    }
+    if (end - p < 3 || (p[0] != 'q' && p[0] != 'Q') || p[1] != '=')
+    {
+        return 1000;
+    }
+
+    // In thousandths, as q-values have at most 3 decimals
+    p += 2;
+    int quality = (*p == '1') ? 1000 : 0;
+    if (p < end && (*p == '0' || *p == '1'))
+    {
+        p++;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        int scale = 100;
+        while (p < end && *p >= '0' && *p <= '9' && scale > 0)
+        {
+            if (quality < 1000)
+            {
+                quality += (*p - '0') * scale;
+            }
+            scale /= 10;
+            p++;
+        }
+    }
+    return quality;
+}
+
+HTTPContentEncoding HTTPCompressor::Negotiate(const HTTPStringView& acceptEncoding)
+{
+    // -1 when not listed
+    int gzip = -1;
+    int deflate = -1;
+    int any = -1;
+
+    const char* p = acceptEncoding.data;
+    const char* end = p + acceptEncoding.length;
+    while (p < end)
+    {
+        const char* next = static_cast<const char*>(memchr(p, ',', end - p));
+        if (next == NULL)
+        {
+            next = end;
+        }
+        while (p < next && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        const char* nameEnd = p;
+        while (nameEnd < next && *nameEnd != ';' && *nameEnd != ' ' && *nameEnd != '\t')
+        {
+            nameEnd++;
+        }
+
+        HTTPStringView name(p, nameEnd - p);
+        int quality = ParseQuality(nameEnd, next);
+        if (name.EqualsIgnoreCase("gzip") || name.EqualsIgnoreCase("x-gzip"))
+        {
+            gzip = quality;
+        }
+        else if (name.EqualsIgnoreCase("deflate"))
+        {
+            deflate = quality;
+        }
+        else if (name.EqualsIgnoreCase("*"))
+        {
+            any = quality;
+        }
+        p = next + 1;
+    }
+
+    if (gzip < 0)
+    {
+        gzip = any;
+    }
+    if (deflate < 0)
+    {
+        deflate = any;
+    }
+    if (gzip > 0 && gzip >= deflate)
+    {
+        return EncodingGzip;
+    }
+    if (deflate > 0)
+    {
+        return EncodingDeflate;
+    }
+    return EncodingIdentity;
+}
+
+const char* HTTPCompressor::GetName(HTTPContentEncoding encoding)
+{
+    switch (encoding)
+    {
+    case EncodingGzip:
+        return "gzip";
+    case EncodingDeflate:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+// HTTPCompressionCache
+HTTPCompressionCache::HTTPCompressionCache(size_t maxBytes) :
+    mBytes(0), mMaxBytes(maxBytes), mHits(0), mMisses(0)
+{
+}
+
+bool HTTPCompressionCache::Get(HTTPContentEncoding encoding, const std::string& body,
+        std::string& compressed)
+{
+    MD5Hash hash;
+    hash.Update(reinterpret_cast<const unsigned char*>(body.data()), (unsigned int)body.size());
+    hash.Finish();
+    MD5Context result = hash.GetResult();
+    std::string key(reinterpret_cast<const char*>(result.digest), sizeof(result.digest));
+    key += char('0' + encoding);
+
+    {
+        AutoCriticalSection lock(&mLock);
+        std::map<std::string, Entry>::iterator iter = mEntries.find(key);
+        if (iter != mEntries.end())
+        {
+            mLRU.splice(mLRU.begin(), mLRU, iter->second.lru);
+            compressed = iter->second.data;
+            mHits++;
+            return true;
+        }
+        mMisses++;
+    }
+
+    // Compressed without the lock, a concurrent miss of the same body may do it too
+    compressed.clear();
+    if (!HTTPCompressor::Compress(encoding, body.data(), body.size(), compressed))
+    {
+        return false;
+    }
+
+    AutoCriticalSection lock(&mLock);
+    if (compressed.size() > mMaxBytes || mEntries.find(key) != mEntries.end())
+    {
+        return true;
+    }
+    mLRU.push_front(key);
+    Entry& entry = mEntries[key];
+    entry.data = compressed;
+    entry.lru = mLRU.begin();
+    mBytes += compressed.size();
+    Trim();
+    return true;
+}
+
+void HTTPCompressionCache::Clear()
+{
+    AutoCriticalSection lock(&mLock);
+    mEntries.clear();
+    mLRU.clear();
+    mBytes = 0;
+}
+
+size_t HTTPCompressionCache::GetSize()
+{
+    AutoCriticalSection lock(&mLock);
+    return mBytes;
+}
+
+void HTTPCompressionCache::Trim()
+{
+    while (mBytes > mMaxBytes && !mLRU.empty())
+    {
+        std::map<std::string, Entry>::iterator iter = mEntries.find(mLRU.back());
+        mBytes -= iter->second.data.size();
+        mEntries.erase(iter);
+        mLRU.pop_back();
+    }
+}
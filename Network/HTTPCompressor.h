@@ -0,0 +1,117 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPCompressor.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef HTTPCompressor_INCLUDED
+#define HTTPCompressor_INCLUDED
+
+#include <map>
+#include <list>
+#include <string>
+#include <zlib.h>
+#include "Types.h"
+#include "CriticalSection.h"
+#include "HTTPHeaderParser.h"
+
+enum HTTPContentEncoding
+{
+    EncodingIdentity, EncodingGzip, EncodingDeflate
+};
+
+// Compresses a body with the gzip or deflate content coding (zlib),
+// in one go or as a stream of pieces.
+class HTTPCompressor
+{
+public:
+    HTTPCompressor();
+    ~HTTPCompressor();
+
+    // Starts a stream. level is the zlib level, 1 (fastest) to 9 (smallest).
+    bool Init(HTTPContentEncoding encoding, int level = DEFAULT_LEVEL);
+
+    // Compresses the next piece of the body, appending the output to out.
+    // Output may be held back until more input comes or Finish is called.
+    bool Write(const char* data, size_t length, std::string& out);
+
+    // Flushes the rest of the stream to out, and ends it.
+    bool Finish(std::string& out);
+
+    // Compresses a whole body
+    static bool Compress(HTTPContentEncoding encoding, const char* data, size_t length,
+            std::string& out, int level = DEFAULT_LEVEL);
+
+    // Picks the encoding to answer with from an Accept-Encoding header value,
+    // honouring q-values; gzip is preferred over deflate when both are as welcome.
+    static HTTPContentEncoding Negotiate(const HTTPStringView& acceptEncoding);
+
+    // The Content-Encoding name, e.g. "gzip"
+    static const char* GetName(HTTPContentEncoding encoding);
+
+    // Level 6 compresses JSON nearly as well as 9, several times faster
+    static const int DEFAULT_LEVEL = 6;
+
+private:
+    bool Deflate(const char* data, size_t length, std::string& out, int flush);
+
+private:
+    HTTPCompressor(const HTTPCompressor&);
+    HTTPCompressor& operator =(const HTTPCompressor&);
+
+private:
+    z_stream mStream;
+    bool mInitialized;
+};
+
+// Compressed representations of static or rarely changing bodies,
+// keyed by the MD5 of the body and the encoding, so a body is compressed once.
+// Least recently used entries are dropped beyond the size limit. Thread-safe.
+class HTTPCompressionCache
+{
+public:
+    HTTPCompressionCache(size_t maxBytes = 64 * 1024 * 1024);
+
+    // Gets the compressed form of body, compressing and keeping it if not cached yet
+    bool Get(HTTPContentEncoding encoding, const std::string& body, std::string& compressed);
+
+    void Clear();
+
+    // Total size of the compressed data kept
+    size_t GetSize();
+
+    UInt64 GetHits() const
+    {
+        return mHits;
+    }
+
+    UInt64 GetMisses() const
+    {
+        return mMisses;
+    }
+
+private:
+    struct Entry
+    {
+        std::string data;
+        std::list<std::string>::iterator lru;
+    };
+
+    // Drops least recently used entries beyond the limit, with the lock held
+    void Trim();
+
+private:
+    HTTPCompressionCache(const HTTPCompressionCache&);
+    HTTPCompressionCache& operator =(const HTTPCompressionCache&);
+
+private:
+    CriticalSection mLock;
+    std::map<std::string, Entry> mEntries;
+    // Keys, most recently used first
+    std::list<std::string> mLRU;
+    size_t mBytes;
+    size_t mMaxBytes;
+    UInt64 mHits;
+    UInt64 mMisses;
+};
+
+#endif // HTTPCompressor_INCLUDED
@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPHeaderBuilder.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "HTTPHeaderBuilder.h"
+#include <ctime>
+
+// Length of "Sun, 06 Nov 1994 08:49:37 GMT"
+static const size_t HTTP_DATE_LENGTH = 29;
+
+// HTTPHeaderBlock
+HTTPHeaderBlock::HTTPHeaderBlock()
+{
+}
+
+bool HTTPHeaderBlock::AddHeader(const std::string& key, const std::string& value)
+{
+    if (key.empty() || value.empty())
+    {
+        return false;
+    }
+
+    HTTPHeaderBuilder builder(mData);
+    builder.AppendHeader(key, value);
+    return true;
+}
+
+// HTTPHeaderBuilder
+void HTTPHeaderBuilder::AppendStatusLine(int code, const std::string& reason)
+{
+    mBuffer.append("HTTP/1.1 ", 9);
+    AppendNumber(mBuffer, code);
+    mBuffer += ' ';
+    mBuffer += reason;
+    mBuffer.append("\r\n", 2);
+}
+
+void HTTPHeaderBuilder::AppendHeader(const char* key, UInt64 value)
+{
+    mBuffer += key;
+    mBuffer.append(": ", 2);
+    AppendNumber(mBuffer, value);
+    mBuffer.append("\r\n", 2);
+}
+
+void HTTPHeaderBuilder::AppendDate()
+{
+    mBuffer.append("Date: ", 6);
+    mBuffer.append(GetDate(), HTTP_DATE_LENGTH);
+    mBuffer.append("\r\n", 2);
+}
+
+void HTTPHeaderBuilder::AppendNumber(std::string& buffer, UInt64 value)
+{
+    // Digits are produced from the end
+    char digits[20];
+    char* p = digits + sizeof(digits);
+    do
+    {
+        *--p = char('0' + value % 10);
+        value /= 10;
+    }
+    while (value != 0);
+    buffer.append(p, digits + sizeof(digits) - p);
+}
+
+const char* HTTPHeaderBuilder::GetDate()
+{
+    // One cache per thread, so there is no lock on the response path
+    static __thread time_t cachedTime = 0;
+    static __thread char cachedDate[HTTP_DATE_LENGTH + 1];
+
+    time_t now = time(NULL);
+    if (now != cachedTime)
+    {
+        struct tm tmValue;
+        gmtime_r(&now, &tmValue);
+        strftime(cachedDate, sizeof(cachedDate), "%a, %d %b %Y %H:%M:%S GMT", &tmValue);
+        cachedTime = now;
+    }
+    return cachedDate;
+}
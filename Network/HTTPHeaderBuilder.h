@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPHeaderBuilder.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef HTTPHeaderBuilder_INCLUDED
+#define HTTPHeaderBuilder_INCLUDED
+
+#include <string>
+#include "Types.h"
+
+// Header lines prepared once and appended verbatim to many responses,
+// e.g. the Content-Type and Cache-Control of an end point.
+class HTTPHeaderBlock
+{
+public:
+    HTTPHeaderBlock();
+
+    // Add a "key: value" line. Returns false if key or value is empty.
+    bool AddHeader(const std::string& key, const std::string& value);
+
+    void Clear()
+    {
+        mData.clear();
+    }
+
+    bool Empty() const
+    {
+        return mData.empty();
+    }
+
+    // All the lines, each ending with CRLF
+    const std::string& GetData() const
+    {
+        return mData;
+    }
+
+private:
+    std::string mData;
+};
+
+// Appends the status line and header lines of a response directly to a buffer,
+// without formatting through temporary strings.
+// The buffer is typically reused across responses, e.g. the output buffer of a connection.
+class HTTPHeaderBuilder
+{
+public:
+    explicit HTTPHeaderBuilder(std::string& buffer) : mBuffer(buffer)
+    {
+    }
+
+    // "HTTP/1.1 code reason"
+    void AppendStatusLine(int code, const std::string& reason);
+
+    void AppendHeader(const char* key, size_t keyLength, const char* value, size_t valueLength)
+    {
+        mBuffer.append(key, keyLength);
+        mBuffer.append(": ", 2);
+        mBuffer.append(value, valueLength);
+        mBuffer.append("\r\n", 2);
+    }
+
+    void AppendHeader(const std::string& key, const std::string& value)
+    {
+        AppendHeader(key.data(), key.size(), value.data(), value.size());
+    }
+
+    void AppendHeader(const char* key, UInt64 value);
+
+    // The Date header, with the current time
+    void AppendDate();
+
+    void AppendBlock(const HTTPHeaderBlock& block)
+    {
+        mBuffer += block.GetData();
+    }
+
+    // The blank line ending the headers
+    void End()
+    {
+        mBuffer.append("\r\n", 2);
+    }
+
+    // Appends the decimal digits of value
+    static void AppendNumber(std::string& buffer, UInt64 value);
+
+    // Returns the current time as an HTTP date (RFC 7231 IMF-fixdate), 29 characters.
+    // The string is formatted at most once per second by each thread,
+    // and stays valid until the thread's next call.
+    static const char* GetDate();
+
+private:
+    std::string& mBuffer;
+};
+
+#endif // HTTPHeaderBuilder_INCLUDED
@@ -0,0 +1,278 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPHeaderParser.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "HTTPHeaderParser.h"
+#include <cstring>
+
+static inline char ToLowerASCII(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+static inline bool IsOWS(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// Returns the length of the line starting at data, without its line ending,
+// and sets next to the start of the following line.
+// Both CRLF and bare LF end a line. Returns false if there is no line ending.
+static inline bool FindLine(const char* data, size_t length, size_t& lineLength, size_t& next)
+{
+    const char* lf = static_cast<const char*>(memchr(data, '\n', length));
+    if (lf == NULL)
+    {
+        return false;
+    }
+
+    lineLength = lf - data;
+    next = lineLength + 1;
+    if (lineLength > 0 && data[lineLength - 1] == '\r')
+    {
+        lineLength--;
+    }
+    return true;
+}
+
+bool HTTPStringView::EqualsIgnoreCase(const char* str) const
+{
+    size_t i = 0;
+    for (; i < length; i++)
+    {
+        if (str[i] == '\0' || ToLowerASCII(data[i]) != ToLowerASCII(str[i]))
+        {
+            return false;
+        }
+    }
+    return str[i] == '\0';
+}
+
+HTTPHeaderParser::HTTPHeaderParser()
+{
+    Reset();
+}
+
+void HTTPHeaderParser::Reset()
+{
+    mVersion = HTTPStringView();
+    mStatusCode = 0;
+    mReason = HTTPStringView();
+    mFieldCount = 0;
+    mTruncated = false;
+    mDroppedLast = false;
+}
+
+bool HTTPHeaderParser::ParseResponse(const char* data, size_t length)
+{
+    Reset();
+
+    bool found = false;
+    bool inFields = false;
+    size_t pos = 0;
+    while (pos < length)
+    {
+        size_t lineLength;
+        size_t next;
+        if (!FindLine(data + pos, length - pos, lineLength, next))
+        {
+            // Last line not terminated, take it as is
+            lineLength = length - pos;
+            next = lineLength;
+        }
+
+        const char* line = data + pos;
+        pos += next;
+
+        if (!inFields)
+        {
+            if (lineLength == 0)
+            {
+                continue;
+            }
+
+            // A new response replaces the previous one
+            Reset();
+            found = ParseStatusLine(line, lineLength);
+            inFields = found;
+        }
+        else if (lineLength == 0)
+        {
+            inFields = false;
+        }
+        else
+        {
+            ParseFieldLine(line, lineLength);
+        }
+    }
+
+    return found;
+}
+
+size_t HTTPHeaderParser::ParseFields(const char* data, size_t length)
+{
+    mFieldCount = 0;
+    mTruncated = false;
+    mDroppedLast = false;
+
+    size_t pos = 0;
+    while (pos < length)
+    {
+        size_t lineLength;
+        size_t next;
+        if (!FindLine(data + pos, length - pos, lineLength, next))
+        {
+            return 0;
+        }
+
+        const char* line = data + pos;
+        pos += next;
+        if (lineLength == 0)
+        {
+            return pos;
+        }
+
+        if (!ParseFieldLine(line, lineLength))
+        {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+const HTTPStringView* HTTPHeaderParser::Find(const char* name) const
+{
+    for (int i = 0; i < mFieldCount; i++)
+    {
+        if (mFields[i].name.EqualsIgnoreCase(name))
+        {
+            return &mFields[i].value;
+        }
+    }
+    return NULL;
+}
+
+bool HTTPHeaderParser::Get(const char* name, std::string& value) const
+{
+    const HTTPStringView* view = Find(name);
+    if (view == NULL)
+    {
+        return false;
+    }
+
+    value.assign(view->data, view->length);
+    return true;
+}
+
+bool HTTPHeaderParser::ParseFieldLine(const char* line, size_t length)
+{
+    if (IsOWS(line[0]))
+    {
+        // Obsolete line folding: the value of the previous field goes on.
+        // The value view then spans the line break.
+        if (mFieldCount == 0)
+        {
+            return false;
+        }
+        if (mDroppedLast)
+        {
+            return true;
+        }
+
+        size_t end = length;
+        while (end > 0 && IsOWS(line[end - 1]))
+        {
+            end--;
+        }
+        if (end > 0)
+        {
+            HTTPStringView& value = mFields[mFieldCount - 1].value;
+            if (value.data == NULL || value.length == 0)
+            {
+                size_t start = 0;
+                while (IsOWS(line[start]))
+                {
+                    start++;
+                }
+                value = HTTPStringView(line + start, end - start);
+            }
+            else
+            {
+                value.length = (line + end) - value.data;
+            }
+        }
+        return true;
+    }
+
+    const char* colon = static_cast<const char*>(memchr(line, ':', length));
+    if (colon == NULL || colon == line)
+    {
+        return false;
+    }
+
+    // No whitespace is allowed between the name and the colon
+    if (IsOWS(colon[-1]))
+    {
+        return false;
+    }
+
+    if (mFieldCount >= MAX_FIELDS)
+    {
+        mTruncated = true;
+        mDroppedLast = true;
+        return true;
+    }
+    mDroppedLast = false;
+
+    const char* value = colon + 1;
+    const char* end = line + length;
+    while (value < end && IsOWS(*value))
+    {
+        value++;
+    }
+    while (end > value && IsOWS(end[-1]))
+    {
+        end--;
+    }
+
+    HTTPHeaderField& field = mFields[mFieldCount++];
+    field.name = HTTPStringView(line, colon - line);
+    field.value = HTTPStringView(value, end - value);
+    return true;
+}
+
+bool HTTPHeaderParser::ParseStatusLine(const char* line, size_t length)
+{
+    // HTTP-version SP status-code SP [reason-phrase]
+    const char* end = line + length;
+    const char* sp = static_cast<const char*>(memchr(line, ' ', length));
+    if (sp == NULL || sp == line || length < 5 || strncmp(line, "HTTP/", 5) != 0)
+    {
+        return false;
+    }
+    mVersion = HTTPStringView(line, sp - line);
+
+    const char* code = sp + 1;
+    int statusCode = 0;
+    int digits = 0;
+    while (code + digits < end && digits < 3 && code[digits] >= '0' && code[digits] <= '9')
+    {
+        statusCode = statusCode * 10 + (code[digits] - '0');
+        digits++;
+    }
+    if (digits != 3 || (code + 3 < end && code[3] != ' '))
+    {
+        return false;
+    }
+    mStatusCode = statusCode;
+
+    const char* reason = code + 3;
+    if (reason < end)
+    {
+        reason++;
+    }
+    mReason = HTTPStringView(reason, end - reason);
+    return true;
+}
@@ -0,0 +1,134 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPHeaderParser.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef HTTPHeaderParser_INCLUDED
+#define HTTPHeaderParser_INCLUDED
+
+#include <string>
+#include <cstddef>
+
+// A read-only view of characters owned by someone else, not null terminated.
+struct HTTPStringView
+{
+    HTTPStringView() : data(NULL), length(0)
+    {
+    }
+
+    HTTPStringView(const char* d, size_t len) : data(d), length(len)
+    {
+    }
+
+    bool Empty() const
+    {
+        return length == 0;
+    }
+
+    // Compares with a null terminated string, ignoring ASCII case.
+    bool EqualsIgnoreCase(const char* str) const;
+
+    std::string ToString() const
+    {
+        return std::string(data, length);
+    }
+
+    const char* data;
+    size_t length;
+};
+
+// One header field. Both views point into the parsed buffer.
+struct HTTPHeaderField
+{
+    HTTPStringView name;
+    // Without the surrounding whitespace
+    HTTPStringView value;
+};
+
+// Single-pass, allocation-free parser of HTTP header blocks.
+// The results are views into the parsed buffer, which must stay unchanged
+// while the results are used. Fields are kept in a fixed array,
+// extra fields are ignored (see IsTruncated).
+// Used for both responses (HTTPClient) and requests (server code).
+class HTTPHeaderParser
+{
+public:
+    enum
+    {
+        MAX_FIELDS = 64
+    };
+
+    HTTPHeaderParser();
+
+    // Parses the status line and the fields of a response.
+    // If data holds several responses (interim 1xx responses, redirects or proxy
+    // CONNECT replies, as collected by curl), the last one is kept.
+    // Returns false if no complete status line is found.
+    bool ParseResponse(const char* data, size_t length);
+
+    // Parses header fields, up to and including the empty line ending them.
+    // Returns the number of bytes consumed, or 0 if the end of the fields was not found.
+    size_t ParseFields(const char* data, size_t length);
+
+    // Forgets the results.
+    void Reset();
+
+    // Status line of a response
+    const HTTPStringView& GetVersion() const
+    {
+        return mVersion;
+    }
+
+    int GetStatusCode() const
+    {
+        return mStatusCode;
+    }
+
+    const HTTPStringView& GetReason() const
+    {
+        return mReason;
+    }
+
+    int GetFieldCount() const
+    {
+        return mFieldCount;
+    }
+
+    const HTTPHeaderField& GetField(int index) const
+    {
+        return mFields[index];
+    }
+
+    // Returns true if fields were dropped because there were more than MAX_FIELDS.
+    bool IsTruncated() const
+    {
+        return mTruncated;
+    }
+
+    // Returns the value of the first field with the given name, ignoring case,
+    // or NULL if there is none.
+    const HTTPStringView* Find(const char* name) const;
+
+    // Same as above, copying the value. Returns false if not found.
+    bool Get(const char* name, std::string& value) const;
+
+private:
+    // Parses one field line (without line ending), returns false if malformed
+    bool ParseFieldLine(const char* line, size_t length);
+
+    // Parses a status line (without line ending)
+    bool ParseStatusLine(const char* line, size_t length);
+
+private:
+    HTTPStringView mVersion;
+    int mStatusCode;
+    HTTPStringView mReason;
+
+    HTTPHeaderField mFields[MAX_FIELDS];
+    int mFieldCount;
+    bool mTruncated;
+    // The last field line was dropped, so are its continuation lines
+    bool mDroppedLast;
+};
+
+#endif // HTTPHeaderParser_INCLUDED
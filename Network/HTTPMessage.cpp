@@ -4,10 +4,35 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "HTTPMessage.h"
-#include "StringUtilities.h"
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-HTTPMessage::HTTPMessage()
+// Bodies up to this size are sent in the same buffer as the headers
+static const size_t MAX_INLINE_BODY = 16 * 1024;
+// Data of one chunk sent by Send
+static const size_t SEND_CHUNK = 64 * 1024;
+// The size line of a chunk is written with a fixed width (leading zeros are allowed),
+// so the data can be produced right after it: 8 hex digits and CRLF.
+static const size_t CHUNK_SIZE_LINE = 10;
+// Smaller bodies are not worth compressing
+static const size_t MIN_COMPRESS_SIZE = 256;
+
+// Fill the size line of a chunk at line
+static void WriteChunkSize(char* line, size_t length)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    for (int i = 0; i < 8; i++)
+    {
+        line[i] = HEX_DIGITS[(length >> (28 - 4 * i)) & 0xf];
+    }
+    line[8] = '\r';
+    line[9] = '\n';
+}
+
+HTTPMessage::HTTPMessage() : mHeaderBlock(NULL), mProducer(NULL), mProducerParam(NULL),
+    mBodyFileSize(0), mEncoding(EncodingIdentity), mCompressor(NULL)
 {
     mResponseCode = 0;
     mResponseString.clear();
@@ -15,7 +40,9 @@ HTTPMessage::HTTPMessage()
     mBodyString.clear();
 }
 
-HTTPMessage::HTTPMessage(int code, const std::string& response)
+HTTPMessage::HTTPMessage(int code, const std::string& response) : mHeaderBlock(NULL),
+    mProducer(NULL), mProducerParam(NULL), mBodyFileSize(0), mEncoding(EncodingIdentity),
+    mCompressor(NULL)
 {
     mResponseCode = code;
     mResponseString = response;
@@ -23,8 +50,43 @@ HTTPMessage::HTTPMessage(int code, const std::string& response)
     mBodyString.clear();
 }
 
+HTTPMessage::HTTPMessage(const HTTPMessage& other) : mCompressor(NULL)
+{
+    *this = other;
+}
+
+HTTPMessage& HTTPMessage::operator =(const HTTPMessage& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    mResponseCode = other.mResponseCode;
+    mResponseString = other.mResponseString;
+    mHeaders = other.mHeaders;
+    mHeaderBlock = other.mHeaderBlock;
+    mBodyString = other.mBodyString;
+    mProducer = other.mProducer;
+    mProducerParam = other.mProducerParam;
+    mBodyFile = other.mBodyFile;
+    mBodyFileSize = other.mBodyFileSize;
+    mEncoding = other.mEncoding;
+
+    delete mCompressor;
+    mCompressor = NULL;
+    if (other.mCompressor != NULL)
+    {
+        mCompressor = new HTTPCompressor();
+        mCompressor->Init(mEncoding);
+    }
+
+    return *this;
+}
+
 HTTPMessage::~HTTPMessage()
 {
+    delete mCompressor;
 }
 
 // Check if the HTTP message is validly formed
@@ -69,6 +131,7 @@ bool HTTPMessage::AddHeader(const std::string& key, const std::string& value)
 void HTTPMessage::CleanHeaders()
 {
     mHeaders.clear();
+    mHeaderBlock = NULL;
 }
 
 // Set the HTTP message body
@@ -80,57 +143,231 @@ bool HTTPMessage::SetBody(const std::string& body)
     }
 
     mBodyString = body;
+    mProducer = NULL;
+    mBodyFile.clear();
 
     return true;
 }
 
-// Send the completed HTTP message
-bool HTTPMessage::Send(Socket& streamSock)
+// Stream the body from producer
+void HTTPMessage::SetBodyProducer(HTTPBodyProducer producer, void* param)
 {
-    if (!IsValid())
+    mBodyString.clear();
+    mBodyFile.clear();
+    mProducer = producer;
+    mProducerParam = param;
+}
+
+// Send the contents of a file as the body
+bool HTTPMessage::SetBodyFile(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || access(path.c_str(), R_OK) != 0)
     {
         return false;
     }
-    if (streamSock.Sockfd() < 0)
+
+    mBodyString.clear();
+    mProducer = NULL;
+    mBodyFile = path;
+    mBodyFileSize = st.st_size;
+
+    return true;
+}
+
+// Append the next chunk of a chunked body
+bool HTTPMessage::AppendChunk(std::string& buffer, size_t maxSize, bool& done)
+{
+    done = false;
+    if (mProducer == NULL)
     {
         return false;
     }
+    if (maxSize > 0x7fffffff)
+    {
+        maxSize = 0x7fffffff;
+    }
+    if (mCompressor != NULL)
+    {
+        return AppendCompressedChunk(buffer, maxSize, done);
+    }
 
-    // The whole header string to send
-    std::string headerStr;
+    // Data is produced in place, after room for the size line
+    size_t start = buffer.size();
+    buffer.resize(start + CHUNK_SIZE_LINE + maxSize);
+    int length = mProducer(&buffer[start + CHUNK_SIZE_LINE], maxSize, mProducerParam);
+    if (length < 0)
+    {
+        buffer.resize(start);
+        return false;
+    }
+    if (length == 0)
+    {
+        // The last chunk, without trailer
+        buffer.resize(start);
+        buffer.append("0\r\n\r\n", 5);
+        done = true;
+        return true;
+    }
 
-    // Add the response line
-    std::string message;
-    message = StringUtilities::FormatString("HTTP/1.1 %d %s\r\n",
-            mResponseCode, mResponseString.c_str());
-    headerStr += message;
+    WriteChunkSize(&buffer[start], length);
+    buffer.resize(start + CHUNK_SIZE_LINE + length);
+    buffer.append("\r\n", 2);
+    return true;
+}
 
-    // Add the headers
-    for (std::map<std::string, std::string>::const_iterator citer =
-            mHeaders.begin(); citer != mHeaders.end(); ++citer)
+// AppendChunk for a compressed stream
+bool HTTPMessage::AppendCompressedChunk(std::string& buffer, size_t maxSize, bool& done)
+{
+    // The compressor writes after the size line.
+    // Input is produced until it gives some output, so no chunk is empty.
+    size_t start = buffer.size();
+    buffer.append(CHUNK_SIZE_LINE, '0');
+    while (!done && buffer.size() == start + CHUNK_SIZE_LINE)
     {
-        std::string key = citer->first;
-        std::string value = citer->second;
-        message = StringUtilities::FormatString("%s: %s\r\n", key.c_str(),
-                value.c_str());
-        headerStr += message;
+        mChunkInput.resize(maxSize);
+        int length = mProducer(&mChunkInput[0], maxSize, mProducerParam);
+        bool result = length < 0 ? false :
+                length == 0 ? mCompressor->Finish(buffer) :
+                mCompressor->Write(mChunkInput.data(), length, buffer);
+        if (!result)
+        {
+            buffer.resize(start);
+            return false;
+        }
+        done = length == 0;
     }
 
-    // Add the date
-    time_t currentTime = time(NULL);
-    char timeBuf[30];
-    strftime(timeBuf, sizeof(timeBuf), "%a, %d %b %Y %H:%M:%S GMT", gmtime(
-            &currentTime));
-    message = StringUtilities::FormatString("Date: %s\r\n", timeBuf);
-    headerStr += message;
+    size_t length = buffer.size() - start - CHUNK_SIZE_LINE;
+    if (length > 0)
+    {
+        WriteChunkSize(&buffer[start], length);
+        buffer.append("\r\n", 2);
+    }
+    else
+    {
+        buffer.resize(start);
+    }
+    if (done)
+    {
+        // The last chunk, without trailer
+        buffer.append("0\r\n\r\n", 5);
+        std::string().swap(mChunkInput);
+    }
+    return true;
+}
 
-    // Add the Content-length
-    message = StringUtilities::FormatString("Content-length: %u\r\n",
-            mBodyString.size());
-    headerStr += message;
+// Run the producer to the end and keep its output as the body
+bool HTTPMessage::BufferBody()
+{
+    if (mProducer == NULL)
+    {
+        return true;
+    }
 
-    // And the final blank line to signify the end of the headers
-    headerStr += "\r\n";
+    std::string body;
+    while (true)
+    {
+        size_t start = body.size();
+        body.resize(start + SEND_CHUNK);
+        int length = mProducer(&body[start], SEND_CHUNK, mProducerParam);
+        if (length < 0)
+        {
+            return false;
+        }
+        body.resize(start + length);
+        if (length == 0)
+        {
+            break;
+        }
+    }
+
+    mProducer = NULL;
+    mBodyString.swap(body);
+    return true;
+}
+
+// Compress the body with encoding
+bool HTTPMessage::Compress(HTTPContentEncoding encoding, HTTPCompressionCache* cache)
+{
+    if (encoding == EncodingIdentity || mCompressor != NULL || !mBodyFile.empty() ||
+            HasHeader("Content-Encoding"))
+    {
+        return false;
+    }
+
+    if (mProducer != NULL)
+    {
+        mCompressor = new HTTPCompressor();
+        if (!mCompressor->Init(encoding))
+        {
+            delete mCompressor;
+            mCompressor = NULL;
+            return false;
+        }
+    }
+    else
+    {
+        if (mBodyString.size() < MIN_COMPRESS_SIZE)
+        {
+            return false;
+        }
+
+        std::string compressed;
+        bool result = cache != NULL ? cache->Get(encoding, mBodyString, compressed) :
+                HTTPCompressor::Compress(encoding, mBodyString.data(), mBodyString.size(), compressed);
+        if (!result || compressed.size() >= mBodyString.size())
+        {
+            return false;
+        }
+        mBodyString.swap(compressed);
+    }
+
+    mEncoding = encoding;
+    AddHeader("Content-Encoding", HTTPCompressor::GetName(encoding));
+    AddHeader("Vary", "Accept-Encoding");
+    return true;
+}
+
+// Send the completed HTTP message
+bool HTTPMessage::Send(Socket& streamSock)
+{
+    if (streamSock.Sockfd() < 0)
+    {
+        return false;
+    }
+
+    // The whole header string to send, small bodies go along
+    bool inlineBody = mBodyString.size() <= MAX_INLINE_BODY;
+    std::string headerStr;
+    headerStr.reserve(256 + (inlineBody ? mBodyString.size() : 0));
+    if (!AppendHeaders(headerStr))
+    {
+        return false;
+    }
+    if (inlineBody)
+    {
+        headerStr += mBodyString;
+    }
+
+    if (mProducer != NULL)
+    {
+        // Chunks are sent as produced, the first one along with the headers
+        bool done = false;
+        while (!done)
+        {
+            if (!AppendChunk(headerStr, SEND_CHUNK, done))
+            {
+                return false;
+            }
+            if (streamSock.SendData(headerStr.data(), headerStr.size()) < 0)
+            {
+                return false;
+            }
+            headerStr.clear();
+        }
+        return true;
+    }
 
     int len = streamSock.SendData(headerStr.c_str(), headerStr.size());
     if(len < 0)
@@ -138,8 +375,13 @@ bool HTTPMessage::Send(Socket& streamSock)
         return false;
     }
 
+    if (!mBodyFile.empty())
+    {
+        return SendBodyFile(streamSock);
+    }
+
     // Send the body if present
-    if (mBodyString.size() > 0)
+    if (!inlineBody)
     {
         len = streamSock.SendData(mBodyString.c_str(), mBodyString.size());
     }
@@ -151,3 +393,91 @@ bool HTTPMessage::Send(Socket& streamSock)
 
     return true;
 }
+
+// Send the file body, which is announced with Content-length
+bool HTTPMessage::SendBodyFile(Socket& streamSock) const
+{
+    int fd = open(mBodyFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    Int64 offset = 0;
+    Int64 size = Int64(mBodyFileSize);
+    while (offset < size)
+    {
+        if (streamSock.SendFile(fd, offset, size - offset) <= 0)
+        {
+            break;
+        }
+    }
+    close(fd);
+
+    return offset == size;
+}
+
+// Append the completed HTTP message to buffer
+bool HTTPMessage::AppendTo(std::string& buffer, bool withBody) const
+{
+    if (!AppendHeaders(buffer))
+    {
+        return false;
+    }
+
+    if (withBody)
+    {
+        buffer += mBodyString;
+    }
+
+    return true;
+}
+
+// Append the status line and headers, up to the final blank line
+bool HTTPMessage::AppendHeaders(std::string& headerStr) const
+{
+    if (!IsValid())
+    {
+        return false;
+    }
+
+    HTTPHeaderBuilder builder(headerStr);
+
+    // Add the response line
+    builder.AppendStatusLine(mResponseCode, mResponseString);
+
+    // Add the prebuilt headers
+    if (mHeaderBlock != NULL)
+    {
+        builder.AppendBlock(*mHeaderBlock);
+    }
+
+    // Add the headers
+    for (std::map<std::string, std::string>::const_iterator citer =
+            mHeaders.begin(); citer != mHeaders.end(); ++citer)
+    {
+        builder.AppendHeader(citer->first, citer->second);
+    }
+
+    // Add the date, formatted once a second
+    builder.AppendDate();
+
+    // Add the Content-length, unless the body is sent chunked
+    if (mProducer != NULL)
+    {
+        builder.AppendHeader("Transfer-Encoding", 17, "chunked", 7);
+    }
+    else if (!mBodyFile.empty())
+    {
+        builder.AppendHeader("Content-length", mBodyFileSize);
+    }
+    else
+    {
+        builder.AppendHeader("Content-length", UInt64(mBodyString.size()));
+    }
+
+    // And the final blank line to signify the end of the headers
+    builder.End();
+
+    return true;
+}
@@ -9,12 +9,21 @@
 #include <string>
 #include <map>
 #include "Socket.h"
+#include "HTTPHeaderBuilder.h"
+#include "HTTPCompressor.h"
+
+// Produces the next part of a streamed body into buffer, up to size bytes.
+// Returns the number of bytes produced, 0 at the end of the body, or -1 on error.
+typedef int (*HTTPBodyProducer)(char* buffer, size_t size, void* param);
 
 class HTTPMessage
 {
 public:
     HTTPMessage();
     HTTPMessage(int code, const std::string& response);
+    // A copy of a message being streamed compressed starts a new compressed stream
+    HTTPMessage(const HTTPMessage& other);
+    HTTPMessage& operator =(const HTTPMessage& other);
     virtual ~HTTPMessage();
 
     // Check if the HTTP message is validly formed
@@ -26,15 +35,94 @@ public:
     // Add header
     bool AddHeader(const std::string& key, const std::string& value);
 
-    // Clear Headers
+    // Whether a header was added
+    bool HasHeader(const std::string& key) const
+    {
+        return mHeaders.find(key) != mHeaders.end();
+    }
+
+    // Clear Headers, including the header block
     void CleanHeaders();
 
+    // Use prebuilt header lines, sent before the other headers.
+    // The block is not copied, it must outlive the message.
+    void SetHeaderBlock(const HTTPHeaderBlock* block)
+    {
+        mHeaderBlock = block;
+    }
+
     // Set the HTTP message body
     bool SetBody(const std::string& body);
 
+    // Stream the body from producer, sent with Transfer-Encoding: chunked
+    // as it is produced, instead of a body held in memory.
+    void SetBodyProducer(HTTPBodyProducer producer, void* param);
+
+    // Send the contents of a file as the body, with sendfile().
+    // Returns false if path is not a readable regular file.
+    bool SetBodyFile(const std::string& path);
+
+    // Whether the body is sent chunked, from a producer
+    bool IsChunked() const
+    {
+        return mProducer != NULL;
+    }
+
+    // The file sent as body, empty if none
+    const std::string& GetBodyFile() const
+    {
+        return mBodyFile;
+    }
+
+    UInt64 GetBodyFileSize() const
+    {
+        return mBodyFileSize;
+    }
+
+    // Append the next chunk of a chunked body, of at most maxSize bytes of data,
+    // or the last chunk once the producer is done, which sets done.
+    // Returns false if the producer fails.
+    bool AppendChunk(std::string& buffer, size_t maxSize, bool& done);
+
+    // Run the producer to the end and keep its output as the body,
+    // for peers which do not take chunked bodies (HTTP/1.0).
+    bool BufferBody();
+
+    // Compress the body with encoding (see HTTPCompressor::Negotiate), adding Content-Encoding.
+    // A body in memory is compressed at once, through cache if given, and left as it is
+    // if small or not shrinking. A produced body is compressed as it is streamed,
+    // so call BufferBody() first if needed. File bodies are not compressed.
+    // Returns true if the body is sent compressed.
+    bool Compress(HTTPContentEncoding encoding, HTTPCompressionCache* cache = NULL);
+
     // Send the completed HTTP message
     bool Send(Socket& streamSock);
 
+    // Append the completed HTTP message to buffer, e.g. an output buffer
+    // holding several pipelined responses.
+    // withBody is false for responses to HEAD, which keep the Content-length of the body.
+    // Only the headers are appended for a chunked or file body, which the caller
+    // streams with AppendChunk or Socket::SendFile.
+    bool AppendTo(std::string& buffer, bool withBody = true) const;
+
+    int GetResponseCode() const
+    {
+        return mResponseCode;
+    }
+
+    const std::string& GetBody() const
+    {
+        return mBodyString;
+    }
+
+private:
+    // Append the status line and headers, up to the final blank line
+    bool AppendHeaders(std::string& headerStr) const;
+    // Send the file body
+    bool SendBodyFile(Socket& streamSock) const;
+    // AppendChunk for a compressed stream
+    bool AppendCompressedChunk(std::string& buffer, size_t maxSize, bool& done);
+
 private:
     // Response string and code supplied on the HTTP status line
     int mResponseCode;
@@ -42,9 +130,21 @@ private:
 
     // Header field/value pairs
     std::map<std::string, std::string> mHeaders;
+    const HTTPHeaderBlock* mHeaderBlock;
 
     // Body of the message
     std::string mBodyString;
+    // Or its producer
+    HTTPBodyProducer mProducer;
+    void* mProducerParam;
+    // Or its file
+    std::string mBodyFile;
+    UInt64 mBodyFileSize;
+
+    // Compression of the produced body, and its input
+    HTTPContentEncoding mEncoding;
+    HTTPCompressor* mCompressor;
+    std::string mChunkInput;
 };
 
 #endif // HTTPMessage_INCLUDED
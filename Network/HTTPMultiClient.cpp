@@ -0,0 +1,250 @@
+/*
+ * HTTPMultiClient.cpp
+ *
+ */
+
+#include <curl/curl.h>
+#include "HTTPMultiClient.h"
+#include "Timestamp.h"
+#include "Log.h"
+
+HTTPMultiClient::HTTPMultiClient(int maxPerHost, int maxTotal) :
+    mMulti(NULL), mThreadStarted(false), mStopping(false), mPending(0)
+{
+    // The shared curl state also takes care of the global curl initialization
+    HTTPClient::ReleaseHandle(HTTPClient::AcquireHandle());
+
+    mMulti = curl_multi_init();
+    if (mMulti != NULL)
+    {
+        curl_multi_setopt(mMulti, CURLMOPT_MAX_HOST_CONNECTIONS, long(maxPerHost > 0 ? maxPerHost : 1));
+        curl_multi_setopt(mMulti, CURLMOPT_MAX_TOTAL_CONNECTIONS, long(maxTotal > 0 ? maxTotal : 0));
+    }
+}
+
+HTTPMultiClient::~HTTPMultiClient()
+{
+    Stop();
+    if (mMulti != NULL)
+    {
+        curl_multi_cleanup(mMulti);
+    }
+}
+
+bool HTTPMultiClient::Submit(const HTTPClient& request,
+        HTTPCompletionCallback callback, void* param)
+{
+    if (mMulti == NULL)
+    {
+        return false;
+    }
+
+    AutoCriticalSection autoLock(&mCriticalSection);
+    if (mStopping)
+    {
+        return false;
+    }
+
+    if (!mThreadStarted)
+    {
+        if (pthread_create(&mEventThread, NULL, EventThreadProc, this) != 0)
+        {
+            LOG(LogError, "Failed to start HTTP event thread");
+            return false;
+        }
+        mThreadStarted = true;
+    }
+
+    Transfer* transfer = new Transfer;
+    transfer->request = request;
+    transfer->callback = callback;
+    transfer->param = param;
+    transfer->curl = NULL;
+    transfer->headerList = NULL;
+    mQueued.push_back(transfer);
+    mPending++;
+
+    curl_multi_wakeup(mMulti);
+    return true;
+}
+
+bool HTTPMultiClient::WaitAll(const Timespan& timeout)
+{
+    Timestamp start;
+    AutoCriticalSection autoLock(&mCriticalSection);
+    while (mPending > 0)
+    {
+        Int64 remaining = timeout.GetTotalMicroseconds() - start.GetElapsed();
+        if (remaining <= 0)
+        {
+            return false;
+        }
+        mAllDone.Wait(mCriticalSection, long(remaining / 1000) + 1);
+    }
+
+    return true;
+}
+
+int HTTPMultiClient::GetPending() const
+{
+    AutoCriticalSection autoLock(&mCriticalSection);
+    return mPending;
+}
+
+void HTTPMultiClient::Stop()
+{
+    bool started;
+    {
+        AutoCriticalSection autoLock(&mCriticalSection);
+        if (mStopping)
+        {
+            return;
+        }
+        mStopping = true;
+        started = mThreadStarted;
+        if (mMulti != NULL)
+        {
+            curl_multi_wakeup(mMulti);
+        }
+    }
+
+    if (started)
+    {
+        pthread_join(mEventThread, NULL);
+    }
+}
+
+void* HTTPMultiClient::EventThreadProc(void* param)
+{
+    static_cast<HTTPMultiClient*>(param)->Run();
+    return NULL;
+}
+
+void HTTPMultiClient::Run()
+{
+    for (;;)
+    {
+        StartQueued();
+
+        {
+            AutoCriticalSection autoLock(&mCriticalSection);
+            if (mStopping)
+            {
+                break;
+            }
+        }
+
+        int running = 0;
+        curl_multi_perform(mMulti, &running);
+        CompleteFinished();
+
+        // Sleeps until a transfer has something to do, its timeout expires,
+        // or Submit/Stop wakes it up
+        int numfds = 0;
+        curl_multi_poll(mMulti, NULL, 0, 1000, &numfds);
+    }
+
+    // Abort the transfers not completed
+    while (!mRunning.empty())
+    {
+        Transfer* transfer = mRunning.front();
+        mRunning.pop_front();
+        curl_multi_remove_handle(mMulti, transfer->curl);
+        Finish(transfer, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    std::list<Transfer*> queued;
+    {
+        AutoCriticalSection autoLock(&mCriticalSection);
+        queued.swap(mQueued);
+    }
+    for (std::list<Transfer*>::iterator it = queued.begin(); it != queued.end(); ++it)
+    {
+        Finish(*it, CURLE_ABORTED_BY_CALLBACK);
+    }
+}
+
+void HTTPMultiClient::StartQueued()
+{
+    std::list<Transfer*> queued;
+    {
+        AutoCriticalSection autoLock(&mCriticalSection);
+        queued.swap(mQueued);
+    }
+
+    for (std::list<Transfer*>::iterator it = queued.begin(); it != queued.end(); ++it)
+    {
+        Transfer* transfer = *it;
+        transfer->curl = HTTPClient::AcquireHandle();
+        if (transfer->curl == NULL)
+        {
+            Finish(transfer, CURLE_FAILED_INIT);
+            continue;
+        }
+
+        transfer->headerList = transfer->request.Setup(transfer->curl,
+                transfer->headerData, transfer->result.body, transfer->bodyTarget);
+        curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+        if (curl_multi_add_handle(mMulti, transfer->curl) != CURLM_OK)
+        {
+            Finish(transfer, CURLE_FAILED_INIT);
+            continue;
+        }
+        mRunning.push_back(transfer);
+    }
+}
+
+void HTTPMultiClient::CompleteFinished()
+{
+    int remaining = 0;
+    CURLMsg* msg;
+    while ((msg = curl_multi_info_read(mMulti, &remaining)) != NULL)
+    {
+        if (msg->msg != CURLMSG_DONE)
+        {
+            continue;
+        }
+
+        Transfer* transfer = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+        CURLcode performCode = msg->data.result;
+        curl_multi_remove_handle(mMulti, msg->easy_handle);
+        mRunning.remove(transfer);
+        Finish(transfer, performCode);
+    }
+}
+
+void HTTPMultiClient::Finish(Transfer* transfer, int performCode)
+{
+    HTTPResult& result = transfer->result;
+    if (transfer->curl != NULL)
+    {
+        result.success = HTTPClient::Complete(transfer->curl, performCode,
+                transfer->headerData, result.statusCode, result.headers,
+                result.dstIp, result.duration, result.errMsg);
+        HTTPClient::ReleaseHandle(transfer->curl);
+        curl_slist_free_all(transfer->headerList);
+    }
+    else
+    {
+        result.errMsg = curl_easy_strerror(CURLcode(performCode));
+    }
+
+    if (transfer->request.mSink != NULL)
+    {
+        transfer->request.mSink->Finish(result.success);
+    }
+
+    if (transfer->callback != NULL)
+    {
+        transfer->callback(result, transfer->param);
+    }
+    delete transfer;
+
+    AutoCriticalSection autoLock(&mCriticalSection);
+    mPending--;
+    if (mPending == 0)
+    {
+        mAllDone.Broadcast();
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * HTTPMultiClient.h
+ *
+ */
+
+#ifndef HTTPMULTICLIENT_H_
+#define HTTPMULTICLIENT_H_
+
+#include <list>
+#include <pthread.h>
+#include "HTTPClient.h"
+#include "Timespan.h"
+#include "CriticalSection.h"
+#include "Condition.h"
+
+// Runs many HTTPClient requests concurrently, on top of curl multi.
+// Requests are submitted from any thread with Submit() (or HTTPClient::Submit),
+// and are all driven by a single event thread, started on the first submission.
+// Completion callbacks are invoked from the event thread, so they must not block;
+// a callback may submit more requests.
+// Each request keeps its own timeout (HTTPClient::SetTimeout).
+// Connections, TLS sessions and DNS results are shared with HTTPClient::Access.
+class HTTPMultiClient
+{
+public:
+    // maxPerHost limits the concurrent connections per host,
+    // more requests to the same host wait in a queue for a free connection.
+    // maxTotal limits the concurrent connections of all hosts, 0 means unlimited.
+    HTTPMultiClient(int maxPerHost = 6, int maxTotal = 0);
+
+    // Aborts the requests not completed yet, see Stop().
+    ~HTTPMultiClient();
+
+    // Queues a copy of the request.
+    // Returns false if the event thread could not be started, or the client is stopped.
+    bool Submit(const HTTPClient& request, HTTPCompletionCallback callback, void* param);
+
+    // Waits until all the submitted requests are completed, up to timeout.
+    // Returns false if timed out.
+    bool WaitAll(const Timespan& timeout);
+
+    // Returns the number of submitted requests not completed yet.
+    int GetPending() const;
+
+    // Stops the event thread. Requests not completed yet are aborted,
+    // their callbacks are invoked with success false.
+    void Stop();
+
+private:
+    struct Transfer
+    {
+        HTTPClient request;
+        HTTPCompletionCallback callback;
+        void* param;
+        void* curl;
+        struct curl_slist* headerList;
+        HTTPClient::BodyTarget bodyTarget;
+        std::string headerData;
+        HTTPResult result;
+    };
+
+    static void* EventThreadProc(void* param);
+    void Run();
+    // Adds the queued transfers to the multi handle
+    void StartQueued();
+    // Completes the transfers reported done by curl
+    void CompleteFinished();
+    void Finish(Transfer* transfer, int performCode);
+
+private:
+    HTTPMultiClient(const HTTPMultiClient&);
+    HTTPMultiClient& operator =(const HTTPMultiClient&);
+
+private:
+    void* mMulti;
+    pthread_t mEventThread;
+    bool mThreadStarted;
+    bool mStopping;
+
+    // Submitted while not added to the multi handle yet
+    std::list<Transfer*> mQueued;
+    // Added to the multi handle, only used by the event thread
+    std::list<Transfer*> mRunning;
+    int mPending;
+
+    mutable CriticalSection mCriticalSection;
+    // Signaled whenever the pending count drops to 0
+    Condition mAllDone;
+};
+
+#endif /* HTTPMULTICLIENT_H_ */
@@ -0,0 +1,422 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPRequestParser.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "HTTPRequestParser.h"
+#include <cstring>
+
+// Longest chunk size line (size and extensions) accepted
+static const size_t MAX_CHUNK_LINE = 1024;
+
+static inline bool IsTokenChar(unsigned char c)
+{
+    // tchar of RFC 7230, without the rarely used ones
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '_' || c == '.' || c == '!' || c == '#' || c == '$' ||
+            c == '%' || c == '&' || c == '\'' || c == '*' || c == '+' || c == '^' ||
+            c == '`' || c == '|' || c == '~';
+}
+
+static inline int HexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Finds the line starting at pos. Sets end to the end of the line without
+// its line ending (CRLF or LF), and next to the start of the following line.
+static inline bool FindLine(const char* data, size_t pos, size_t length, size_t& end, size_t& next)
+{
+    const char* lf = static_cast<const char*>(memchr(data + pos, '\n', length - pos));
+    if (lf == NULL)
+    {
+        return false;
+    }
+
+    end = lf - data;
+    next = end + 1;
+    if (end > pos && data[end - 1] == '\r')
+    {
+        end--;
+    }
+    return true;
+}
+
+HTTPRequestParser::HTTPRequestParser(size_t maxHeaderSize, size_t maxBodySize) :
+    mMaxHeaderSize(maxHeaderSize), mMaxBodySize(maxBodySize)
+{
+    Reset();
+}
+
+void HTTPRequestParser::Reset()
+{
+    mState = StateRequestLine;
+    mPos = 0;
+    mConsumed = 0;
+    mErrorStatus = 0;
+    mMethod.offset = mMethod.length = 0;
+    mTarget.offset = mTarget.length = 0;
+    mVersion.offset = mVersion.length = 0;
+    mFieldCount = 0;
+    mBody.offset = mBody.length = 0;
+    mChunked = false;
+    mContentLength = 0;
+    mChunkRemaining = 0;
+    mTrailerSize = 0;
+}
+
+HTTPRequestParser::Result HTTPRequestParser::Parse(char* data, size_t length)
+{
+    for (;;)
+    {
+        size_t end;
+        size_t next;
+        switch (mState)
+        {
+        case StateRequestLine:
+        case StateHeaders:
+            if (!FindLine(data, mPos, length, end, next))
+            {
+                return length > mMaxHeaderSize ? Fail(431) : ResultIncomplete;
+            }
+            if (next > mMaxHeaderSize)
+            {
+                return Fail(431);
+            }
+
+            if (mState == StateRequestLine)
+            {
+                // Empty lines before the request line are ignored
+                if (end > mPos)
+                {
+                    if (!ParseRequestLine(data, mPos, end))
+                    {
+                        return Fail(400);
+                    }
+                    mState = StateHeaders;
+                }
+                mPos = next;
+            }
+            else if (end == mPos)
+            {
+                // End of headers
+                mPos = next;
+                Result result = StartBody(data);
+                if (result != ResultComplete)
+                {
+                    return result;
+                }
+            }
+            else
+            {
+                int status = ParseField(data, mPos, end);
+                if (status != 0)
+                {
+                    return Fail(status);
+                }
+                mPos = next;
+            }
+            break;
+
+        case StateBody:
+            if (length < mPos + mContentLength)
+            {
+                return ResultIncomplete;
+            }
+            mBody.offset = mPos;
+            mBody.length = size_t(mContentLength);
+            mConsumed = mPos + size_t(mContentLength);
+            mState = StateDone;
+            break;
+
+        case StateChunkSize:
+        {
+            if (!FindLine(data, mPos, length, end, next))
+            {
+                return (length - mPos > MAX_CHUNK_LINE) ? Fail(400) : ResultIncomplete;
+            }
+
+            UInt64 size = 0;
+            size_t i = mPos;
+            for (; i < end; i++)
+            {
+                int digit = HexValue(data[i]);
+                if (digit < 0)
+                {
+                    break;
+                }
+                if (size > (mMaxBodySize >> 4) + 1)
+                {
+                    return Fail(413);
+                }
+                size = (size << 4) | UInt64(digit);
+            }
+            // Chunk extensions after ';' are ignored
+            if (i == mPos || (i < end && data[i] != ';' && data[i] != ' ' && data[i] != '\t'))
+            {
+                return Fail(400);
+            }
+            if (mBody.length + size > mMaxBodySize)
+            {
+                return Fail(413);
+            }
+
+            mPos = next;
+            if (size == 0)
+            {
+                mState = StateTrailer;
+            }
+            else
+            {
+                mChunkRemaining = size;
+                mState = StateChunkData;
+            }
+            break;
+        }
+
+        case StateChunkData:
+        {
+            size_t available = length - mPos;
+            if (available == 0)
+            {
+                return ResultIncomplete;
+            }
+            size_t n = (mChunkRemaining < available) ? size_t(mChunkRemaining) : available;
+            // Decode in place, the decoded body never passes the raw data
+            size_t target = mBody.offset + mBody.length;
+            if (target != mPos)
+            {
+                memmove(data + target, data + mPos, n);
+            }
+            mBody.length += n;
+            mPos += n;
+            mChunkRemaining -= n;
+            if (mChunkRemaining == 0)
+            {
+                mState = StateChunkDataEnd;
+            }
+            break;
+        }
+
+        case StateChunkDataEnd:
+            if (length - mPos < 1 || (data[mPos] == '\r' && length - mPos < 2))
+            {
+                return ResultIncomplete;
+            }
+            if (data[mPos] == '\r')
+            {
+                mPos++;
+            }
+            if (data[mPos] != '\n')
+            {
+                return Fail(400);
+            }
+            mPos++;
+            mState = StateChunkSize;
+            break;
+
+        case StateTrailer:
+            if (!FindLine(data, mPos, length, end, next))
+            {
+                return (mTrailerSize + length - mPos > mMaxHeaderSize) ? Fail(431) : ResultIncomplete;
+            }
+            mTrailerSize += next - mPos;
+            if (mTrailerSize > mMaxHeaderSize)
+            {
+                return Fail(431);
+            }
+            // Trailer fields are skipped, an empty line ends the request
+            if (end == mPos)
+            {
+                mConsumed = next;
+                mState = StateDone;
+            }
+            mPos = next;
+            break;
+
+        case StateDone:
+            return ResultComplete;
+
+        case StateError:
+            return ResultError;
+        }
+    }
+}
+
+const HTTPRequestParser::Span* HTTPRequestParser::Find(const char* data, const char* name) const
+{
+    for (int i = 0; i < mFieldCount; i++)
+    {
+        if (View(data, mFields[i].name).EqualsIgnoreCase(name))
+        {
+            return &mFields[i].value;
+        }
+    }
+    return NULL;
+}
+
+bool HTTPRequestParser::ParseRequestLine(const char* data, size_t start, size_t end)
+{
+    // method SP request-target SP HTTP-version
+    size_t i = start;
+    while (i < end && IsTokenChar(data[i]))
+    {
+        i++;
+    }
+    if (i == start || i == end || data[i] != ' ')
+    {
+        return false;
+    }
+    mMethod.offset = start;
+    mMethod.length = i - start;
+
+    size_t targetStart = ++i;
+    while (i < end && data[i] != ' ')
+    {
+        // No control characters in the target
+        if ((unsigned char)data[i] <= 0x20 || data[i] == 0x7f)
+        {
+            return false;
+        }
+        i++;
+    }
+    if (i == targetStart || i == end)
+    {
+        return false;
+    }
+    mTarget.offset = targetStart;
+    mTarget.length = i - targetStart;
+
+    size_t versionStart = ++i;
+    if (end - versionStart != 8 || memcmp(data + versionStart, "HTTP/1.", 7) != 0 ||
+            data[versionStart + 7] < '0' || data[versionStart + 7] > '9')
+    {
+        return false;
+    }
+    mVersion.offset = versionStart;
+    mVersion.length = 8;
+    return true;
+}
+
+int HTTPRequestParser::ParseField(const char* data, size_t start, size_t end)
+{
+    // Obsolete line folding is rejected, as allowed for servers
+    size_t i = start;
+    while (i < end && IsTokenChar(data[i]))
+    {
+        i++;
+    }
+    if (i == start || i == end || data[i] != ':')
+    {
+        return 400;
+    }
+    if (mFieldCount >= MAX_FIELDS)
+    {
+        return 431;
+    }
+
+    Field& field = mFields[mFieldCount++];
+    field.name.offset = start;
+    field.name.length = i - start;
+
+    size_t valueStart = i + 1;
+    while (valueStart < end && (data[valueStart] == ' ' || data[valueStart] == '\t'))
+    {
+        valueStart++;
+    }
+    size_t valueEnd = end;
+    while (valueEnd > valueStart && (data[valueEnd - 1] == ' ' || data[valueEnd - 1] == '\t'))
+    {
+        valueEnd--;
+    }
+    field.value.offset = valueStart;
+    field.value.length = valueEnd - valueStart;
+    return 0;
+}
+
+HTTPRequestParser::Result HTTPRequestParser::StartBody(const char* data)
+{
+    const Span* transferEncoding = NULL;
+    const Span* contentLength = NULL;
+    for (int i = 0; i < mFieldCount; i++)
+    {
+        HTTPStringView name = View(data, mFields[i].name);
+        if (name.EqualsIgnoreCase("Content-Length"))
+        {
+            // Repeated Content-Length must agree
+            if (contentLength != NULL &&
+                    (contentLength->length != mFields[i].value.length ||
+                    memcmp(data + contentLength->offset, data + mFields[i].value.offset,
+                            contentLength->length) != 0))
+            {
+                return Fail(400);
+            }
+            contentLength = &mFields[i].value;
+        }
+        else if (name.EqualsIgnoreCase("Transfer-Encoding"))
+        {
+            transferEncoding = &mFields[i].value;
+        }
+    }
+
+    mBody.offset = mPos;
+    mBody.length = 0;
+
+    if (transferEncoding != NULL)
+    {
+        // Both framings at once is a request smuggling attempt
+        if (contentLength != NULL)
+        {
+            return Fail(400);
+        }
+        if (!View(data, *transferEncoding).EqualsIgnoreCase("chunked"))
+        {
+            return Fail(501);
+        }
+        mChunked = true;
+        mState = StateChunkSize;
+        return ResultComplete;
+    }
+
+    if (contentLength != NULL)
+    {
+        if (contentLength->length == 0 || contentLength->length > 18)
+        {
+            return Fail(contentLength->length > 18 ? 413 : 400);
+        }
+        UInt64 value = 0;
+        for (size_t i = 0; i < contentLength->length; i++)
+        {
+            char c = data[contentLength->offset + i];
+            if (c < '0' || c > '9')
+            {
+                return Fail(400);
+            }
+            value = value * 10 + UInt64(c - '0');
+        }
+        if (value > mMaxBodySize)
+        {
+            return Fail(413);
+        }
+        mContentLength = value;
+        mState = StateBody;
+        return ResultComplete;
+    }
+
+    // No body
+    mConsumed = mPos;
+    mState = StateDone;
+    return ResultComplete;
+}
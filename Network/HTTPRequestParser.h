@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPRequestParser.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef HTTPRequestParser_INCLUDED
+#define HTTPRequestParser_INCLUDED
+
+#include <cstddef>
+#include "Types.h"
+#include "HTTPHeaderParser.h"
+
+// Incremental, allocation-free HTTP/1.1 request parser.
+// Parse() is called with the start of the request in the receive buffer,
+// each time more data arrives; parsing resumes where it stopped.
+// Results are recorded as offsets from the start of the request, so the buffer
+// may move (e.g. a growing std::string) between calls, but the bytes already
+// passed must not change.
+// A chunked body is decoded in place: chunk data is moved to be contiguous
+// right after the headers, so the body is one span in both cases.
+class HTTPRequestParser
+{
+public:
+    enum Result
+    {
+        ResultIncomplete, ResultComplete, ResultError
+    };
+
+    enum
+    {
+        MAX_FIELDS = 64
+    };
+
+    // A range of the request, relative to its first byte
+    struct Span
+    {
+        size_t offset;
+        size_t length;
+    };
+
+    struct Field
+    {
+        Span name;
+        Span value;
+    };
+
+    // Requests with a larger request line and headers fail with 431,
+    // larger bodies with 413.
+    HTTPRequestParser(size_t maxHeaderSize = 8 * 1024, size_t maxBodySize = 1024 * 1024);
+
+    void SetLimits(size_t maxHeaderSize, size_t maxBodySize)
+    {
+        mMaxHeaderSize = maxHeaderSize;
+        mMaxBodySize = maxBodySize;
+    }
+
+    // Gets ready for the next request.
+    void Reset();
+
+    // Parses the first length bytes of the request starting at data.
+    // data is modified when a chunked body is decoded.
+    Result Parse(char* data, size_t length);
+
+    // Once complete, the number of bytes the request takes in the buffer,
+    // the next pipelined request starts right after.
+    size_t GetConsumed() const
+    {
+        return mConsumed;
+    }
+
+    // Once failed, the status code to answer with:
+    // 400 malformed, 413 body too large, 431 headers too large, 501 unsupported transfer coding.
+    int GetErrorStatus() const
+    {
+        return mErrorStatus;
+    }
+
+    const Span& GetMethod() const
+    {
+        return mMethod;
+    }
+
+    const Span& GetTarget() const
+    {
+        return mTarget;
+    }
+
+    const Span& GetVersion() const
+    {
+        return mVersion;
+    }
+
+    // Decoded body, empty if none
+    const Span& GetBody() const
+    {
+        return mBody;
+    }
+
+    bool IsChunked() const
+    {
+        return mChunked;
+    }
+
+    int GetFieldCount() const
+    {
+        return mFieldCount;
+    }
+
+    const Field& GetField(int index) const
+    {
+        return mFields[index];
+    }
+
+    // Returns the value of the first field with the given name, ignoring case,
+    // or NULL if there is none. data is the start of the request.
+    const Span* Find(const char* data, const char* name) const;
+
+    static HTTPStringView View(const char* data, const Span& span)
+    {
+        return HTTPStringView(data + span.offset, span.length);
+    }
+
+private:
+    enum State
+    {
+        StateRequestLine,
+        StateHeaders,
+        StateBody,
+        StateChunkSize,
+        StateChunkData,
+        StateChunkDataEnd,
+        StateTrailer,
+        StateDone,
+        StateError
+    };
+
+    Result Fail(int status)
+    {
+        mState = StateError;
+        mErrorStatus = status;
+        return ResultError;
+    }
+
+    bool ParseRequestLine(const char* data, size_t start, size_t end);
+    // Returns 0, or the error status
+    int ParseField(const char* data, size_t start, size_t end);
+    // Picks the body framing once the headers are complete.
+    // Returns ResultComplete to go on parsing, or ResultError.
+    Result StartBody(const char* data);
+
+private:
+    size_t mMaxHeaderSize;
+    size_t mMaxBodySize;
+
+    State mState;
+    // Where parsing resumes
+    size_t mPos;
+    size_t mConsumed;
+    int mErrorStatus;
+
+    Span mMethod;
+    Span mTarget;
+    Span mVersion;
+    Field mFields[MAX_FIELDS];
+    int mFieldCount;
+
+    Span mBody;
+    bool mChunked;
+    UInt64 mContentLength;
+    UInt64 mChunkRemaining;
+    // Size of the trailer section, limited like headers
+    size_t mTrailerSize;
+};
+
+#endif // HTTPRequestParser_INCLUDED
@@ -0,0 +1,297 @@
+/*
+ * HTTPResponseSink.cpp
+ *
+ */
+
+#include "HTTPResponseSink.h"
+#include "JSONParser.h"
+#include "Log.h"
+#include <cstdio>
+
+// HTTPStringSink
+void HTTPStringSink::OnContentLength(Int64 length)
+{
+    if (length > 0 && length <= MAX_RESERVE)
+    {
+        mBody.reserve(mBody.size() + size_t(length));
+    }
+}
+
+bool HTTPStringSink::Write(const char* data, size_t length)
+{
+    mBody.append(data, length);
+    return true;
+}
+
+// HTTPFileSink
+HTTPFileSink::HTTPFileSink(const FileSpec& file) :
+    mFile(file), mTemp(file.GetPath() + ".tmp"), mOpened(false), mGood(true)
+{
+}
+
+HTTPFileSink::~HTTPFileSink()
+{
+    // A transfer not finished leaves nothing behind
+    if (mOpened)
+    {
+        Discard();
+    }
+}
+
+void HTTPFileSink::OnContentLength(Int64 length)
+{
+    Open();
+}
+
+bool HTTPFileSink::Write(const char* data, size_t length)
+{
+    if (!Open())
+    {
+        return false;
+    }
+
+    while (length > 0)
+    {
+        int written = mTemp.Write(data, length);
+        if (written <= 0)
+        {
+            LOG(LogError, "Failed to write response to: %s", mTemp.GetPath().c_str());
+            mGood = false;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+void HTTPFileSink::Finish(bool success)
+{
+    if (!success)
+    {
+        // Nothing is created or replaced for a failed request
+        if (mOpened)
+        {
+            Discard();
+        }
+        return;
+    }
+
+    // An empty body still creates an empty file
+    if (!Open())
+    {
+        mOpened = false;
+        return;
+    }
+    mTemp.Close();
+    mOpened = false;
+    if (!mGood)
+    {
+        mTemp.Remove();
+        return;
+    }
+    if (rename(mTemp.GetPath().c_str(), mFile.GetPath().c_str()) != 0)
+    {
+        LOG(LogError, "Failed to rename response file to: %s", mFile.GetPath().c_str());
+        mGood = false;
+        mTemp.Remove();
+    }
+}
+
+void HTTPFileSink::Discard()
+{
+    mTemp.Close();
+    mTemp.Remove();
+    mOpened = false;
+}
+
+bool HTTPFileSink::Open()
+{
+    if (mOpened)
+    {
+        return mGood;
+    }
+
+    mOpened = true;
+    if (!mTemp.Open(true))
+    {
+        LOG(LogError, "Failed to open response file: %s", mTemp.GetPath().c_str());
+        mGood = false;
+        return false;
+    }
+    mTemp.SetSize(0);
+    return true;
+}
+
+// HTTPJSONSink
+HTTPJSONSink::HTTPJSONSink(JSONValueCallback callback, void* param) :
+    mCallback(callback), mParam(param), mMode(ModeUnknown), mDepth(0),
+    mInValue(false), mScalar(false), mInString(false), mEscape(false),
+    mError(false), mCount(0)
+{
+}
+
+static inline bool IsJSONWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool HTTPJSONSink::Write(const char* data, size_t length)
+{
+    if (mError)
+    {
+        return false;
+    }
+
+    // Values are only tokenized here, text is copied span by span
+    // and parsed by JSONParser once complete
+    int base = (mMode == ModeArray) ? 1 : 0;
+    size_t spanStart = 0;
+    size_t i = 0;
+    while (i < length)
+    {
+        char c = data[i];
+        if (!mInValue)
+        {
+            if (IsJSONWhitespace(c))
+            {
+                i++;
+                continue;
+            }
+
+            if (mMode == ModeUnknown)
+            {
+                if (c == '[')
+                {
+                    mMode = ModeArray;
+                    mDepth = 1;
+                    base = 1;
+                    i++;
+                    continue;
+                }
+                mMode = ModeValues;
+            }
+
+            if (mMode == ModeArray && mDepth == 1 && (c == ',' || c == ']'))
+            {
+                if (c == ']')
+                {
+                    mMode = ModeDone;
+                    mDepth = 0;
+                }
+                i++;
+                continue;
+            }
+
+            if (mMode == ModeDone)
+            {
+                LOG(LogError, "Unexpected data after JSON array");
+                mError = true;
+                return false;
+            }
+
+            mInValue = true;
+            mScalar = (c != '{' && c != '[' && c != '"');
+            mBuffer.clear();
+            spanStart = i;
+        }
+
+        if (mScalar)
+        {
+            // Numbers, true, false and null end with the next delimiter,
+            // which is processed again as a separator
+            if (c == ',' || c == ']' || IsJSONWhitespace(c))
+            {
+                mBuffer.append(data + spanStart, i - spanStart);
+                if (!Emit())
+                {
+                    return false;
+                }
+                continue;
+            }
+            i++;
+            continue;
+        }
+
+        bool complete = false;
+        if (mInString)
+        {
+            if (mEscape)
+            {
+                mEscape = false;
+            }
+            else if (c == '\\')
+            {
+                mEscape = true;
+            }
+            else if (c == '"')
+            {
+                mInString = false;
+                complete = (mDepth == base);
+            }
+        }
+        else if (c == '"')
+        {
+            mInString = true;
+        }
+        else if (c == '{' || c == '[')
+        {
+            mDepth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            mDepth--;
+            complete = (mDepth == base);
+        }
+
+        i++;
+        if (complete)
+        {
+            mBuffer.append(data + spanStart, i - spanStart);
+            if (!Emit())
+            {
+                return false;
+            }
+        }
+    }
+
+    if (mInValue)
+    {
+        mBuffer.append(data + spanStart, length - spanStart);
+    }
+
+    return true;
+}
+
+void HTTPJSONSink::Finish(bool success)
+{
+    // A trailing scalar has no delimiter after it
+    if (success && mInValue && mScalar && !mError)
+    {
+        Emit();
+    }
+
+    if (success && (mInValue || mMode == ModeArray))
+    {
+        LOG(LogError, "Truncated JSON response");
+        mError = true;
+    }
+}
+
+bool HTTPJSONSink::Emit()
+{
+    mInValue = false;
+    JSONValue* value = JSONParser::Parse(mBuffer.c_str());
+    if (value == NULL)
+    {
+        LOG(LogError, "Invalid JSON value in response");
+        mError = true;
+        return false;
+    }
+
+    mCount++;
+    bool ret = mCallback(value, mParam);
+    delete value;
+    return ret;
+}
@@ -0,0 +1,166 @@
+/*
+ * HTTPResponseSink.h
+ *
+ */
+
+#ifndef HTTPRESPONSESINK_H_
+#define HTTPRESPONSESINK_H_
+
+#include <string>
+#include <cstddef>
+#include "Types.h"
+#include "FileSpec.h"
+
+class JSONValue;
+
+// Receives a response body as it arrives, instead of having it buffered in memory.
+// Set on a request with HTTPClient::SetSink. A sink receives one body at a time.
+class HTTPResponseSink
+{
+public:
+    virtual ~HTTPResponseSink()
+    {
+    }
+
+    // Called before the first body data, with the Content-Length of the response,
+    // or -1 if unknown (e.g. chunked transfer).
+    virtual void OnContentLength(Int64 length)
+    {
+    }
+
+    // Called for each piece of the body, in order.
+    // Returns false to abort the transfer.
+    virtual bool Write(const char* data, size_t length) = 0;
+
+    // Called once the transfer is over, success tells whether the request succeeded.
+    virtual void Finish(bool success)
+    {
+    }
+};
+
+// Buffers the body in a string, reserving its capacity from Content-Length.
+class HTTPStringSink: public HTTPResponseSink
+{
+public:
+    HTTPStringSink(std::string& body) : mBody(body)
+    {
+    }
+
+    void OnContentLength(Int64 length);
+    bool Write(const char* data, size_t length);
+
+    // Largest Content-Length trusted for reserving, larger bodies grow as usual
+    static const Int64 MAX_RESERVE = 256 * 1024 * 1024;
+
+private:
+    std::string& mBody;
+};
+
+// Receives a piece of the body, returns false to abort the transfer.
+typedef bool (*HTTPDataCallback)(const char* data, size_t length, void* param);
+
+// Passes the body to a callback.
+class HTTPCallbackSink: public HTTPResponseSink
+{
+public:
+    HTTPCallbackSink(HTTPDataCallback callback, void* param) :
+        mCallback(callback), mParam(param)
+    {
+    }
+
+    bool Write(const char* data, size_t length)
+    {
+        return mCallback(data, length, mParam);
+    }
+
+private:
+    HTTPDataCallback mCallback;
+    void* mParam;
+};
+
+// Writes the body to a file. The body is written to "<file>.tmp", which is renamed
+// to the file once the request succeeded, so a failed download leaves the file as it was.
+class HTTPFileSink: public HTTPResponseSink
+{
+public:
+    HTTPFileSink(const FileSpec& file);
+    ~HTTPFileSink();
+
+    void OnContentLength(Int64 length);
+    bool Write(const char* data, size_t length);
+    void Finish(bool success);
+
+    // Returns false if the file could not be opened, written or renamed.
+    bool IsGood() const
+    {
+        return mGood;
+    }
+
+private:
+    bool Open();
+    // Closes and removes the temporary file
+    void Discard();
+
+private:
+    FileSpec mFile;
+    FileSpec mTemp;
+    bool mOpened;
+    bool mGood;
+};
+
+// Receives one parsed JSON value. The value is deleted once the callback returns.
+// Returns false to abort the transfer.
+typedef bool (*JSONValueCallback)(JSONValue* value, void* param);
+
+// Parses the body incrementally as a stream of JSON values:
+// the elements of a top level array, or top level values separated by
+// whitespace (newline delimited JSON).
+// Each value is parsed as soon as its text is complete, so only one value
+// is held in memory at a time, whatever the size of the body.
+class HTTPJSONSink: public HTTPResponseSink
+{
+public:
+    HTTPJSONSink(JSONValueCallback callback, void* param);
+
+    bool Write(const char* data, size_t length);
+    void Finish(bool success);
+
+    // Returns false if the body was not valid JSON.
+    bool IsGood() const
+    {
+        return !mError;
+    }
+
+    // Returns the number of values delivered.
+    int GetCount() const
+    {
+        return mCount;
+    }
+
+private:
+    // Parses and delivers the current value
+    bool Emit();
+
+private:
+    enum Mode
+    {
+        ModeUnknown, ModeArray, ModeValues, ModeDone
+    };
+
+    JSONValueCallback mCallback;
+    void* mParam;
+
+    Mode mMode;
+    // Nesting depth, including the top level array
+    int mDepth;
+    bool mInValue;
+    bool mScalar;
+    bool mInString;
+    bool mEscape;
+    bool mError;
+    int mCount;
+    // Text of the current value, reused across values
+    std::string mBuffer;
+};
+
+#endif /* HTTPRESPONSESINK_H_ */
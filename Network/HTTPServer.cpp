@@ -0,0 +1,811 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPServer.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "HTTPServer.h"
+#include "Timestamp.h"
+#include "Log.h"
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+
+// Stop parsing pipelined requests while this much output is not sent yet
+static const size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+// Bytes read from a connection at once
+static const size_t READ_CHUNK = 16 * 1024;
+// Data of one chunk of a streamed body
+static const size_t STREAM_CHUNK = 64 * 1024;
+
+struct HTTPServer::Connection
+{
+    Connection() : inputStart(0), outputStart(0), stream(NULL), fileFd(-1), fileOffset(0),
+        fileSize(0), closeAfterWrite(false), peerClosed(false), events(EPOLLIN)
+    {
+    }
+
+    ~Connection()
+    {
+        EndStream();
+    }
+
+    void EndStream()
+    {
+        delete stream;
+        stream = NULL;
+        if (fileFd >= 0)
+        {
+            close(fileFd);
+            fileFd = -1;
+        }
+    }
+
+    bool HasPendingOutput() const
+    {
+        return outputStart < output.size() || stream != NULL;
+    }
+
+    // Requests wait for the output to be sent, and so does reading more of them
+    bool IsOutputBackedUp() const
+    {
+        return stream != NULL || output.size() - outputStart >= MAX_PENDING_OUTPUT;
+    }
+
+    Socket sock;
+    SocketAddress peer;
+    // Received data, requests are parsed in place from inputStart
+    std::string input;
+    size_t inputStart;
+    // Parses the request at inputStart, across reads
+    HTTPRequestParser parser;
+    // Responses not sent yet, from outputStart
+    std::string output;
+    size_t outputStart;
+    // Response whose body is being streamed, after output; requests wait meanwhile
+    HTTPMessage* stream;
+    // Its file body, sent from fileOffset
+    int fileFd;
+    Int64 fileOffset;
+    Int64 fileSize;
+    // No more requests are read once the buffered responses are sent
+    bool closeAfterWrite;
+    // Peer has shut down its side, the requests it sent are still answered
+    bool peerClosed;
+    // Events registered with epoll
+    UInt32 events;
+    Timestamp lastActive;
+};
+
+struct HTTPServer::EventLoop
+{
+    HTTPServer* server;
+    int epollFd;
+    int wakeFd;
+    pthread_t thread;
+    bool started;
+    std::map<int, Connection*> connections;
+};
+
+// HTTPServerRequest
+HTTPServerRequest::HTTPServerRequest() : mData(NULL), mParser(NULL), mPeerAddress(NULL)
+{
+}
+
+// HTTPServerHandler
+HTTPServerHandler::HTTPServerHandler()
+{
+    // No allowed method, by default
+}
+
+HTTPServerHandler::~HTTPServerHandler()
+{
+}
+
+void HTTPServerHandler::handle_GET(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::handle_POST(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::handle_PUT(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::handle_DELETE(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::handle_HEAD(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::handle_TRACE(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::handle_OPTIONS(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::handle_CONNECT(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+}
+
+void HTTPServerHandler::AddAllowedMethod(const std::string& method)
+{
+    mAllowedMethod.push_back(method);
+}
+
+void HTTPServerHandler::DeleteAllowedMethod(const std::string& method)
+{
+    mAllowedMethod.remove(method);
+}
+
+const std::list<std::string>& HTTPServerHandler::GetAllowedMethods() const
+{
+    return mAllowedMethod;
+}
+
+bool HTTPServerHandler::IsAllowed(const HTTPStringView& method) const
+{
+    for (std::list<std::string>::const_iterator citer = mAllowedMethod.begin();
+            citer != mAllowedMethod.end(); ++citer)
+    {
+        if (method.length == citer->size() &&
+                memcmp(method.data, citer->data(), method.length) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HTTPServerHandler::AddStaticHeader(const std::string& key, const std::string& value)
+{
+    return mStaticHeaders.AddHeader(key, value);
+}
+
+// HTTPServer
+HTTPServer::HTTPServer(const SocketAddress& address, int threads) :
+    mAddress(address), mThreadCount(threads), mListener(SOCK_STREAM),
+    mKeepAliveTimeout(60, 0), mMaxConnections(10000),
+    mMaxHeaderSize(8 * 1024), mMaxBodySize(1024 * 1024), mCompression(false),
+    mCompressionCache(NULL), mRunning(false)
+{
+    if (mThreadCount <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        mThreadCount = cpus > 0 ? int(cpus) : 1;
+    }
+}
+
+HTTPServer::~HTTPServer()
+{
+    Stop();
+}
+
+bool HTTPServer::AddEndPoint(const std::string& path, const HTTPServerHandler& handler,
+        bool family)
+{
+    if (mRunning || mRoutes.find(path) != mRoutes.end())
+    {
+        return false;
+    }
+
+    Route route;
+    route.handler = &handler;
+    route.family = family;
+    mRoutes[path] = route;
+    return true;
+}
+
+bool HTTPServer::Start(int backlog)
+{
+    if (mRunning)
+    {
+        return false;
+    }
+
+    if (mListener.Bind(mAddress, true) != ErrorOK ||
+            mListener.Listen(backlog) != ErrorOK)
+    {
+        LOG(LogError, "Failed to listen on: %s", mAddress.ToString().c_str());
+        mListener.Close();
+        return false;
+    }
+    mListener.SetBlocking(false);
+
+    mRunning = true;
+    for (int i = 0; i < mThreadCount; i++)
+    {
+        EventLoop* loop = new EventLoop;
+        loop->server = this;
+        loop->started = false;
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        mLoops.push_back(loop);
+        if (loop->epollFd < 0 || loop->wakeFd < 0)
+        {
+            LOG(LogError, "Failed to create event loop: %d", errno);
+            Stop();
+            return false;
+        }
+
+        // The listener is shared by all loops, only one of them is woken per connection
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = NULL;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, mListener.Sockfd(), &ev);
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = loop;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &ev);
+
+        if (pthread_create(&loop->thread, NULL, EventThreadProc, loop) != 0)
+        {
+            LOG(LogError, "Failed to start HTTP server thread");
+            Stop();
+            return false;
+        }
+        loop->started = true;
+    }
+
+    return true;
+}
+
+void HTTPServer::Stop()
+{
+    if (!mRunning)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < mLoops.size(); i++)
+    {
+        if (mLoops[i]->wakeFd >= 0)
+        {
+            UInt64 one = 1;
+            ssize_t rc = write(mLoops[i]->wakeFd, &one, sizeof(one));
+            (void)rc;
+        }
+    }
+
+    for (size_t i = 0; i < mLoops.size(); i++)
+    {
+        EventLoop* loop = mLoops[i];
+        if (loop->started)
+        {
+            pthread_join(loop->thread, NULL);
+        }
+        if (loop->epollFd >= 0)
+        {
+            close(loop->epollFd);
+        }
+        if (loop->wakeFd >= 0)
+        {
+            close(loop->wakeFd);
+        }
+        delete loop;
+    }
+    mLoops.clear();
+
+    mListener.Close();
+    mRunning = false;
+}
+
+void* HTTPServer::EventThreadProc(void* param)
+{
+    EventLoop* loop = static_cast<EventLoop*>(param);
+    loop->server->Run(loop);
+    return NULL;
+}
+
+void HTTPServer::Run(EventLoop* loop)
+{
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    Timestamp lastIdleCheck;
+    bool stopping = false;
+
+    while (!stopping)
+    {
+        int n = epoll_wait(loop->epollFd, events, MAX_EVENTS, 1000);
+        if (n < 0 && errno != EINTR)
+        {
+            LOG(LogError, "epoll_wait failed: %d", errno);
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            void* ptr = events[i].data.ptr;
+            if (ptr == NULL)
+            {
+                AcceptConnections(loop);
+                continue;
+            }
+            if (ptr == loop)
+            {
+                stopping = true;
+                continue;
+            }
+
+            Connection* conn = static_cast<Connection*>(ptr);
+            UInt32 ev = events[i].events;
+            bool alive = true;
+            if (ev & EPOLLIN)
+            {
+                alive = ReadInput(conn);
+                if (alive)
+                {
+                    ProcessInput(conn);
+                }
+            }
+            else if (ev & (EPOLLERR | EPOLLHUP))
+            {
+                alive = false;
+            }
+
+            if (alive && conn->HasPendingOutput())
+            {
+                alive = WriteOutput(conn);
+                // Requests held back by pending output can go on, while the socket takes the responses
+                while (alive && !conn->HasPendingOutput() && conn->inputStart < conn->input.size())
+                {
+                    size_t inputStart = conn->inputStart;
+                    ProcessInput(conn);
+                    if (conn->inputStart == inputStart)
+                    {
+                        // The next request is not complete
+                        break;
+                    }
+                    alive = WriteOutput(conn);
+                }
+            }
+
+            // Held back requests are all answered by now unless output is pending,
+            // so a connection shut down by the peer is done once its output is sent
+            if (!alive || ((conn->closeAfterWrite || conn->peerClosed) && !conn->HasPendingOutput()))
+            {
+                CloseConnection(loop, conn);
+            }
+            else
+            {
+                UpdateEvents(loop, conn);
+            }
+        }
+
+        if (lastIdleCheck.IsElapsed(1000000))
+        {
+            lastIdleCheck.Update();
+            CloseIdleConnections(loop);
+        }
+    }
+
+    while (!loop->connections.empty())
+    {
+        CloseConnection(loop, loop->connections.begin()->second);
+    }
+}
+
+void HTTPServer::AcceptConnections(EventLoop* loop)
+{
+    // Bounded, so that one loop does not take a whole burst of connections
+    for (int i = 0; i < 64; i++)
+    {
+        char buffer[SocketAddress::MAX_ADDRESS_LENGTH];
+        sockaddr* pSA = reinterpret_cast<sockaddr*>(buffer);
+        SOCKET_LENGTH_t saLen = sizeof(buffer);
+        int fd = accept4(mListener.Sockfd(), pSA, &saLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG(LogError, "Failed to accept connection: %d", errno);
+            }
+            return;
+        }
+
+        if (mConnectionCount.Value() >= mMaxConnections)
+        {
+            LOG(LogError, "Too many connections, refuse a new one");
+            close(fd);
+            continue;
+        }
+
+        Connection* conn = new Connection;
+        conn->sock.Attach(fd);
+        conn->parser.SetLimits(mMaxHeaderSize, mMaxBodySize);
+        bool hasError = false;
+        conn->peer = SocketAddress(pSA, saLen, hasError);
+        if (pSA->sa_family != AF_UNIX)
+        {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            delete conn;
+            continue;
+        }
+
+        loop->connections[fd] = conn;
+        mConnectionCount++;
+    }
+}
+
+void HTTPServer::CloseConnection(EventLoop* loop, Connection* conn)
+{
+    int fd = conn->sock.Sockfd();
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, fd, NULL);
+    loop->connections.erase(fd);
+    // Closes the socket
+    delete conn;
+    mConnectionCount--;
+}
+
+void HTTPServer::CloseIdleConnections(EventLoop* loop)
+{
+    Int64 timeout = mKeepAliveTimeout.GetTotalMicroseconds();
+    std::map<int, Connection*>::iterator iter = loop->connections.begin();
+    while (iter != loop->connections.end())
+    {
+        Connection* conn = iter->second;
+        ++iter;
+        if (conn->lastActive.IsElapsed(timeout))
+        {
+            CloseConnection(loop, conn);
+        }
+    }
+}
+
+bool HTTPServer::ReadInput(Connection* conn)
+{
+    // Drop the requests already answered
+    if (conn->inputStart > 0)
+    {
+        conn->input.erase(0, conn->inputStart);
+        conn->inputStart = 0;
+    }
+
+    char buffer[READ_CHUNK];
+    ssize_t rc;
+    do
+    {
+        rc = recv(conn->sock.Sockfd(), buffer, sizeof(buffer), 0);
+    }
+    while (rc < 0 && errno == EINTR);
+
+    if (rc < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (rc == 0)
+    {
+        // Peer has shut down, answer the requests buffered then close
+        conn->peerClosed = true;
+        return conn->HasPendingOutput() || conn->inputStart < conn->input.size();
+    }
+
+    conn->lastActive.Update();
+    if (!conn->closeAfterWrite && !conn->peerClosed)
+    {
+        conn->input.append(buffer, rc);
+    }
+
+    // The parser bounds a request, this bounds what is buffered behind held back ones
+    if (conn->input.size() - conn->inputStart > mMaxHeaderSize + mMaxBodySize + READ_CHUNK)
+    {
+        LOG(LogWarning, "Too much input buffered from %s, closing", conn->peer.ToString().c_str());
+        return false;
+    }
+    return true;
+}
+
+void HTTPServer::ProcessInput(Connection* conn)
+{
+    // Pipelined requests are answered in order, as long as output does not pile up
+    while (conn->inputStart < conn->input.size() && conn->stream == NULL &&
+            conn->output.size() - conn->outputStart < MAX_PENDING_OUTPUT)
+    {
+        // Parsing resumes where the previous read stopped
+        char* data = &conn->input[conn->inputStart];
+        size_t length = conn->input.size() - conn->inputStart;
+        HTTPRequestParser& parser = conn->parser;
+        HTTPRequestParser::Result result = parser.Parse(data, length);
+        if (result == HTTPRequestParser::ResultIncomplete)
+        {
+            return;
+        }
+        if (result == HTTPRequestParser::ResultError)
+        {
+            int status = parser.GetErrorStatus();
+            AppendError(conn, status, status == 413 ? "Payload Too Large" :
+                    status == 431 ? "Request Header Fields Too Large" :
+                    status == 501 ? "Not Implemented" : "Bad Request");
+            conn->inputStart = conn->input.size();
+            return;
+        }
+
+        HTTPServerRequest req;
+        req.mPeerAddress = &conn->peer;
+        req.mData = data;
+        req.mParser = &parser;
+        req.mMethod = HTTPRequestParser::View(data, parser.GetMethod());
+        req.mTarget = HTTPRequestParser::View(data, parser.GetTarget());
+        req.mVersion = HTTPRequestParser::View(data, parser.GetVersion());
+        req.mBody = HTTPRequestParser::View(data, parser.GetBody());
+        const char* query = static_cast<const char*>(memchr(req.mTarget.data, '?', req.mTarget.length));
+        if (query != NULL)
+        {
+            req.mPath = HTTPStringView(req.mTarget.data, query - req.mTarget.data);
+            req.mQuery = HTTPStringView(query + 1, req.mTarget.data + req.mTarget.length - query - 1);
+        }
+        else
+        {
+            req.mPath = req.mTarget;
+        }
+
+        // HTTP/1.1 is persistent unless asked otherwise, HTTP/1.0 only if asked
+        HTTPStringView connection;
+        bool hasConnection = req.FindHeader("Connection", connection);
+        bool http10 = req.GetVersion().EqualsIgnoreCase("HTTP/1.0");
+        bool keepAlive = http10 ?
+                (hasConnection && connection.EqualsIgnoreCase("keep-alive")) :
+                !(hasConnection && connection.EqualsIgnoreCase("close"));
+
+        HTTPMessage resp(200, "OK");
+        HandleRequest(req, resp);
+        bool withBody = !req.GetMethod().EqualsIgnoreCase("HEAD");
+        if (resp.IsChunked() && http10)
+        {
+            // No chunked encoding before HTTP/1.1
+            if (!resp.BufferBody())
+            {
+                resp = HTTPMessage(500, "Internal Server Error");
+            }
+        }
+        HTTPStringView acceptEncoding;
+        if (mCompression && req.FindHeader("Accept-Encoding", acceptEncoding))
+        {
+            resp.Compress(HTTPCompressor::Negotiate(acceptEncoding), mCompressionCache);
+        }
+        if (withBody && !resp.GetBodyFile().empty())
+        {
+            conn->fileFd = open(resp.GetBodyFile().c_str(), O_RDONLY | O_CLOEXEC);
+            if (conn->fileFd < 0)
+            {
+                resp = HTTPMessage(500, "Internal Server Error");
+            }
+            conn->fileOffset = 0;
+            conn->fileSize = resp.GetBodyFileSize();
+        }
+        if (!keepAlive)
+        {
+            resp.AddHeader("Connection", "close");
+            conn->closeAfterWrite = true;
+        }
+        else if (http10)
+        {
+            resp.AddHeader("Connection", "keep-alive");
+        }
+        resp.AppendTo(conn->output, withBody);
+        if (withBody && (resp.IsChunked() || conn->fileFd >= 0))
+        {
+            // The body follows the headers, as the connection can take it
+            conn->stream = new HTTPMessage(resp);
+        }
+
+        conn->inputStart += parser.GetConsumed();
+        parser.Reset();
+        if (conn->closeAfterWrite)
+        {
+            conn->inputStart = conn->input.size();
+            return;
+        }
+    }
+}
+
+bool HTTPServer::WriteOutput(Connection* conn)
+{
+    while (true)
+    {
+        while (conn->outputStart < conn->output.size())
+        {
+            ssize_t rc = send(conn->sock.Sockfd(), conn->output.data() + conn->outputStart,
+                    conn->output.size() - conn->outputStart, MSG_NOSIGNAL);
+            if (rc < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            conn->outputStart += rc;
+        }
+
+        // All sent, reuse the buffer
+        conn->output.clear();
+        conn->outputStart = 0;
+        conn->lastActive.Update();
+        if (conn->stream == NULL)
+        {
+            return true;
+        }
+
+        // Go on with the streamed body
+        if (conn->fileFd >= 0)
+        {
+            while (conn->fileOffset < conn->fileSize)
+            {
+                off_t offset = conn->fileOffset;
+                ssize_t rc = sendfile(conn->sock.Sockfd(), conn->fileFd, &offset,
+                        size_t(conn->fileSize - conn->fileOffset));
+                if (rc < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                if (rc == 0)
+                {
+                    // The file has shrunk, the response can not be completed
+                    return false;
+                }
+                conn->fileOffset = offset;
+                conn->lastActive.Update();
+            }
+            conn->EndStream();
+            return true;
+        }
+
+        bool done = false;
+        if (!conn->stream->AppendChunk(conn->output, STREAM_CHUNK, done))
+        {
+            return false;
+        }
+        if (done)
+        {
+            conn->EndStream();
+        }
+    }
+}
+
+void HTTPServer::UpdateEvents(EventLoop* loop, Connection* conn)
+{
+    // Nothing more is read from a connection about to be closed, nor while its
+    // output is backed up; reading resumes once WriteOutput() has drained it
+    bool read = !conn->closeAfterWrite && !conn->peerClosed && !conn->IsOutputBackedUp();
+    UInt32 events = (read ? EPOLLIN : 0) |
+            (conn->HasPendingOutput() ? EPOLLOUT : 0);
+    if (events == conn->events)
+    {
+        return;
+    }
+
+    epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = conn;
+    epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, conn->sock.Sockfd(), &ev);
+    conn->events = events;
+}
+
+void HTTPServer::HandleRequest(const HTTPServerRequest& req, HTTPMessage& resp) const
+{
+    const HTTPServerHandler* handler = FindHandler(req.GetPath());
+    if (handler == NULL)
+    {
+        resp.SetResponse(404, "Not Found");
+        return;
+    }
+
+    const HTTPStringView& method = req.GetMethod();
+    if (!handler->IsAllowed(method))
+    {
+        std::string allow;
+        const std::list<std::string>& allowed = handler->GetAllowedMethods();
+        for (std::list<std::string>::const_iterator citer = allowed.begin();
+                citer != allowed.end(); ++citer)
+        {
+            if (!allow.empty())
+            {
+                allow += ", ";
+            }
+            allow += *citer;
+        }
+        resp.SetResponse(405, "Method Not Allowed");
+        resp.AddHeader("Allow", allow.empty() ? std::string("none") : allow);
+        return;
+    }
+
+    if (!handler->GetStaticHeaders().Empty())
+    {
+        resp.SetHeaderBlock(&handler->GetStaticHeaders());
+    }
+
+    if (method.EqualsIgnoreCase("GET"))
+    {
+        handler->handle_GET(req, resp);
+    }
+    else if (method.EqualsIgnoreCase("POST"))
+    {
+        handler->handle_POST(req, resp);
+    }
+    else if (method.EqualsIgnoreCase("PUT"))
+    {
+        handler->handle_PUT(req, resp);
+    }
+    else if (method.EqualsIgnoreCase("DELETE"))
+    {
+        handler->handle_DELETE(req, resp);
+    }
+    else if (method.EqualsIgnoreCase("HEAD"))
+    {
+        handler->handle_HEAD(req, resp);
+    }
+    else if (method.EqualsIgnoreCase("TRACE"))
+    {
+        handler->handle_TRACE(req, resp);
+    }
+    else if (method.EqualsIgnoreCase("OPTIONS"))
+    {
+        handler->handle_OPTIONS(req, resp);
+    }
+    else if (method.EqualsIgnoreCase("CONNECT"))
+    {
+        handler->handle_CONNECT(req, resp);
+    }
+    else
+    {
+        resp.SetResponse(501, "Not Implemented");
+    }
+}
+
+const HTTPServerHandler* HTTPServer::FindHandler(const HTTPStringView& path) const
+{
+    std::string key(path.data, path.length);
+    std::map<std::string, Route>::const_iterator iter = mRoutes.find(key);
+    if (iter != mRoutes.end())
+    {
+        return iter->second.handler;
+    }
+
+    // Walk up the path for a family end point
+    while (!key.empty())
+    {
+        std::string::size_type slash = key.rfind('/');
+        if (slash == std::string::npos)
+        {
+            break;
+        }
+        key.resize(slash);
+        iter = mRoutes.find(key.empty() ? std::string("/") : key);
+        if (iter != mRoutes.end() && iter->second.family)
+        {
+            return iter->second.handler;
+        }
+    }
+
+    return NULL;
+}
+
+void HTTPServer::AppendError(Connection* conn, int status, const std::string& reason)
+{
+    HTTPMessage resp(status, reason);
+    resp.AddHeader("Connection", "close");
+    resp.AppendTo(conn->output);
+    conn->closeAfterWrite = true;
+}
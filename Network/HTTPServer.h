@@ -0,0 +1,262 @@
+//////////////////////////////////////////////////////////////////////////
+// HTTPServer.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef HTTPServer_INCLUDED
+#define HTTPServer_INCLUDED
+
+#include <map>
+#include <list>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Types.h"
+#include "Socket.h"
+#include "SocketAddress.h"
+#include "Timespan.h"
+#include "AtomicCounter.h"
+#include "HTTPMessage.h"
+#include "HTTPHeaderParser.h"
+#include "HTTPRequestParser.h"
+
+// A request received by HTTPServer.
+// All views point into the receive buffer of the connection,
+// they are only valid while the handler runs.
+class HTTPServerRequest
+{
+public:
+    HTTPServerRequest();
+
+    const HTTPStringView& GetMethod() const
+    {
+        return mMethod;
+    }
+
+    // Request target as sent, path and query
+    const HTTPStringView& GetTarget() const
+    {
+        return mTarget;
+    }
+
+    // Path part of the target, without the query
+    const HTTPStringView& GetPath() const
+    {
+        return mPath;
+    }
+
+    // Query part of the target, without the '?'
+    const HTTPStringView& GetQuery() const
+    {
+        return mQuery;
+    }
+
+    const HTTPStringView& GetVersion() const
+    {
+        return mVersion;
+    }
+
+    int GetHeaderCount() const
+    {
+        return mParser->GetFieldCount();
+    }
+
+    HTTPHeaderField GetHeader(int index) const
+    {
+        HTTPHeaderField field;
+        field.name = HTTPRequestParser::View(mData, mParser->GetField(index).name);
+        field.value = HTTPRequestParser::View(mData, mParser->GetField(index).value);
+        return field;
+    }
+
+    // Gets the value of a header, ignoring case. Returns false if not present.
+    bool FindHeader(const char* name, HTTPStringView& value) const
+    {
+        const HTTPRequestParser::Span* span = mParser->Find(mData, name);
+        if (span == NULL)
+        {
+            return false;
+        }
+        value = HTTPRequestParser::View(mData, *span);
+        return true;
+    }
+
+    // Decoded if sent chunked
+    const HTTPStringView& GetBody() const
+    {
+        return mBody;
+    }
+
+    const SocketAddress& GetPeerAddress() const
+    {
+        return *mPeerAddress;
+    }
+
+private:
+    friend class HTTPServer;
+
+    HTTPStringView mMethod;
+    HTTPStringView mTarget;
+    HTTPStringView mPath;
+    HTTPStringView mQuery;
+    HTTPStringView mVersion;
+    HTTPStringView mBody;
+    // Start of the request, and its parse results
+    const char* mData;
+    const HTTPRequestParser* mParser;
+    const SocketAddress* mPeerAddress;
+};
+
+// Handles the requests of an end point of HTTPServer.
+// Shaped after EndPointHandler of RESTServer: one method per HTTP method,
+// and a list of allowed methods, others are answered with 405.
+// The response is filled in resp, which comes with 200 OK and no body.
+// Handlers are called from the event threads of the server, concurrently,
+// so they must be thread-safe and should not block.
+class HTTPServerHandler
+{
+public:
+    HTTPServerHandler();
+    virtual ~HTTPServerHandler();
+
+    // Override following handler method, if you want
+    virtual void handle_GET(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    virtual void handle_POST(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    virtual void handle_PUT(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    virtual void handle_DELETE(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    virtual void handle_HEAD(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    virtual void handle_TRACE(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    virtual void handle_OPTIONS(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    virtual void handle_CONNECT(const HTTPServerRequest& req, HTTPMessage& resp) const;
+
+    void AddAllowedMethod(const std::string& method);
+    void DeleteAllowedMethod(const std::string& method);
+    const std::list<std::string>& GetAllowedMethods() const;
+    bool IsAllowed(const HTTPStringView& method) const;
+
+    // Headers added to every response of the end point, e.g. Content-Type.
+    // They are formatted once, here, rather than for each response.
+    bool AddStaticHeader(const std::string& key, const std::string& value);
+    const HTTPHeaderBlock& GetStaticHeaders() const
+    {
+        return mStaticHeaders;
+    }
+
+private:
+    std::list<std::string> mAllowedMethod;
+    HTTPHeaderBlock mStaticHeaders;
+};
+
+// An HTTP/1.1 server built on Socket and epoll.
+// Connections are persistent (keep-alive) and pipelined requests are answered in order.
+// Several event threads share the listening socket, each one owns the connections
+// it accepted, so there is no lock on the request path.
+class HTTPServer
+{
+public:
+    // threads is the number of event threads, 0 means one per CPU.
+    HTTPServer(const SocketAddress& address, int threads = 0);
+    virtual ~HTTPServer();
+
+    // Registers the handler of a path.
+    // If family is true, the handler also serves all the paths below it
+    // (e.g. "/api" serves "/api/users"), the longest registered path wins.
+    // Must be called before Start().
+    bool AddEndPoint(const std::string& path, const HTTPServerHandler& handler,
+            bool family = false);
+
+    // Idle keep-alive connections are closed after this timeout. Default is 60 seconds.
+    void SetKeepAliveTimeout(const Timespan& timeout)
+    {
+        mKeepAliveTimeout = timeout;
+    }
+
+    // Connections beyond this limit are closed as soon as accepted. Default is 10000.
+    void SetMaxConnections(int maxConnections)
+    {
+        mMaxConnections = maxConnections;
+    }
+
+    // Requests with a larger request line and headers are answered with 431,
+    // larger bodies (also when chunked) with 413. Defaults are 8KB and 1MB.
+    void SetLimits(size_t maxHeaderSize, size_t maxBodySize)
+    {
+        mMaxHeaderSize = maxHeaderSize;
+        mMaxBodySize = maxBodySize;
+    }
+
+    // Compresses responses for the clients accepting gzip or deflate (Accept-Encoding).
+    // Bodies in memory go through cache if given, which suits static responses;
+    // the cache is not owned. Off by default.
+    void SetCompression(bool enable, HTTPCompressionCache* cache = NULL)
+    {
+        mCompression = enable;
+        mCompressionCache = cache;
+    }
+
+    // Binds, listens and starts the event threads.
+    bool Start(int backlog = 1024);
+
+    // Stops the event threads and closes all connections.
+    void Stop();
+
+    // Returns the number of open connections.
+    int GetConnectionCount() const
+    {
+        return mConnectionCount.Value();
+    }
+
+private:
+    struct Connection;
+    struct EventLoop;
+
+    static void* EventThreadProc(void* param);
+    void Run(EventLoop* loop);
+
+    void AcceptConnections(EventLoop* loop);
+    void CloseConnection(EventLoop* loop, Connection* conn);
+    void CloseIdleConnections(EventLoop* loop);
+
+    // Reads what is available, returns false if the connection must be closed
+    bool ReadInput(Connection* conn);
+    // Answers the complete requests buffered
+    void ProcessInput(Connection* conn);
+    // Writes buffered responses, returns false if the connection must be closed
+    bool WriteOutput(Connection* conn);
+    // Asks for write readiness while output is pending
+    void UpdateEvents(EventLoop* loop, Connection* conn);
+
+    void HandleRequest(const HTTPServerRequest& req, HTTPMessage& resp) const;
+    const HTTPServerHandler* FindHandler(const HTTPStringView& path) const;
+
+    void AppendError(Connection* conn, int status, const std::string& reason);
+
+private:
+    HTTPServer(const HTTPServer&);
+    HTTPServer& operator =(const HTTPServer&);
+
+private:
+    SocketAddress mAddress;
+    int mThreadCount;
+    Socket mListener;
+
+    struct Route
+    {
+        const HTTPServerHandler* handler;
+        bool family;
+    };
+    std::map<std::string, Route> mRoutes;
+
+    Timespan mKeepAliveTimeout;
+    int mMaxConnections;
+    size_t mMaxHeaderSize;
+    size_t mMaxBodySize;
+    bool mCompression;
+    HTTPCompressionCache* mCompressionCache;
+
+    std::vector<EventLoop*> mLoops;
+    AtomicCounter mConnectionCount;
+    bool mRunning;
+};
+
+#endif // HTTPServer_INCLUDED
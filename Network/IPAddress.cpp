@@ -4,509 +4,52 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "IPAddress.h"
-#include "NumberFormatter.h"
-#include "Types.h"
-#include "RefCountedObject.h"
-#include <algorithm>
 #include <cstring>
 #include <assert.h>
 
-// IPAddressImpl
-class IPAddressImpl: public RefCountedObject
+// Words of 16 bits of an IPv6 address, in host order
+static UInt16 GetWord(const in6_addr& addr, int index)
 {
-public:
-    virtual std::string ToString() const = 0;
-    virtual SOCKET_LENGTH_t GetLength() const = 0;
-    virtual const void* GetAddr() const = 0;
-    virtual IPAddress::IPFamily GetFamily() const = 0;
-    virtual int GetAddressFamily() const = 0;
-    virtual bool IsWildcard() const = 0;
-    virtual bool IsBroadcast() const = 0;
-    virtual bool IsLoopback() const = 0;
-    virtual bool IsMulticast() const = 0;
-    virtual bool IsLinkLocal() const = 0;
-    virtual bool IsSiteLocal() const = 0;
-    virtual bool IsIPv4Mapped() const = 0;
-    virtual bool IsIPv4Compatible() const = 0;
-    virtual bool IsWellKnownMC() const = 0;
-    virtual bool IsNodeLocalMC() const = 0;
-    virtual bool IsLinkLocalMC() const = 0;
-    virtual bool IsSiteLocalMC() const = 0;
-    virtual bool IsOrgLocalMC() const = 0;
-    virtual bool IsGlobalMC() const = 0;
-    virtual bool Mask(const IPAddressImpl* pMask, const IPAddressImpl* pSet) = 0;
-    virtual IPAddressImpl* Clone() const = 0;
-
-protected:
-    IPAddressImpl()
-    {
-    }
-
-    virtual ~IPAddressImpl()
-    {
-    }
-
-private:
-    IPAddressImpl(const IPAddressImpl&);
-    IPAddressImpl& operator =(const IPAddressImpl&);
-};
+    return UInt16((addr.s6_addr[index * 2] << 8) | addr.s6_addr[index * 2 + 1]);
+}
 
-class IPv4AddressImpl: public IPAddressImpl
+static bool ParseIPv4(const std::string& addr, in_addr& result)
 {
-public:
-    IPv4AddressImpl()
-    {
-        std::memset(&mAddr, 0, sizeof(mAddr));
-    }
-
-    IPv4AddressImpl(const void* addr)
-    {
-        std::memcpy(&mAddr, addr, sizeof(mAddr));
-    }
-
-    std::string ToString() const
-    {
-        const UInt8* bytes = reinterpret_cast<const UInt8*> (&mAddr);
-        std::string result;
-        result.reserve(16);
-        NumberFormatter::Append(result, bytes[0]);
-        result.append(".");
-        NumberFormatter::Append(result, bytes[1]);
-        result.append(".");
-        NumberFormatter::Append(result, bytes[2]);
-        result.append(".");
-        NumberFormatter::Append(result, bytes[3]);
-        return result;
-    }
-
-    SOCKET_LENGTH_t GetLength() const
-    {
-        return sizeof(mAddr);
-    }
-
-    const void* GetAddr() const
-    {
-        return &mAddr;
-    }
-
-    IPAddress::IPFamily GetFamily() const
-    {
-        return IPAddress::IPv4;
-    }
-
-    int GetAddressFamily() const
-    {
-        return AF_INET;
-    }
-
-    bool IsWildcard() const
-    {
-        return mAddr.s_addr == INADDR_ANY;
-    }
-
-    bool IsBroadcast() const
-    {
-        return mAddr.s_addr == INADDR_NONE;
-    }
-
-    bool IsLoopback() const
-    {
-        // 127.0.0.1
-        return ntohl(mAddr.s_addr) == 0x7F000001;
-    }
-
-    bool IsMulticast() const
-    {
-        // 224.0.0.0/24 to 239.0.0.0/24
-        return (ntohl(mAddr.s_addr) & 0xF0000000) == 0xE0000000;
-    }
-
-    bool IsLinkLocal() const
-    {
-        // 169.254.0.0/16
-        return (ntohl(mAddr.s_addr) & 0xFFFF0000) == 0xA9FE0000;
-    }
-
-    bool IsSiteLocal() const
-    {
-        UInt32 addr = ntohl(mAddr.s_addr);
-        return (addr & 0xFF000000) == 0x0A000000 || // 10.0.0.0/24
-                (addr & 0xFFFF0000) == 0xC0A80000 || // 192.68.0.0/16
-                (addr >= 0xAC100000 && addr <= 0xAC1FFFFF); // 172.16.0.0 to 172.31.255.255
-    }
-
-    bool IsIPv4Compatible() const
-    {
-        return true;
-    }
-
-    bool IsIPv4Mapped() const
-    {
-        return true;
-    }
-
-    bool IsWellKnownMC() const
-    {
-        // 224.0.0.0/8
-        return (ntohl(mAddr.s_addr) & 0xFFFFFF00) == 0xE0000000;
-    }
-
-    bool IsNodeLocalMC() const
-    {
-        return false;
-    }
-
-    bool IsLinkLocalMC() const
-    {
-        // 244.0.0.0/24
-        return (ntohl(mAddr.s_addr) & 0xFF000000) == 0xE0000000;
-    }
-
-    bool IsSiteLocalMC() const
-    {
-        // 239.255.0.0/16
-        return (ntohl(mAddr.s_addr) & 0xFFFF0000) == 0xEFFF0000;
-    }
-
-    bool IsOrgLocalMC() const
-    {
-        // 239.192.0.0/16
-        return (ntohl(mAddr.s_addr) & 0xFFFF0000) == 0xEFC00000;
-    }
-
-    bool IsGlobalMC() const
-    {
-        // 224.0.1.0 to 238.255.255.255
-        UInt32 addr = ntohl(mAddr.s_addr);
-        return addr >= 0xE0000100 && addr <= 0xEE000000;
-    }
-
-    static IPv4AddressImpl* Parse(const std::string& addr)
-    {
-        if (addr.empty())
-        {
-            return NULL;
-        }
-
-        in_addr ia;
-        if (inet_aton(addr.c_str(), &ia))
-        {
-            return new IPv4AddressImpl(&ia);
-        }
-        else
-        {
-            return NULL;
-        }
-    }
-
-    bool Mask(const IPAddressImpl* pMask, const IPAddressImpl* pSet)
-    {
-        mAddr.s_addr &= static_cast<const IPv4AddressImpl*>(pMask)->mAddr.s_addr;
-        mAddr.s_addr |= static_cast<const IPv4AddressImpl*>(pSet)->mAddr.s_addr
-                        & ~static_cast<const IPv4AddressImpl*>(pMask)->mAddr.s_addr;
-        return true;
-    }
-
-    IPAddressImpl* Clone() const
-    {
-        return new IPv4AddressImpl(&mAddr);
-    }
-
-private:
-    in_addr mAddr;
-};
+    return !addr.empty() && inet_aton(addr.c_str(), &result);
+}
 
-class IPv6AddressImpl: public IPAddressImpl
+static bool ParseIPv6(const std::string& addr, in6_addr& result, unsigned int& scope)
 {
-public:
-    IPv6AddressImpl()
-    {
-        mScope = 0;
-        std::memset(&mAddr, 0, sizeof(mAddr));
-    }
-
-    IPv6AddressImpl(const void* addr)
-    {
-        mScope = 0;
-        std::memcpy(&mAddr, addr, sizeof(mAddr));
-    }
-
-    IPv6AddressImpl(const void* addr, unsigned int scope)
-    {
-        mScope = scope;
-        std::memcpy(&mAddr, addr, sizeof(mAddr));
-    }
-
-    std::string ToString() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        if (IsIPv4Compatible() || IsIPv4Mapped())
-        {
-            std::string result;
-            result.reserve(24);
-            if (words[5] == 0)
-            {
-                result.append("::");
-            }
-            else
-            {
-                result.append("::FFFF:");
-            }
-
-            const UInt8* bytes = reinterpret_cast<const UInt8*>(&mAddr);
-            NumberFormatter::Append(result, bytes[12]);
-            result.append(".");
-            NumberFormatter::Append(result, bytes[13]);
-            result.append(".");
-            NumberFormatter::Append(result, bytes[14]);
-            result.append(".");
-            NumberFormatter::Append(result, bytes[15]);
-            return result;
-        }
-        else
-        {
-            std::string result;
-            result.reserve(46);
-            bool zeroSequence = false;
-            int i = 0;
-            while (i < 8)
-            {
-                if (!zeroSequence && words[i] == 0)
-                {
-                    int zi = i;
-                    while (zi < 8 && words[zi] == 0)
-                    {
-                        ++zi;
-                    }
-
-                    if (zi > i + 1)
-                    {
-                        i = zi;
-                        result.append(":");
-                        zeroSequence = true;
-                    }
-                }
-                if (i > 0)
-                {
-                    result.append(":");
-                }
-                if (i < 8)
-                {
-                    NumberFormatter::AppendHex(result, ntohs(words[i++]));
-                }
-            }
-            if (mScope > 0)
-            {
-                result.append("%");
-                char buffer[IFNAMSIZ];
-                if (if_indextoname(mScope, buffer))
-                {
-                    result.append(buffer);
-                }
-                else
-                {
-                    NumberFormatter::Append(result, mScope);
-                }
-            }
-            return result;
-        }
-    }
-
-    SOCKET_LENGTH_t GetLength() const
-    {
-        return sizeof(mAddr);
-    }
-
-    const void* GetAddr() const
-    {
-        return &mAddr;
-    }
-
-    IPAddress::IPFamily GetFamily() const
-    {
-        return IPAddress::IPv6;
-    }
-
-    int GetAddressFamily() const
-    {
-        return AF_INET6;
-    }
-
-    unsigned int GetScope() const
-    {
-        return mScope;
-    }
-
-    bool IsWildcard() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return words[0] == 0 && words[1] == 0 && words[2] == 0 && words[3] == 0
-                && words[4] == 0 && words[5] == 0 && words[6] == 0 && words[7]
-                == 0;
-    }
-
-    bool IsBroadcast() const
+    if (addr.empty())
     {
         return false;
     }
 
-    bool IsLoopback() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return words[0] == 0 && words[1] == 0 && words[2] == 0 && words[3] == 0
-                && words[4] == 0 && words[5] == 0 && words[6] == 0 && words[7]
-                == 1;
-    }
-
-    bool IsMulticast() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFE0) == 0xFF00;
-    }
-
-    bool IsLinkLocal() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFE0) == 0xFE80;
-    }
-
-    bool IsSiteLocal() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFE0) == 0xFEC0;
-    }
-
-    bool IsIPv4Compatible() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return words[0] == 0 && words[1] == 0 && words[2] == 0 && words[3] == 0
-                && words[4] == 0 && words[5] == 0;
-    }
-
-    bool IsIPv4Mapped() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return words[0] == 0 && words[1] == 0 && words[2] == 0 && words[3] == 0
-                && words[4] == 0 && words[5] == 0xFFFF;
-    }
-
-    bool IsWellKnownMC() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFF0) == 0xFF00;
-    }
-
-    bool IsNodeLocalMC() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFEF) == 0xFF01;
-    }
-
-    bool IsLinkLocalMC() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFEF) == 0xFF02;
-    }
-
-    bool IsSiteLocalMC() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFEF) == 0xFF05;
-    }
-
-    bool IsOrgLocalMC() const
-    {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFEF) == 0xFF08;
-    }
-
-    bool IsGlobalMC() const
+    scope = 0;
+    std::string::size_type pos = addr.find('%');
+    if (std::string::npos != pos)
     {
-        const UInt16* words = reinterpret_cast<const UInt16*>(&mAddr);
-        return (words[0] & 0xFFEF) == 0xFF0F;
-    }
-
-    static IPv6AddressImpl* Parse(const std::string& addr)
-    {
-        if (addr.empty())
-        {
-            return NULL;
-        }
-
-        in6_addr ia;
-        std::string::size_type pos = addr.find('%');
-        if (std::string::npos != pos)
-        {
-            std::string::size_type start = ('[' == addr[0]) ? 1 : 0;
-            std::string unscopedAddr(addr, start, pos - start);
-            std::string scope(addr, pos + 1, addr.size() - start - pos);
-            unsigned int scopeId(0);
-            if (!(scopeId = if_nametoindex(scope.c_str())))
-            {
-                return NULL;
-            }
-
-            if (inet_pton(AF_INET6, unscopedAddr.c_str(), &ia) == 1)
-            {
-                return new IPv6AddressImpl(&ia, scopeId);
-            }
-            else
-            {
-                return NULL;
-            }
-        }
-        else
+        std::string::size_type start = ('[' == addr[0]) ? 1 : 0;
+        std::string unscopedAddr(addr, start, pos - start);
+        std::string scopeName(addr, pos + 1, addr.size() - start - pos);
+        if (!(scope = if_nametoindex(scopeName.c_str())))
         {
-            if (inet_pton(AF_INET6, addr.c_str(), &ia) == 1)
-            {
-                return new IPv6AddressImpl(&ia);
-            }
-            else
-            {
-                return NULL;
-            }
+            return false;
         }
+        return inet_pton(AF_INET6, unscopedAddr.c_str(), &result) == 1;
     }
-
-    bool Mask(const IPAddressImpl* pMask, const IPAddressImpl* pSet)
-    {
-        return false;
-    }
-
-    IPAddressImpl* Clone() const
-    {
-        return new IPv6AddressImpl(&mAddr, mScope);
-    }
-
-private:
-    in6_addr mAddr;
-    unsigned int mScope;
-};
-
-// IPAddress
-IPAddress::IPAddress() :
-    mImpl(new IPv4AddressImpl)
-{
+    return inet_pton(AF_INET6, addr.c_str(), &result) == 1;
 }
 
-IPAddress::IPAddress(const IPAddress& addr) :
-    mImpl(addr.mImpl)
+IPAddress::IPAddress()
 {
-    mImpl->Duplicate();
+    Init(IPv4, NULL, 0);
 }
 
-IPAddress::IPAddress(IPFamily family) :
-    mImpl(0)
+IPAddress::IPAddress(IPFamily family)
 {
-    if (family == IPv4)
-    {
-        mImpl = new IPv4AddressImpl();
-    }
-    else if (family == IPv6)
-    {
-        mImpl = new IPv6AddressImpl();
-    }
-    else
+    Init(family == IPv6 ? IPv6 : IPv4, NULL, 0);
+    if (family != IPv4 && family != IPv6)
     {
         assert("Invalid address family");
     }
@@ -514,31 +57,36 @@ IPAddress::IPAddress(IPFamily family) :
 
 IPAddress::IPAddress(const std::string& addr, bool& hasError)
 {
-    hasError = false;
-    mImpl = IPv4AddressImpl::Parse(addr);
-    if (!mImpl)
+    Init(IPv4, NULL, 0);
+    hasError = !Parse(addr, *this);
+    if (hasError)
     {
-        mImpl = IPv6AddressImpl::Parse(addr);
-    }
-
-    if (!mImpl)
-    {
-        hasError = true;
         assert("Invalid address");
     }
 }
 
-IPAddress::IPAddress(const std::string& addr, IPFamily family, bool& hasError) :
-    mImpl(0)
+IPAddress::IPAddress(const std::string& addr, IPFamily family, bool& hasError)
 {
+    Init(IPv4, NULL, 0);
     hasError = false;
     if (family == IPv4)
     {
-        mImpl = IPv4AddressImpl::Parse(addr);
+        in_addr ia;
+        hasError = !ParseIPv4(addr, ia);
+        if (!hasError)
+        {
+            Init(IPv4, &ia, 0);
+        }
     }
     else if (family == IPv6)
     {
-        mImpl = IPv6AddressImpl::Parse(addr);
+        in6_addr ia;
+        unsigned int scope;
+        hasError = !ParseIPv6(addr, ia, scope);
+        if (!hasError)
+        {
+            Init(IPv6, &ia, scope);
+        }
     }
     else
     {
@@ -546,23 +94,23 @@ IPAddress::IPAddress(const std::string& addr, IPFamily family, bool& hasError) :
         assert("Invalid address family");
     }
 
-    if (!mImpl)
+    if (hasError)
     {
-        hasError = true;
         assert("Invalid address");
     }
 }
 
 IPAddress::IPAddress(const void* addr, SOCKET_LENGTH_t Length, bool& hasError)
 {
+    Init(IPv4, NULL, 0);
     hasError = false;
     if (Length == sizeof(struct in_addr))
     {
-        mImpl = new IPv4AddressImpl(addr);
+        Init(IPv4, addr, 0);
     }
     else if (Length == sizeof(struct in6_addr))
     {
-        mImpl = new IPv6AddressImpl(addr);
+        Init(IPv6, addr, 0);
     }
     else
     {
@@ -574,14 +122,15 @@ IPAddress::IPAddress(const void* addr, SOCKET_LENGTH_t Length, bool& hasError)
 IPAddress::IPAddress(const void* addr, SOCKET_LENGTH_t length,
         unsigned int scope, bool& hasError)
 {
+    Init(IPv4, NULL, 0);
     hasError = false;
     if (length == sizeof(in_addr))
     {
-        mImpl = new IPv4AddressImpl(addr);
+        Init(IPv4, addr, 0);
     }
     else if (length == sizeof(in6_addr))
     {
-        mImpl = new IPv6AddressImpl(addr, scope);
+        Init(IPv6, addr, scope);
     }
     else
     {
@@ -590,50 +139,182 @@ IPAddress::IPAddress(const void* addr, SOCKET_LENGTH_t length,
     }
 }
 
-IPAddress::~IPAddress()
+void IPAddress::Init(IPFamily family, const void* addr, unsigned int scope)
 {
-    mImpl->Release();
+    std::memset(&mAddr, 0, sizeof(mAddr));
+    if (addr != NULL)
+    {
+        std::memcpy(&mAddr, addr, family == IPv4 ? sizeof(in_addr) : sizeof(in6_addr));
+    }
+    mFamily = family;
+    mScope = family == IPv6 ? scope : 0;
 }
 
-IPAddress& IPAddress::operator =(const IPAddress& addr)
+std::string IPAddress::ToString() const
 {
-    if (&addr != this)
+    char buffer[MAX_STRING_LENGTH];
+    return std::string(buffer, Format(buffer, sizeof(buffer)));
+}
+
+// Writes value in decimal at p, returns the end
+static char* FormatDecimal(char* p, unsigned int value)
+{
+    char digits[10];
+    int count = 0;
+    do
     {
-        mImpl->Release();
-        mImpl = addr.mImpl;
-        mImpl->Duplicate();
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
     }
-    return *this;
+    while (value != 0);
+    while (count > 0)
+    {
+        *p++ = digits[--count];
+    }
+    return p;
 }
 
-IPAddress::IPFamily IPAddress::GetFamily() const
+// Writes value in upper case hex without leading zeros at p, returns the end
+static char* FormatHex(char* p, unsigned int value)
 {
-    return mImpl->GetFamily();
+    static const char DIGITS[] = "0123456789ABCDEF";
+    int shift = 12;
+    while (shift > 0 && (value >> shift) == 0)
+    {
+        shift -= 4;
+    }
+    for (; shift >= 0; shift -= 4)
+    {
+        *p++ = DIGITS[(value >> shift) & 0xF];
+    }
+    return p;
 }
 
-std::string IPAddress::ToString() const
+static char* FormatDotted(char* p, const UInt8* bytes)
 {
-    return mImpl->ToString();
+    for (int i = 0; i < 4; i++)
+    {
+        if (i > 0)
+        {
+            *p++ = '.';
+        }
+        p = FormatDecimal(p, bytes[i]);
+    }
+    return p;
+}
+
+size_t IPAddress::Format(char* buffer, size_t size) const
+{
+    // Written to a local buffer large enough for any address, then copied
+    char text[MAX_STRING_LENGTH];
+    char* p = text;
+    const UInt8* bytes = mAddr.bytes;
+    if (mFamily == IPv4)
+    {
+        p = FormatDotted(p, bytes);
+    }
+    else if (IsIPv4Compatible() || IsIPv4Mapped())
+    {
+        if (GetWord(mAddr.v6, 5) == 0)
+        {
+            memcpy(p, "::", 2);
+            p += 2;
+        }
+        else
+        {
+            memcpy(p, "::FFFF:", 7);
+            p += 7;
+        }
+        p = FormatDotted(p, bytes + 12);
+    }
+    else
+    {
+        // The first run of more than one zero word is written "::"
+        bool zeroSequence = false;
+        int i = 0;
+        while (i < 8)
+        {
+            if (!zeroSequence && GetWord(mAddr.v6, i) == 0)
+            {
+                int zi = i;
+                while (zi < 8 && GetWord(mAddr.v6, zi) == 0)
+                {
+                    ++zi;
+                }
+
+                if (zi > i + 1)
+                {
+                    i = zi;
+                    *p++ = ':';
+                    zeroSequence = true;
+                }
+            }
+            if (i > 0)
+            {
+                *p++ = ':';
+            }
+            if (i < 8)
+            {
+                p = FormatHex(p, GetWord(mAddr.v6, i++));
+            }
+        }
+        if (mScope > 0)
+        {
+            *p++ = '%';
+            char name[IFNAMSIZ];
+            if (if_indextoname(mScope, name))
+            {
+                size_t length = strnlen(name, sizeof(name) - 1);
+                memcpy(p, name, length);
+                p += length;
+            }
+            else
+            {
+                p = FormatDecimal(p, mScope);
+            }
+        }
+    }
+
+    size_t length = p - text;
+    if (length >= size)
+    {
+        return 0;
+    }
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    return length;
 }
 
 bool IPAddress::IsWildcard() const
 {
-    return mImpl->IsWildcard();
+    // The bytes past an IPv4 address are zero
+    return (mAddr.words[0] | mAddr.words[1] | mAddr.words[2] | mAddr.words[3]) == 0;
 }
 
 bool IPAddress::IsBroadcast() const
 {
-    return mImpl->IsBroadcast();
+    return mFamily == IPv4 && mAddr.v4.s_addr == INADDR_NONE;
 }
 
 bool IPAddress::IsLoopback() const
 {
-    return mImpl->IsLoopback();
+    if (mFamily == IPv4)
+    {
+        // 127.0.0.1
+        return ntohl(mAddr.v4.s_addr) == 0x7F000001;
+    }
+    return mAddr.words[0] == 0 && mAddr.words[1] == 0 && mAddr.words[2] == 0
+            && ntohl(mAddr.words[3]) == 1;
 }
 
 bool IPAddress::IsMulticast() const
 {
-    return mImpl->IsMulticast();
+    if (mFamily == IPv4)
+    {
+        // 224.0.0.0/24 to 239.0.0.0/24
+        return (ntohl(mAddr.v4.s_addr) & 0xF0000000) == 0xE0000000;
+    }
+    return (GetWord(mAddr.v6, 0) & 0xFFE0) == 0xFF00;
 }
 
 bool IPAddress::IsUnicast() const
@@ -643,192 +324,287 @@ bool IPAddress::IsUnicast() const
 
 bool IPAddress::IsLinkLocal() const
 {
-    return mImpl->IsLinkLocal();
+    if (mFamily == IPv4)
+    {
+        // 169.254.0.0/16
+        return (ntohl(mAddr.v4.s_addr) & 0xFFFF0000) == 0xA9FE0000;
+    }
+    return (GetWord(mAddr.v6, 0) & 0xFFE0) == 0xFE80;
 }
 
 bool IPAddress::IsSiteLocal() const
 {
-    return mImpl->IsSiteLocal();
+    if (mFamily == IPv4)
+    {
+        UInt32 addr = ntohl(mAddr.v4.s_addr);
+        return (addr & 0xFF000000) == 0x0A000000 || // 10.0.0.0/24
+                (addr & 0xFFFF0000) == 0xC0A80000 || // 192.68.0.0/16
+                (addr >= 0xAC100000 && addr <= 0xAC1FFFFF); // 172.16.0.0 to 172.31.255.255
+    }
+    return (GetWord(mAddr.v6, 0) & 0xFFE0) == 0xFEC0;
 }
 
 bool IPAddress::IsIPv4Compatible() const
 {
-    return mImpl->IsIPv4Compatible();
+    return mFamily == IPv4 || (mAddr.words[0] == 0 && mAddr.words[1] == 0 && mAddr.words[2] == 0);
 }
 
 bool IPAddress::IsIPv4Mapped() const
 {
-    return mImpl->IsIPv4Mapped();
+    return mFamily == IPv4 || (mAddr.words[0] == 0 && mAddr.words[1] == 0
+            && ntohl(mAddr.words[2]) == 0x0000FFFF);
 }
 
 bool IPAddress::IsWellKnownMC() const
 {
-    return mImpl->IsWellKnownMC();
+    if (mFamily == IPv4)
+    {
+        // 224.0.0.0/8
+        return (ntohl(mAddr.v4.s_addr) & 0xFFFFFF00) == 0xE0000000;
+    }
+    return (GetWord(mAddr.v6, 0) & 0xFFF0) == 0xFF00;
 }
 
 bool IPAddress::IsNodeLocalMC() const
 {
-    return mImpl->IsNodeLocalMC();
+    return mFamily == IPv6 && (GetWord(mAddr.v6, 0) & 0xFFEF) == 0xFF01;
 }
 
 bool IPAddress::IsLinkLocalMC() const
 {
-    return mImpl->IsLinkLocalMC();
+    if (mFamily == IPv4)
+    {
+        // 244.0.0.0/24
+        return (ntohl(mAddr.v4.s_addr) & 0xFF000000) == 0xE0000000;
+    }
+    return (GetWord(mAddr.v6, 0) & 0xFFEF) == 0xFF02;
 }
 
 bool IPAddress::IsSiteLocalMC() const
 {
-    return mImpl->IsSiteLocalMC();
+    if (mFamily == IPv4)
+    {
+        // 239.255.0.0/16
+        return (ntohl(mAddr.v4.s_addr) & 0xFFFF0000) == 0xEFFF0000;
+    }
+    return (GetWord(mAddr.v6, 0) & 0xFFEF) == 0xFF05;
 }
 
 bool IPAddress::IsOrgLocalMC() const
 {
-    return mImpl->IsOrgLocalMC();
+    if (mFamily == IPv4)
+    {
+        // 239.192.0.0/16
+        return (ntohl(mAddr.v4.s_addr) & 0xFFFF0000) == 0xEFC00000;
+    }
+    return (GetWord(mAddr.v6, 0) & 0xFFEF) == 0xFF08;
 }
 
 bool IPAddress::IsGlobalMC() const
 {
-    return mImpl->IsGlobalMC();
-}
-
-bool IPAddress::operator ==(const IPAddress& a) const
-{
-    SOCKET_LENGTH_t l1 = GetLength();
-    SOCKET_LENGTH_t l2 = a.GetLength();
-    if (l1 == l2)
+    if (mFamily == IPv4)
     {
-        return std::memcmp(GetAddr(), a.GetAddr(), l1) == 0;
-    }
-    else
-    {
-        return false;
+        // 224.0.1.0 to 238.255.255.255
+        UInt32 addr = ntohl(mAddr.v4.s_addr);
+        return addr >= 0xE0000100 && addr <= 0xEE000000;
     }
+    return (GetWord(mAddr.v6, 0) & 0xFFEF) == 0xFF0F;
 }
 
-bool IPAddress::operator !=(const IPAddress& a) const
+bool IPAddress::Parse(const std::string& addr, IPAddress& result)
 {
-    SOCKET_LENGTH_t l1 = GetLength();
-    SOCKET_LENGTH_t l2 = a.GetLength();
-    if (l1 == l2)
-    {
-        return std::memcmp(GetAddr(), a.GetAddr(), l1) != 0;
-    }
-    else
+    if (Parse(addr.data(), addr.size(), result))
     {
         return true;
     }
-}
 
-bool IPAddress::operator <(const IPAddress& a) const
-{
-    SOCKET_LENGTH_t l1 = GetLength();
-    SOCKET_LENGTH_t l2 = a.GetLength();
-    if (l1 == l2)
+    in_addr ia;
+    if (ParseIPv4(addr, ia))
     {
-        return std::memcmp(GetAddr(), a.GetAddr(), l1) < 0;
+        result.Init(IPv4, &ia, 0);
+        return true;
     }
-    else
+
+    in6_addr ia6;
+    unsigned int scope;
+    if (ParseIPv6(addr, ia6, scope))
     {
-        return l1 < l2;
+        result.Init(IPv6, &ia6, scope);
+        return true;
     }
+    return false;
 }
 
-bool IPAddress::operator <=(const IPAddress& a) const
+// Parses a dotted decimal address from p, moving p past it.
+// Parts with leading zeros are refused, inet_aton() reads them as octal.
+static bool ParseDotted(const char*& p, const char* end, UInt8* bytes)
 {
-    SOCKET_LENGTH_t l1 = GetLength();
-    SOCKET_LENGTH_t l2 = a.GetLength();
-    if (l1 == l2)
-    {
-        return std::memcmp(GetAddr(), a.GetAddr(), l1) <= 0;
-    }
-    else
+    for (int i = 0; i < 4; i++)
     {
-        return l1 < l2;
-    }
-}
+        if (i > 0)
+        {
+            if (p == end || *p != '.')
+            {
+                return false;
+            }
+            p++;
+        }
 
-bool IPAddress::operator >(const IPAddress& a) const
+        const char* start = p;
+        unsigned int value = 0;
+        while (p < end && *p >= '0' && *p <= '9' && p - start < 3)
+        {
+            value = value * 10 + (*p++ - '0');
+        }
+        if (p == start || value > 255 || (*start == '0' && p - start > 1))
+        {
+            return false;
+        }
+        bytes[i] = UInt8(value);
+    }
+    return true;
+}
+
+// Value of each hex digit character, -1 for other characters
+static const signed char HEX_VALUES[256] =
+{
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+static bool ParseHexWords(const char* p, const char* end, UInt8* bytes)
 {
-    SOCKET_LENGTH_t l1 = GetLength();
-    SOCKET_LENGTH_t l2 = a.GetLength();
-    if (l1 == l2)
+    UInt16 words[8];
+    int count = 0;
+    // Index of the word "::" stands before, -1 if none
+    int gap = -1;
+    if (end - p >= 2 && p[0] == ':' && p[1] == ':')
     {
-        return std::memcmp(GetAddr(), a.GetAddr(), l1) > 0;
+        gap = 0;
+        p += 2;
     }
-    else
+
+    while (p < end)
     {
-        return l1 > l2;
+        const char* start = p;
+        unsigned int value = 0;
+        int digit;
+        while (p < end && p - start < 4 && (digit = HEX_VALUES[UInt8(*p)]) >= 0)
+        {
+            value = (value << 4) | digit;
+            p++;
+        }
+        if (p < end && *p == '.' && count <= 6)
+        {
+            // Dotted decimal tail, the last 32 bits
+            p = start;
+            UInt8 tail[4];
+            if (!ParseDotted(p, end, tail) || p != end)
+            {
+                return false;
+            }
+            words[count++] = UInt16((tail[0] << 8) | tail[1]);
+            words[count++] = UInt16((tail[2] << 8) | tail[3]);
+            break;
+        }
+        if (p == start || count == 8)
+        {
+            return false;
+        }
+        words[count++] = UInt16(value);
+
+        if (p == end)
+        {
+            break;
+        }
+        if (*p++ != ':')
+        {
+            return false;
+        }
+        if (p < end && *p == ':')
+        {
+            if (gap >= 0)
+            {
+                return false;
+            }
+            gap = count;
+            p++;
+        }
+        else if (p == end)
+        {
+            // Trailing single ':'
+            return false;
+        }
     }
-}
 
-bool IPAddress::operator >=(const IPAddress& a) const
-{
-    SOCKET_LENGTH_t l1 = GetLength();
-    SOCKET_LENGTH_t l2 = a.GetLength();
-    if (l1 == l2)
+    if (gap < 0 ? count != 8 : count > 7)
     {
-        return std::memcmp(GetAddr(), a.GetAddr(), l1) >= 0;
+        return false;
     }
-    else
+
+    // Words after the gap go to the end
+    int zeros = 8 - count;
+    for (int i = 0, w = 0; i < 8; i++)
     {
-        return l1 > l2;
+        UInt16 word = 0;
+        if (gap >= 0 && i >= gap && i < gap + zeros)
+        {
+            word = 0;
+        }
+        else
+        {
+            word = words[w++];
+        }
+        bytes[i * 2] = UInt8(word >> 8);
+        bytes[i * 2 + 1] = UInt8(word);
     }
+    return true;
 }
 
-SOCKET_LENGTH_t IPAddress::GetLength() const
-{
-    return mImpl->GetLength();
-}
-
-const void* IPAddress::GetAddr() const
-{
-    return mImpl->GetAddr();
-}
-
-int IPAddress::GetAddressFamily() const
-{
-    return mImpl->GetAddressFamily();
-}
-
-void IPAddress::Init(IPAddressImpl* pImpl)
-{
-    mImpl->Release();
-    mImpl = pImpl;
-}
-
-bool IPAddress::Parse(const std::string& addr, IPAddress& result)
+bool IPAddress::Parse(const char* text, size_t length, IPAddress& result)
 {
-    IPAddressImpl* pImpl = IPv4AddressImpl::Parse(addr);
-    if (!pImpl)
+    const char* end = text + length;
+    UInt8 bytes[16];
+    const char* p = text;
+    if (ParseDotted(p, end, bytes) && p == end)
     {
-        pImpl = IPv6AddressImpl::Parse(addr);
-    }
-
-    if (pImpl)
-    {
-        result.Init(pImpl);
+        result.Init(IPv4, bytes, 0);
         return true;
     }
-    else
+    if (memchr(text, ':', length) != NULL && ParseHexWords(text, end, bytes))
     {
-        return false;
+        result.Init(IPv6, bytes, 0);
+        return true;
     }
+    return false;
 }
 
 bool IPAddress::Mask(const IPAddress& Mask)
 {
-    IPAddressImpl* pClone = mImpl->Clone();
-    mImpl->Release();
-    mImpl = pClone;
-    IPAddress null;
-    return mImpl->Mask(Mask.mImpl, null.mImpl);
+    return this->Mask(Mask, IPAddress());
 }
 
 bool IPAddress::Mask(const IPAddress& Mask, const IPAddress& set)
 {
-    IPAddressImpl* pClone = mImpl->Clone();
-    mImpl->Release();
-    mImpl = pClone;
-    return mImpl->Mask(Mask.mImpl, set.mImpl);
+    if (mFamily != IPv4 || Mask.mFamily != IPv4 || set.mFamily != IPv4)
+    {
+        return false;
+    }
+    mAddr.v4.s_addr &= Mask.mAddr.v4.s_addr;
+    mAddr.v4.s_addr |= set.mAddr.v4.s_addr & ~Mask.mAddr.v4.s_addr;
+    return true;
 }
-
@@ -7,11 +7,13 @@
 #define IPAddress_INCLUDED
 
 #include <string>
+#include "Types.h"
 #include "SocketDefs.h"
 
 // This class represents an Internet (IP) host address.
 // The address can belong either to the IPv4 or the IPv6 address family.
-class IPAddressImpl;
+// It is a plain value held inline, 24 bytes whatever the family: creating,
+// copying and comparing addresses never allocates, and copies are byte copies.
 class IPAddress
 {
 public:
@@ -24,9 +26,6 @@ public:
     // Creates a wild card (zero) IPv4 IPAddress.
     IPAddress();
 
-    // Creates an IPAddress by copying another one.
-    IPAddress(const IPAddress& addr);
-
     // Creates a wild card (zero) IPAddress for the given address family.
     explicit IPAddress(IPFamily family);
 
@@ -49,14 +48,11 @@ public:
     IPAddress(const void* addr, SOCKET_LENGTH_t length, unsigned int scope,
             bool& hasError);
 
-    // Destroys the IPAddress.
-    ~IPAddress();
-
-    // Assigns an IPAddress.
-    IPAddress& operator =(const IPAddress& addr);
-
     // Returns the address family (IPv4 or IPv6) of the address.
-    IPFamily GetFamily() const;
+    IPFamily GetFamily() const
+    {
+        return mFamily;
+    }
 
     // Returns a string containing a representation of the address in presentation format.
     // For IPv4 addresses the result will be in dotted-decimal (d.d.d.d) notation.
@@ -156,21 +152,62 @@ public:
     // For IPv6, global multicast addresses are in the FFxF:x:x:x:x:x:x:x range.
     bool IsGlobalMC() const;
 
-    bool operator ==(const IPAddress& addr) const;
-    bool operator !=(const IPAddress& addr) const;
-    bool operator <(const IPAddress& addr) const;
-    bool operator <=(const IPAddress& addr) const;
-    bool operator >(const IPAddress& addr) const;
-    bool operator >=(const IPAddress& addr) const;
+    // Addresses compare as their bytes, IPv4 ones before IPv6 ones. The scope is ignored.
+    bool operator ==(const IPAddress& addr) const
+    {
+        return mFamily == addr.mFamily && mAddr.words[0] == addr.mAddr.words[0]
+                && mAddr.words[1] == addr.mAddr.words[1] && mAddr.words[2] == addr.mAddr.words[2]
+                && mAddr.words[3] == addr.mAddr.words[3];
+    }
+
+    bool operator !=(const IPAddress& addr) const
+    {
+        return !(*this == addr);
+    }
+
+    bool operator <(const IPAddress& addr) const
+    {
+        return Compare(addr) < 0;
+    }
+
+    bool operator <=(const IPAddress& addr) const
+    {
+        return Compare(addr) <= 0;
+    }
+
+    bool operator >(const IPAddress& addr) const
+    {
+        return Compare(addr) > 0;
+    }
+
+    bool operator >=(const IPAddress& addr) const
+    {
+        return Compare(addr) >= 0;
+    }
 
-    // Returns the Length in bytes of the internal socket address structure.	
-    SOCKET_LENGTH_t GetLength() const;
+    // Returns the Length in bytes of the internal socket address structure.
+    SOCKET_LENGTH_t GetLength() const
+    {
+        return mFamily == IPv4 ? sizeof(in_addr) : sizeof(in6_addr);
+    }
 
-    // Returns the internal address structure.
-    const void* GetAddr() const;
+    // Returns the internal address structure, a in_addr or a in6_addr.
+    const void* GetAddr() const
+    {
+        return &mAddr;
+    }
 
     // Returns the address family (AF_INET or AF_INET6) of the address.
-    int GetAddressFamily() const;
+    int GetAddressFamily() const
+    {
+        return mFamily == IPv4 ? AF_INET : AF_INET6;
+    }
+
+    // Returns the scope ID of an IPv6 address, 0 if none.
+    unsigned int GetScope() const
+    {
+        return mScope;
+    }
 
     // Masks the IP address using the given netmask, which is usually a IPv4 subnet Mask.
     // Only supported for IPv4 addresses. The new address is (address & Mask).
@@ -186,17 +223,58 @@ public:
     // Returns false and leaves result unchanged otherwise.
     static bool Parse(const std::string& addr, IPAddress& result);
 
+    // Parses an address in presentation format from the length chars of text,
+    // without allocating: dotted decimal IPv4, and hex IPv6 with an optional
+    // dotted decimal tail. Returns false for other forms the std::string version
+    // accepts through the libc parser, such as "10.1", octal parts or scopes.
+    static bool Parse(const char* text, size_t length, IPAddress& result);
+
+    // Writes the address as ToString() does, null terminated, to buffer, without allocating.
+    // Returns the length written, or 0 if size is too small; MAX_STRING_LENGTH is enough.
+    size_t Format(char* buffer, size_t size) const;
+
     // Maximum Length in bytes of a socket address.
     enum
     {
-        MAX_ADDRESS_LENGTH = sizeof(in6_addr) //sizeof(in_addr)
+        MAX_ADDRESS_LENGTH = sizeof(in6_addr), //sizeof(in_addr)
+        // Longest IPv6 address, '%', interface name and null
+        MAX_STRING_LENGTH = INET6_ADDRSTRLEN + 1 + IFNAMSIZ
     };
 
-protected:
-    void Init(IPAddressImpl* pImpl);
+private:
+    void Init(IPFamily family, const void* addr, unsigned int scope);
+
+    // Returns -1, 0 or 1 as this address is before, equal to or after addr
+    int Compare(const IPAddress& addr) const
+    {
+        if (mFamily != addr.mFamily)
+        {
+            return mFamily == IPv4 ? -1 : 1;
+        }
+        // Words are in network order, the first that differs decides
+        for (int i = 0; i < 4; i++)
+        {
+            if (mAddr.words[i] != addr.mAddr.words[i])
+            {
+                return ntohl(mAddr.words[i]) < ntohl(addr.mAddr.words[i]) ? -1 : 1;
+            }
+        }
+        return 0;
+    }
 
 private:
-    IPAddressImpl* mImpl;
+    // In network byte order. The bytes of an IPv4 address past the first 4 are zero.
+    union Storage
+    {
+        in_addr v4;
+        in6_addr v6;
+        UInt8 bytes[16];
+        UInt32 words[4];
+    };
+
+    Storage mAddr;
+    IPFamily mFamily;
+    unsigned int mScope;
 };
 
 #endif // IPAddress_INCLUDED
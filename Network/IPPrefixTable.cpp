@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////
+// IPPrefixTable.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "IPPrefixTable.h"
+#include "NumberParser.h"
+#include "NumberFormatter.h"
+#include "StringUtilities.h"
+#include "Log.h"
+#include <fstream>
+
+IPPrefix::IPPrefix(const IPAddress& address, int length) : family(address.GetFamily())
+{
+    int bits = family == IPAddress::IPv4 ? 32 : 128;
+    this->length = length < 0 ? 0 : (length > bits ? bits : length);
+    GetBits(address, high, low);
+
+    // Clear the bits past the prefix
+    if (this->length == 0)
+    {
+        high = 0;
+        low = 0;
+    }
+    else if (this->length <= 64)
+    {
+        high &= ~UInt64(0) << (64 - this->length);
+        low = 0;
+    }
+    else if (this->length < 128)
+    {
+        low &= ~UInt64(0) << (128 - this->length);
+    }
+}
+
+bool IPPrefix::Parse(const std::string& cidr, IPPrefix& prefix)
+{
+    std::string::size_type slash = cidr.find('/');
+    IPAddress address;
+    if (!IPAddress::Parse(cidr.substr(0, slash), address))
+    {
+        return false;
+    }
+
+    int length = address.GetFamily() == IPAddress::IPv4 ? 32 : 128;
+    if (slash != std::string::npos)
+    {
+        unsigned int value;
+        if (!NumberParser::ParseUnsignedInt(cidr.substr(slash + 1), value) || value > UInt32(length))
+        {
+            return false;
+        }
+        length = int(value);
+    }
+    prefix = IPPrefix(address, length);
+    return true;
+}
+
+bool IPPrefix::ReadFile(const std::string& path,
+        std::vector<std::pair<IPPrefix, std::string> >& rules)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        LOG(LogError, "Failed to open prefix file %s", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = StringUtilities::Trim(line, " \t\r");
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::string::size_type end = line.find_first_of(" \t");
+        IPPrefix prefix;
+        if (!Parse(line.substr(0, end), prefix))
+        {
+            LOG(LogError, "Invalid prefix at %s:%d", path.c_str(), lineNumber);
+            return false;
+        }
+        std::string value;
+        if (end != std::string::npos)
+        {
+            value = StringUtilities::Trim(line.substr(end), " \t");
+        }
+        rules.push_back(std::make_pair(prefix, value));
+    }
+    return true;
+}
+
+void IPPrefix::GetBits(const IPAddress& address, UInt64& high, UInt64& low)
+{
+    const UInt8* bytes = static_cast<const UInt8*>(address.GetAddr());
+    high = 0;
+    low = 0;
+    if (address.GetFamily() == IPAddress::IPv4)
+    {
+        high = UInt64(ntohl(*reinterpret_cast<const UInt32*>(bytes))) << 32;
+        return;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        high = (high << 8) | bytes[i];
+        low = (low << 8) | bytes[i + 8];
+    }
+}
+
+IPAddress IPPrefix::GetAddress() const
+{
+    bool hasError;
+    if (family == IPAddress::IPv4)
+    {
+        in_addr addr;
+        addr.s_addr = htonl(UInt32(high >> 32));
+        return IPAddress(&addr, sizeof(addr), hasError);
+    }
+
+    in6_addr addr;
+    for (int i = 0; i < 8; i++)
+    {
+        addr.s6_addr[i] = UInt8(high >> (56 - 8 * i));
+        addr.s6_addr[i + 8] = UInt8(low >> (56 - 8 * i));
+    }
+    return IPAddress(&addr, sizeof(addr), hasError);
+}
+
+std::string IPPrefix::ToString() const
+{
+    std::string result = GetAddress().ToString();
+    result += '/';
+    NumberFormatter::Append(result, length);
+    return result;
+}
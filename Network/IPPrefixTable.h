@@ -0,0 +1,442 @@
+//////////////////////////////////////////////////////////////////////////
+// IPPrefixTable.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef IPPrefixTable_INCLUDED
+#define IPPrefixTable_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+#include <pthread.h>
+#include "Types.h"
+#include "IPAddress.h"
+#include "CriticalSection.h"
+
+// An IPv4 or IPv6 network, as an address and a prefix length, e.g. 10.0.0.0/8.
+// The address bits past the prefix length are always zero.
+struct IPPrefix
+{
+    IPPrefix() : family(IPAddress::IPv4), length(0), high(0), low(0)
+    {
+    }
+
+    // Clears the address bits past length, which is capped to the address size.
+    IPPrefix(const IPAddress& address, int length);
+
+    // Parses "address/length"; an address alone is a host prefix (/32 or /128).
+    static bool Parse(const std::string& cidr, IPPrefix& prefix);
+
+    // Reads a file of a prefix per line, each optionally followed by a space or tab and
+    // the text of a value. Empty lines and lines starting with '#' are skipped.
+    // Returns false if the file can not be read or holds an invalid prefix.
+    static bool ReadFile(const std::string& path,
+            std::vector<std::pair<IPPrefix, std::string> >& rules);
+
+    // Returns the address bits of address, left aligned on 128 bits in host order
+    static void GetBits(const IPAddress& address, UInt64& high, UInt64& low);
+
+    IPAddress GetAddress() const;
+
+    std::string ToString() const;
+
+    bool operator <(const IPPrefix& other) const
+    {
+        if (family != other.family)
+        {
+            return family < other.family;
+        }
+        if (length != other.length)
+        {
+            return length < other.length;
+        }
+        return high != other.high ? high < other.high : low < other.low;
+    }
+
+    bool operator ==(const IPPrefix& other) const
+    {
+        return family == other.family && length == other.length && high == other.high
+                && low == other.low;
+    }
+
+    IPAddress::IPFamily family;
+    int length;
+    // Address bits, left aligned: an IPv4 address is in the top 32 bits of high
+    UInt64 high;
+    UInt64 low;
+};
+
+// Maps IPv4 and IPv6 networks to values, and finds the longest prefix matching an address.
+// Rules are changed with Insert()/Remove() and take effect on Commit(), which compiles
+// them into a multibit trie: 16 bits then 8 per level for IPv4, so an IPv4 lookup
+// reads at most 3 entries; 16 then 4 bits per level for IPv6, to keep tables small.
+// Lookups never block: Commit() swaps the new trie in atomically, and frees the
+// previous one once the lookups running on it are done. Readers announce themselves
+// on counters spread over cache lines, so that lookups from many threads do not contend.
+// All methods are thread-safe; writers are serialized.
+template<class T>
+class IPPrefixTable
+{
+public:
+    // Parses the value of a rule in a file, see Load()
+    typedef bool (*ValueParser)(const std::string& text, T& value);
+
+    IPPrefixTable();
+    ~IPPrefixTable();
+
+    // Adds a rule, or replaces the value of an existing one.
+    void Insert(const IPPrefix& prefix, const T& value);
+    bool Insert(const std::string& cidr, const T& value);
+
+    // Removes a rule, returns false if not found.
+    bool Remove(const IPPrefix& prefix);
+
+    void Clear();
+
+    // Number of rules, committed or not
+    size_t GetSize() const;
+
+    // Makes the rules changed since the last commit visible to lookups.
+    void Commit();
+
+    // Replaces all the rules with those of a file, see IPPrefix::ReadFile(), and commits them.
+    // Values are parsed by parser; without one every prefix gets T().
+    // On any invalid line, nothing changes.
+    bool Load(const std::string& path, ValueParser parser = NULL);
+
+    // Finds the value of the longest committed prefix matching address.
+    bool Lookup(const IPAddress& address, T& value) const;
+
+    // Same as above, with an IPv4 address in host order.
+    bool Lookup(UInt32 address, T& value) const;
+
+private:
+    enum
+    {
+        // Entries with this bit hold the position of a chunk of the next level;
+        // others hold 0 for no match, or the index of the value plus 1.
+        CHUNK = 0x80000000u,
+        FIRST_BITS = 16,
+        IPV4_BITS = 8,
+        IPV6_BITS = 4,
+        READER_SLOTS = 64
+    };
+
+    // A compiled trie of one family
+    struct Trie
+    {
+        Trie(int bits) : bits(bits)
+        {
+            entries.assign(size_t(1) << FIRST_BITS, 0);
+        }
+
+        // Bits per level past the first
+        int bits;
+        std::vector<UInt32> entries;
+    };
+
+    struct Snapshot
+    {
+        Snapshot() : ipv4(IPV4_BITS), ipv6(IPV6_BITS)
+        {
+        }
+
+        Trie ipv4;
+        Trie ipv6;
+        std::vector<T> values;
+    };
+
+    // Counters of the lookups running, by parity of the epoch they started in
+    struct ReaderSlot
+    {
+        volatile long counts[2];
+        char padding[64 - 2 * sizeof(long)];
+    };
+
+    // Builds the trie of the rules and swaps it in, with the lock held
+    void Publish();
+    static Snapshot* Build(const std::map<IPPrefix, T>& rules);
+    static void Paint(Trie& trie, const IPPrefix& prefix, UInt32 result);
+    static UInt32 Find(const Trie& trie, UInt64 high, UInt64 low);
+    static UInt32 GetBits(UInt64 high, UInt64 low, int offset, int count);
+
+    // Enters and leaves a read section, returns the counter entered
+    volatile long* BeginRead() const;
+    void EndRead(volatile long* counter) const
+    {
+        __sync_fetch_and_sub(counter, 1);
+    }
+
+private:
+    IPPrefixTable(const IPPrefixTable&);
+    IPPrefixTable& operator =(const IPPrefixTable&);
+
+private:
+    mutable CriticalSection mLock;
+    std::map<IPPrefix, T> mRules;
+
+    Snapshot* volatile mSnapshot;
+    volatile unsigned long mEpoch;
+    mutable ReaderSlot mReaders[READER_SLOTS];
+};
+
+template<class T>
+IPPrefixTable<T>::IPPrefixTable() : mSnapshot(new Snapshot), mEpoch(0)
+{
+    for (int i = 0; i < READER_SLOTS; i++)
+    {
+        mReaders[i].counts[0] = 0;
+        mReaders[i].counts[1] = 0;
+    }
+}
+
+template<class T>
+IPPrefixTable<T>::~IPPrefixTable()
+{
+    delete mSnapshot;
+}
+
+template<class T>
+void IPPrefixTable<T>::Insert(const IPPrefix& prefix, const T& value)
+{
+    AutoCriticalSection autoLock(&mLock);
+    mRules[prefix] = value;
+}
+
+template<class T>
+bool IPPrefixTable<T>::Insert(const std::string& cidr, const T& value)
+{
+    IPPrefix prefix;
+    if (!IPPrefix::Parse(cidr, prefix))
+    {
+        return false;
+    }
+    Insert(prefix, value);
+    return true;
+}
+
+template<class T>
+bool IPPrefixTable<T>::Remove(const IPPrefix& prefix)
+{
+    AutoCriticalSection autoLock(&mLock);
+    return mRules.erase(prefix) > 0;
+}
+
+template<class T>
+void IPPrefixTable<T>::Clear()
+{
+    AutoCriticalSection autoLock(&mLock);
+    mRules.clear();
+}
+
+template<class T>
+size_t IPPrefixTable<T>::GetSize() const
+{
+    AutoCriticalSection autoLock(&mLock);
+    return mRules.size();
+}
+
+template<class T>
+void IPPrefixTable<T>::Commit()
+{
+    AutoCriticalSection autoLock(&mLock);
+    Publish();
+}
+
+template<class T>
+void IPPrefixTable<T>::Publish()
+{
+    Snapshot* old = mSnapshot;
+    mSnapshot = Build(mRules);
+    __sync_synchronize();
+
+    // Lookups starting from now count in the other parity, and see the new trie.
+    // Wait for those counted in the previous one, which may still use the old trie.
+    unsigned long epoch = mEpoch;
+    mEpoch = epoch + 1;
+    __sync_synchronize();
+    for (int i = 0; i < READER_SLOTS; i++)
+    {
+        while (mReaders[i].counts[epoch & 1] != 0)
+        {
+            sched_yield();
+        }
+    }
+    delete old;
+}
+
+template<class T>
+bool IPPrefixTable<T>::Load(const std::string& path, ValueParser parser)
+{
+    std::vector<std::pair<IPPrefix, std::string> > lines;
+    if (!IPPrefix::ReadFile(path, lines))
+    {
+        return false;
+    }
+
+    std::map<IPPrefix, T> rules;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        T value = T();
+        if (parser != NULL && !parser(lines[i].second, value))
+        {
+            return false;
+        }
+        rules[lines[i].first] = value;
+    }
+
+    AutoCriticalSection autoLock(&mLock);
+    mRules.swap(rules);
+    Publish();
+    return true;
+}
+
+template<class T>
+bool IPPrefixTable<T>::Lookup(const IPAddress& address, T& value) const
+{
+    if (address.GetFamily() == IPAddress::IPv4)
+    {
+        return Lookup(UInt32(ntohl(static_cast<const in_addr*>(address.GetAddr())->s_addr)), value);
+    }
+
+    UInt64 high;
+    UInt64 low;
+    IPPrefix::GetBits(address, high, low);
+    volatile long* counter = BeginRead();
+    const Snapshot* snapshot = mSnapshot;
+    UInt32 result = Find(snapshot->ipv6, high, low);
+    if (result != 0)
+    {
+        value = snapshot->values[result - 1];
+    }
+    EndRead(counter);
+    return result != 0;
+}
+
+template<class T>
+bool IPPrefixTable<T>::Lookup(UInt32 address, T& value) const
+{
+    volatile long* counter = BeginRead();
+    const Snapshot* snapshot = mSnapshot;
+    const UInt32* entries = &snapshot->ipv4.entries[0];
+    UInt32 result = entries[address >> 16];
+    if (result & CHUNK)
+    {
+        result = entries[(result & ~CHUNK) + ((address >> 8) & 0xff)];
+        if (result & CHUNK)
+        {
+            result = entries[(result & ~CHUNK) + (address & 0xff)];
+        }
+    }
+    if (result != 0)
+    {
+        value = snapshot->values[result - 1];
+    }
+    EndRead(counter);
+    return result != 0;
+}
+
+template<class T>
+volatile long* IPPrefixTable<T>::BeginRead() const
+{
+    // Threads are spread over the slots by a hash of their ID
+    size_t slot = size_t((UInt64(pthread_self()) * 0x9E3779B97F4A7C15ull) >> 58) % READER_SLOTS;
+    while (true)
+    {
+        unsigned long epoch = mEpoch;
+        volatile long* counter = &mReaders[slot].counts[epoch & 1];
+        __sync_fetch_and_add(counter, 1);
+        // Counted before any commit that follows; otherwise a commit may have missed
+        // this counter, so count again in its epoch
+        if (mEpoch == epoch)
+        {
+            return counter;
+        }
+        __sync_fetch_and_sub(counter, 1);
+    }
+}
+
+template<class T>
+typename IPPrefixTable<T>::Snapshot* IPPrefixTable<T>::Build(const std::map<IPPrefix, T>& rules)
+{
+    Snapshot* snapshot = new Snapshot;
+    snapshot->values.reserve(rules.size());
+
+    // Shorter prefixes first, so longer ones paint over them
+    std::vector<std::pair<IPPrefix, UInt32> > ordered;
+    ordered.reserve(rules.size());
+    for (typename std::map<IPPrefix, T>::const_iterator iter = rules.begin();
+            iter != rules.end(); ++iter)
+    {
+        snapshot->values.push_back(iter->second);
+        ordered.push_back(std::make_pair(iter->first, UInt32(snapshot->values.size())));
+    }
+    // Rules are ordered by family, then by length
+    for (size_t i = 0; i < ordered.size(); i++)
+    {
+        const IPPrefix& prefix = ordered[i].first;
+        Paint(prefix.family == IPAddress::IPv4 ? snapshot->ipv4 : snapshot->ipv6, prefix,
+                ordered[i].second);
+    }
+    return snapshot;
+}
+
+template<class T>
+void IPPrefixTable<T>::Paint(Trie& trie, const IPPrefix& prefix, UInt32 result)
+{
+    size_t chunk = 0;
+    int offset = 0;
+    int bits = FIRST_BITS;
+    while (true)
+    {
+        UInt32 index = GetBits(prefix.high, prefix.low, offset, bits);
+        if (prefix.length <= offset + bits)
+        {
+            // The prefix covers a range of entries of this chunk
+            UInt32 span = UInt32(1) << (offset + bits - prefix.length);
+            std::fill(trie.entries.begin() + chunk + index, trie.entries.begin() + chunk + index + span,
+                    result);
+            return;
+        }
+
+        UInt32 entry = trie.entries[chunk + index];
+        if (!(entry & CHUNK))
+        {
+            // The new chunk inherits the match of the entry it replaces
+            size_t next = trie.entries.size();
+            trie.entries.resize(next + (size_t(1) << trie.bits), entry);
+            entry = UInt32(next) | CHUNK;
+            trie.entries[chunk + index] = entry;
+        }
+        chunk = entry & ~CHUNK;
+        offset += bits;
+        bits = trie.bits;
+    }
+}
+
+template<class T>
+UInt32 IPPrefixTable<T>::Find(const Trie& trie, UInt64 high, UInt64 low)
+{
+    const UInt32* entries = &trie.entries[0];
+    UInt32 result = entries[GetBits(high, low, 0, FIRST_BITS)];
+    int offset = FIRST_BITS;
+    while (result & CHUNK)
+    {
+        result = entries[(result & ~CHUNK) + GetBits(high, low, offset, trie.bits)];
+        offset += trie.bits;
+    }
+    return result;
+}
+
+template<class T>
+UInt32 IPPrefixTable<T>::GetBits(UInt64 high, UInt64 low, int offset, int count)
+{
+    // Levels never straddle the two halves, as 64 is a multiple of every stride
+    UInt64 half = offset < 64 ? high : low;
+    return UInt32((half << (offset & 63)) >> (64 - count));
+}
+
+#endif // IPPrefixTable_INCLUDED
@@ -4,6 +4,7 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "NetworkInterface.h"
+#include "NetworkInterfaceMonitor.h"
 #include "Socket.h"
 #include "Log.h"
 #include "NumberFormatter.h"
@@ -229,7 +230,13 @@ bool NetworkInterface::IsSupportsIPv6() const
 bool NetworkInterface::ForName(const std::string& name,
         bool requireIPv6, NetworkInterface& netIf)
 {
-    std::vector<NetworkInterface> ifs = List();
+    NetworkInterfaceMonitor* monitor = GetMonitor();
+    if (monitor)
+    {
+        return monitor->ForName(name, requireIPv6, netIf);
+    }
+
+    std::vector<NetworkInterface> ifs = Enumerate();
     for (std::vector<NetworkInterface>::const_iterator it = ifs.begin(); it
             != ifs.end(); ++it)
     {
@@ -246,7 +253,13 @@ bool NetworkInterface::ForName(const std::string& name,
 
 bool NetworkInterface::ForAddress(const IPAddress& addr, NetworkInterface& netIf)
 {
-    std::vector<NetworkInterface> ifs = List();
+    NetworkInterfaceMonitor* monitor = GetMonitor();
+    if (monitor)
+    {
+        return monitor->ForAddress(addr, netIf);
+    }
+
+    std::vector<NetworkInterface> ifs = Enumerate();
     for (std::vector<NetworkInterface>::const_iterator it = ifs.begin(); it
             != ifs.end(); ++it)
     {
@@ -267,7 +280,13 @@ bool NetworkInterface::ForIndex(int i, NetworkInterface& netIf)
         return false;
     }
 
-    std::vector<NetworkInterface> ifs = List();
+    NetworkInterfaceMonitor* monitor = GetMonitor();
+    if (monitor)
+    {
+        return monitor->ForIndex(i, netIf);
+    }
+
+    std::vector<NetworkInterface> ifs = Enumerate();
     for (std::vector<NetworkInterface>::const_iterator it = ifs.begin(); it
             != ifs.end(); ++it)
     {
@@ -281,8 +300,31 @@ bool NetworkInterface::ForIndex(int i, NetworkInterface& netIf)
     return false;
 }
 
-//////////////////////////////////////////////////////////////////////////
+NetworkInterfaceMonitor* NetworkInterface::GetMonitor()
+{
+    // Not retried once it failed, netlink is not available then
+    static volatile bool unavailable = false;
+    NetworkInterfaceMonitor& monitor = NetworkInterfaceMonitor::GetDefault();
+    if (monitor.IsRunning() || (!unavailable && monitor.Start()))
+    {
+        return &monitor;
+    }
+    unavailable = true;
+    return NULL;
+}
+
 std::vector<NetworkInterface> NetworkInterface::List()
+{
+    NetworkInterfaceMonitor* monitor = GetMonitor();
+    if (monitor)
+    {
+        return monitor->List();
+    }
+    return Enumerate();
+}
+
+//////////////////////////////////////////////////////////////////////////
+std::vector<NetworkInterface> NetworkInterface::Enumerate()
 {
     AutoCriticalSection lock(&mMutex);
     std::vector<NetworkInterface> result;
@@ -13,6 +13,7 @@
 #include <vector>
 
 class NetworkInterfaceImpl;
+class NetworkInterfaceMonitor;
 
 // This class represents a network interface.
 class NetworkInterface
@@ -78,6 +79,8 @@ public:
     // Returns a List with all network interfaces on the system.
     // If there are multiple addresses bound to one interface,
     // multiple NetworkInterface instances are created for the same interface.
+    // The lookups above and List() use the table of NetworkInterfaceMonitor::GetDefault(),
+    // started on first use, and enumerate the interfaces if it cannot be started.
     static std::vector<NetworkInterface> List();
 
 protected:
@@ -105,7 +108,15 @@ protected:
     // Determines the interface Index of the interface with the given Name.
     int InterfaceNameToIndex(const std::string& interfaceName) const;
 
+    // Enumerates the IPv4 interfaces with SIOCGIFCONF
+    static std::vector<NetworkInterface> Enumerate();
+
+    // Returns the default monitor, started, or NULL if it cannot be started
+    static NetworkInterfaceMonitor* GetMonitor();
+
 private:
+    friend class NetworkInterfaceMonitor;
+
     NetworkInterfaceImpl* mImpl;
     static CriticalSection mMutex;
 };
@@ -0,0 +1,613 @@
+//////////////////////////////////////////////////////////////////////////
+// NetworkInterfaceMonitor.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "NetworkInterfaceMonitor.h"
+#include "Log.h"
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+// Dumps of more links or addresses than this are received in several reads
+static const int RECEIVE_BUFFER_SIZE = 32768;
+// Socket buffer for the notifications, so bursts (e.g. many containers starting) are not lost
+static const int SOCKET_BUFFER_SIZE = 1 << 20;
+// Reloads retried when notifications are lost during a reload
+static const int MAX_LOAD_ATTEMPTS = 5;
+
+// Returns the netmask of prefixLength bits for family
+static IPAddress MakeMask(IPAddress::IPFamily family, int prefixLength)
+{
+    UInt8 bytes[16];
+    int length = family == IPAddress::IPv4 ? 4 : 16;
+    for (int i = 0; i < length; i++)
+    {
+        int bits = prefixLength - i * 8;
+        bytes[i] = bits >= 8 ? 0xFF : (bits <= 0 ? 0 : UInt8(0xFF << (8 - bits)));
+    }
+    bool hasError;
+    return IPAddress(bytes, length, hasError);
+}
+
+NetworkInterfaceMonitor::NetworkInterfaceMonitor() :
+    mRunning(false), mStopping(false), mThread(0), mSocket(-1), mWakeFd(-1),
+    mSequence(0), mChangeCount(0)
+{
+}
+
+NetworkInterfaceMonitor::~NetworkInterfaceMonitor()
+{
+    Stop();
+}
+
+bool NetworkInterfaceMonitor::Start()
+{
+    AutoCriticalSection lock(&mStartLock);
+    if (mRunning)
+    {
+        return true;
+    }
+
+    mSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (mSocket < 0)
+    {
+        LOG(LogError, "Failed to open netlink socket: %d", errno);
+        return false;
+    }
+
+    sockaddr_nl local;
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    int size = SOCKET_BUFFER_SIZE;
+    setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (bind(mSocket, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 ||
+            mWakeFd < 0 || !Load())
+    {
+        LOG(LogError, "Failed to load network interfaces from netlink: %d", errno);
+        close(mSocket);
+        mSocket = -1;
+        if (mWakeFd >= 0)
+        {
+            close(mWakeFd);
+            mWakeFd = -1;
+        }
+        return false;
+    }
+
+    mStopping = false;
+    if (pthread_create(&mThread, NULL, MonitorProc, this) != 0)
+    {
+        LOG(LogError, "Failed to start network interface monitor thread");
+        close(mSocket);
+        close(mWakeFd);
+        mSocket = -1;
+        mWakeFd = -1;
+        return false;
+    }
+    mRunning = true;
+    return true;
+}
+
+void NetworkInterfaceMonitor::Stop()
+{
+    AutoCriticalSection lock(&mStartLock);
+    if (!mRunning)
+    {
+        return;
+    }
+
+    mStopping = true;
+    UInt64 one = 1;
+    ssize_t rc = write(mWakeFd, &one, sizeof(one));
+    (void)rc;
+    pthread_join(mThread, NULL);
+
+    close(mSocket);
+    close(mWakeFd);
+    mSocket = -1;
+    mWakeFd = -1;
+    mRunning = false;
+}
+
+void NetworkInterfaceMonitor::AddListener(NetworkInterfaceCallback callback, void* param)
+{
+    AutoCriticalSection lock(&mListenerLock);
+    Listener listener;
+    listener.callback = callback;
+    listener.param = param;
+    mListeners.push_back(listener);
+}
+
+void NetworkInterfaceMonitor::RemoveListener(NetworkInterfaceCallback callback, void* param)
+{
+    AutoCriticalSection lock(&mListenerLock);
+    for (std::vector<Listener>::iterator it = mListeners.begin(); it != mListeners.end(); ++it)
+    {
+        if (it->callback == callback && it->param == param)
+        {
+            mListeners.erase(it);
+            return;
+        }
+    }
+}
+
+std::vector<NetworkInterface> NetworkInterfaceMonitor::List() const
+{
+    AutoReadLock lock(mTableLock);
+    return mList;
+}
+
+bool NetworkInterfaceMonitor::ForName(const std::string& name, bool requireIPv6,
+        NetworkInterface& netIf) const
+{
+    AutoReadLock lock(mTableLock);
+    std::map<std::string, int>::const_iterator name_it = mByName.find(name);
+    if (name_it == mByName.end())
+    {
+        return false;
+    }
+    std::map<int, size_t>::const_iterator it = mByIndex.find(name_it->second);
+    if (it == mByIndex.end())
+    {
+        return false;
+    }
+
+    // The entries of an interface follow each other, IPv4 first
+    for (size_t i = it->second; i < mList.size() && mList[i].GetIndex() == it->first; i++)
+    {
+        if (!requireIPv6 || mList[i].GetAddress().GetFamily() == IPAddress::IPv6)
+        {
+            netIf = mList[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool NetworkInterfaceMonitor::ForAddress(const IPAddress& address, NetworkInterface& netIf) const
+{
+    AutoReadLock lock(mTableLock);
+    std::map<IPAddress, size_t>::const_iterator it = mByAddress.find(address);
+    if (it == mByAddress.end())
+    {
+        return false;
+    }
+    netIf = mList[it->second];
+    return true;
+}
+
+bool NetworkInterfaceMonitor::ForIndex(int index, NetworkInterface& netIf) const
+{
+    AutoReadLock lock(mTableLock);
+    std::map<int, size_t>::const_iterator it = mByIndex.find(index);
+    if (it == mByIndex.end())
+    {
+        return false;
+    }
+    netIf = mList[it->second];
+    return true;
+}
+
+int NetworkInterfaceMonitor::GetIndex(const std::string& name) const
+{
+    AutoReadLock lock(mTableLock);
+    std::map<std::string, int>::const_iterator it = mByName.find(name);
+    return it != mByName.end() ? it->second : 0;
+}
+
+bool NetworkInterfaceMonitor::GetFlags(int index, unsigned int& flags) const
+{
+    AutoReadLock lock(mTableLock);
+    LinkMap::const_iterator it = mLinks.find(index);
+    if (it == mLinks.end())
+    {
+        return false;
+    }
+    flags = it->second.flags;
+    return true;
+}
+
+bool NetworkInterfaceMonitor::GetAddresses(int index, std::vector<IPAddress>& addresses) const
+{
+    AutoReadLock lock(mTableLock);
+    LinkMap::const_iterator it = mLinks.find(index);
+    if (it == mLinks.end())
+    {
+        return false;
+    }
+    addresses.clear();
+    for (size_t i = 0; i < it->second.addresses.size(); i++)
+    {
+        addresses.push_back(it->second.addresses[i].address);
+    }
+    return true;
+}
+
+NetworkInterfaceMonitor& NetworkInterfaceMonitor::GetDefault()
+{
+    static NetworkInterfaceMonitor monitor;
+    return monitor;
+}
+
+bool NetworkInterfaceMonitor::RequestDump(int type)
+{
+    struct
+    {
+        nlmsghdr header;
+        rtgenmsg body;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.body));
+    request.header.nlmsg_type = type;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++mSequence;
+    request.body.rtgen_family = AF_UNSPEC;
+
+    sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    return sendto(mSocket, &request, request.header.nlmsg_len, 0,
+            reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) == ssize_t(request.header.nlmsg_len);
+}
+
+bool NetworkInterfaceMonitor::Receive(bool dump, std::vector<NetworkInterfaceEvent>& events,
+        bool& overflow)
+{
+    // Aligned for the message headers
+    UInt32 buffer[RECEIVE_BUFFER_SIZE / sizeof(UInt32)];
+    for (;;)
+    {
+        sockaddr_nl from;
+        socklen_t fromLength = sizeof(from);
+        ssize_t length = recvfrom(mSocket, buffer, sizeof(buffer), dump ? 0 : MSG_DONTWAIT,
+                reinterpret_cast<sockaddr*>(&from), &fromLength);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == ENOBUFS)
+            {
+                // Notifications were dropped, the rest of a dump still comes
+                overflow = true;
+                if (dump)
+                {
+                    continue;
+                }
+                return false;
+            }
+            if (!dump && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+            LOG(LogError, "Failed to receive from netlink socket: %d", errno);
+            return false;
+        }
+        if (from.nl_pid != 0)
+        {
+            // Only the kernel is trusted
+            continue;
+        }
+
+        int remaining = int(length);
+        for (const nlmsghdr* message = reinterpret_cast<const nlmsghdr*>(buffer);
+                NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining))
+        {
+            bool reply = dump && message->nlmsg_seq == mSequence;
+            if (reply && message->nlmsg_type == NLMSG_DONE)
+            {
+                return true;
+            }
+            if (reply && message->nlmsg_type == NLMSG_ERROR)
+            {
+                const nlmsgerr* error = static_cast<const nlmsgerr*>(NLMSG_DATA(message));
+                LOG(LogError, "Netlink dump failed: %d", -error->error);
+                return false;
+            }
+            if (message->nlmsg_flags & NLM_F_DUMP_INTR)
+            {
+                // The table changed during the dump, which may be inconsistent
+                overflow = true;
+            }
+            Apply(message, dump ? mLoading : mLinks, events);
+        }
+    }
+}
+
+bool NetworkInterfaceMonitor::Load()
+{
+    for (int attempt = 0; attempt < MAX_LOAD_ATTEMPTS; attempt++)
+    {
+        std::vector<NetworkInterfaceEvent> events;
+        bool overflow = false;
+        mLoading.clear();
+        if (!RequestDump(RTM_GETLINK) || !Receive(true, events, overflow) ||
+                !RequestDump(RTM_GETADDR) || !Receive(true, events, overflow))
+        {
+            return false;
+        }
+        if (overflow)
+        {
+            continue;
+        }
+
+        AutoWriteLock lock(mTableLock);
+        mLinks.swap(mLoading);
+        mLoading.clear();
+        Rebuild();
+        mChangeCount++;
+        return true;
+    }
+    LOG(LogError, "Network interfaces changed too fast to be loaded");
+    return false;
+}
+
+void NetworkInterfaceMonitor::Apply(const nlmsghdr* message, LinkMap& links,
+        std::vector<NetworkInterfaceEvent>& events)
+{
+    NetworkInterfaceEvent event;
+    event.prefixLength = 0;
+    if (message->nlmsg_type == RTM_NEWLINK || message->nlmsg_type == RTM_DELLINK)
+    {
+        const ifinfomsg* info = static_cast<const ifinfomsg*>(NLMSG_DATA(message));
+        if (message->nlmsg_len < NLMSG_LENGTH(sizeof(*info)) || info->ifi_family == AF_BRIDGE)
+        {
+            // Bridge port messages repeat the links
+            return;
+        }
+
+        event.index = info->ifi_index;
+        event.flags = info->ifi_flags;
+        int length = IFLA_PAYLOAD(message);
+        for (const rtattr* attr = IFLA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length))
+        {
+            if (attr->rta_type == IFLA_IFNAME)
+            {
+                const char* name = static_cast<const char*>(RTA_DATA(attr));
+                event.name.assign(name, strnlen(name, RTA_PAYLOAD(attr)));
+            }
+        }
+
+        LinkMap::iterator it = links.find(event.index);
+        if (message->nlmsg_type == RTM_DELLINK)
+        {
+            if (it == links.end())
+            {
+                return;
+            }
+            links.erase(it);
+            event.type = NetworkInterfaceEvent::LinkRemoved;
+        }
+        else if (it == links.end())
+        {
+            Link& link = links[event.index];
+            link.name = event.name;
+            link.flags = event.flags;
+            event.type = NetworkInterfaceEvent::LinkAdded;
+        }
+        else if (it->second.name != event.name || it->second.flags != event.flags)
+        {
+            it->second.name = event.name;
+            it->second.flags = event.flags;
+            event.type = NetworkInterfaceEvent::LinkChanged;
+        }
+        else
+        {
+            // Statistics or other attributes only
+            return;
+        }
+        events.push_back(event);
+        return;
+    }
+
+    if (message->nlmsg_type != RTM_NEWADDR && message->nlmsg_type != RTM_DELADDR)
+    {
+        return;
+    }
+    const ifaddrmsg* info = static_cast<const ifaddrmsg*>(NLMSG_DATA(message));
+    if (message->nlmsg_len < NLMSG_LENGTH(sizeof(*info)) ||
+            (info->ifa_family != AF_INET && info->ifa_family != AF_INET6))
+    {
+        return;
+    }
+
+    // IFA_LOCAL is the address of the interface, IFA_ADDRESS the peer of point to point IPv4 links
+    const void* local = NULL;
+    const void* address = NULL;
+    const void* broadcast = NULL;
+    int length = IFA_PAYLOAD(message);
+    for (const rtattr* attr = IFA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length))
+    {
+        SOCKET_LENGTH_t size = info->ifa_family == AF_INET ? sizeof(in_addr) : sizeof(in6_addr);
+        if (RTA_PAYLOAD(attr) < size)
+        {
+            continue;
+        }
+        switch (attr->rta_type)
+        {
+        case IFA_LOCAL:
+            local = RTA_DATA(attr);
+            break;
+        case IFA_ADDRESS:
+            address = RTA_DATA(attr);
+            break;
+        case IFA_BROADCAST:
+            broadcast = RTA_DATA(attr);
+            break;
+        default:
+            break;
+        }
+    }
+    if (local != NULL)
+    {
+        address = local;
+    }
+    if (address == NULL)
+    {
+        return;
+    }
+
+    bool hasError = false;
+    SOCKET_LENGTH_t size = info->ifa_family == AF_INET ? sizeof(in_addr) : sizeof(in6_addr);
+    Address entry;
+    entry.address = IPAddress(address, size, hasError);
+    entry.prefixLength = info->ifa_prefixlen;
+    if (broadcast != NULL)
+    {
+        entry.broadcast = IPAddress(broadcast, size, hasError);
+    }
+
+    event.index = int(info->ifa_index);
+    event.address = entry.address;
+    event.prefixLength = entry.prefixLength;
+    LinkMap::iterator it = links.find(event.index);
+    if (it == links.end())
+    {
+        if (message->nlmsg_type == RTM_DELADDR)
+        {
+            return;
+        }
+        // The link notification was lost or is still to come
+        char name[IF_NAMESIZE];
+        it = links.insert(std::make_pair(event.index, Link())).first;
+        if (if_indextoname(event.index, name) != NULL)
+        {
+            it->second.name = name;
+        }
+    }
+    event.name = it->second.name;
+    event.flags = it->second.flags;
+
+    std::vector<Address>& addresses = it->second.addresses;
+    std::vector<Address>::iterator addr_it = addresses.begin();
+    while (addr_it != addresses.end() && addr_it->address != entry.address)
+    {
+        ++addr_it;
+    }
+    if (message->nlmsg_type == RTM_DELADDR)
+    {
+        if (addr_it == addresses.end())
+        {
+            return;
+        }
+        addresses.erase(addr_it);
+        event.type = NetworkInterfaceEvent::AddressRemoved;
+    }
+    else if (addr_it == addresses.end())
+    {
+        addresses.push_back(entry);
+        event.type = NetworkInterfaceEvent::AddressAdded;
+    }
+    else
+    {
+        // Flags or lifetimes updated, e.g. an IPv6 address done with duplicate detection
+        *addr_it = entry;
+        return;
+    }
+    events.push_back(event);
+}
+
+void NetworkInterfaceMonitor::Rebuild()
+{
+    mList.clear();
+    mByName.clear();
+    mByAddress.clear();
+    mByIndex.clear();
+    for (LinkMap::const_iterator it = mLinks.begin(); it != mLinks.end(); ++it)
+    {
+        const Link& link = it->second;
+        mByName[link.name] = it->first;
+        // IPv4 addresses first, as NetworkInterface::List() had them only
+        for (int pass = 0; pass < 2; pass++)
+        {
+            IPAddress::IPFamily family = pass == 0 ? IPAddress::IPv4 : IPAddress::IPv6;
+            for (size_t i = 0; i < link.addresses.size(); i++)
+            {
+                const Address& address = link.addresses[i];
+                if (address.address.GetFamily() != family)
+                {
+                    continue;
+                }
+                mByAddress.insert(std::make_pair(address.address, mList.size()));
+                mByIndex.insert(std::make_pair(it->first, mList.size()));
+                mList.push_back(NetworkInterface(link.name, link.name, address.address,
+                        MakeMask(family, address.prefixLength), address.broadcast, it->first));
+            }
+        }
+    }
+}
+
+void NetworkInterfaceMonitor::Notify(const std::vector<NetworkInterfaceEvent>& events)
+{
+    AutoCriticalSection lock(&mListenerLock);
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        for (size_t j = 0; j < mListeners.size(); j++)
+        {
+            mListeners[j].callback(events[i], mListeners[j].param);
+        }
+    }
+}
+
+void* NetworkInterfaceMonitor::MonitorProc(void* param)
+{
+    static_cast<NetworkInterfaceMonitor*>(param)->Monitor();
+    return NULL;
+}
+
+void NetworkInterfaceMonitor::Monitor()
+{
+    while (!mStopping)
+    {
+        pollfd fds[2];
+        fds[0].fd = mSocket;
+        fds[0].events = POLLIN;
+        fds[1].fd = mWakeFd;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG(LogError, "poll on netlink socket failed: %d", errno);
+            break;
+        }
+        if (mStopping || !(fds[0].revents & POLLIN))
+        {
+            continue;
+        }
+
+        std::vector<NetworkInterfaceEvent> events;
+        bool overflow = false;
+        {
+            AutoWriteLock lock(mTableLock);
+            Receive(false, events, overflow);
+            if (!events.empty())
+            {
+                Rebuild();
+                mChangeCount += events.size();
+            }
+        }
+
+        if (overflow && Load())
+        {
+            // Changes were lost, the table was loaded again
+            NetworkInterfaceEvent event;
+            event.type = NetworkInterfaceEvent::Resynchronized;
+            event.index = 0;
+            event.flags = 0;
+            event.prefixLength = 0;
+            events.push_back(event);
+        }
+        Notify(events);
+    }
+}
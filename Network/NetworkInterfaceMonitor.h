@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////////
+// NetworkInterfaceMonitor.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef NetworkInterfaceMonitor_INCLUDED
+#define NetworkInterfaceMonitor_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Types.h"
+#include "RWLock.h"
+#include "CriticalSection.h"
+#include "IPAddress.h"
+#include "NetworkInterface.h"
+
+struct nlmsghdr;
+
+// A change of the interface table, passed to the listeners of a NetworkInterfaceMonitor.
+struct NetworkInterfaceEvent
+{
+    enum Type
+    {
+        // A link appeared, or its name or flags changed
+        LinkAdded, LinkChanged, LinkRemoved,
+        AddressAdded, AddressRemoved,
+        // Events were lost (the kernel dropped notifications) and the table was reloaded:
+        // listeners should read it again rather than rely on the events they got
+        Resynchronized
+    };
+
+    Type type;
+    // Interface index and name, for all types but Resynchronized
+    int index;
+    std::string name;
+    // IFF_UP, IFF_RUNNING... of the link
+    unsigned int flags;
+    // The address and its prefix length, for AddressAdded and AddressRemoved
+    IPAddress address;
+    int prefixLength;
+};
+
+// Called from the monitor thread after the table was updated.
+// Lookups on the monitor may be used from the callback, AddListener/RemoveListener may not.
+typedef void (*NetworkInterfaceCallback)(const NetworkInterfaceEvent& event, void* param);
+
+// Keeps a table of the network interfaces and their addresses, current through an rtnetlink
+// subscription to link and address changes, instead of enumerating the interfaces on each lookup.
+// Start() loads the table and starts a thread receiving the changes; lookups are then map
+// lookups under a read lock, and listeners are called back as soon as the kernel reports a change.
+// Unlike NetworkInterface::List() with SIOCGIFCONF, IPv6 addresses and addresses of links
+// which are down are listed too. All methods are thread-safe.
+class NetworkInterfaceMonitor
+{
+public:
+    NetworkInterfaceMonitor();
+
+    // Stops the monitor thread, see Stop().
+    ~NetworkInterfaceMonitor();
+
+    // Opens the netlink socket, loads the table and starts the monitor thread.
+    // Returns true if the monitor is running, also if it was already started.
+    bool Start();
+
+    // Stops the monitor thread. The table is kept, but no longer updated.
+    void Stop();
+
+    bool IsRunning() const
+    {
+        return mRunning;
+    }
+
+    // Adds a callback invoked on each change of the table.
+    void AddListener(NetworkInterfaceCallback callback, void* param);
+
+    // Removes a callback added with the same param. Once this returns, the callback is not
+    // running and is not called again, so it must not be called from the callback itself.
+    void RemoveListener(NetworkInterfaceCallback callback, void* param);
+
+    // Lists an entry per address, as NetworkInterface::List() does.
+    // Links are listed by index, with their IPv4 addresses first.
+    std::vector<NetworkInterface> List() const;
+
+    // Lookups like the NetworkInterface ones
+    bool ForName(const std::string& name, bool requireIPv6, NetworkInterface& netIf) const;
+    bool ForAddress(const IPAddress& address, NetworkInterface& netIf) const;
+    bool ForIndex(int index, NetworkInterface& netIf) const;
+
+    // Returns the index of the interface name, 0 if not found
+    int GetIndex(const std::string& name) const;
+
+    // Returns the IFF_UP, IFF_RUNNING... flags of the interface, false if not found
+    bool GetFlags(int index, unsigned int& flags) const;
+
+    // Returns the addresses of the interface, false if not found
+    bool GetAddresses(int index, std::vector<IPAddress>& addresses) const;
+
+    // The number of changes applied since Start(), including those of reloads
+    UInt64 GetChangeCount() const
+    {
+        return mChangeCount;
+    }
+
+    // A monitor shared by the whole process, used by the NetworkInterface lookups
+    static NetworkInterfaceMonitor& GetDefault();
+
+private:
+    struct Address
+    {
+        IPAddress address;
+        int prefixLength;
+        IPAddress broadcast;
+    };
+
+    struct Link
+    {
+        Link() : flags(0)
+        {
+        }
+
+        std::string name;
+        unsigned int flags;
+        std::vector<Address> addresses;
+    };
+
+    struct Listener
+    {
+        NetworkInterfaceCallback callback;
+        void* param;
+    };
+
+    typedef std::map<int, Link> LinkMap;
+
+    // Sends a dump request of type, RTM_GETLINK or RTM_GETADDR
+    bool RequestDump(int type);
+
+    // Receives messages until the dump completes, applying them to mLoading,
+    // or if dump is false until the socket has nothing more to read, applying them to mLinks.
+    // Returns false on error. overflow is set if the kernel dropped messages.
+    bool Receive(bool dump, std::vector<NetworkInterfaceEvent>& events, bool& overflow);
+
+    // Loads the whole table again through dumps, with mLinks replaced once loaded
+    bool Load();
+
+    // Applies one netlink message to links, adding its event if it changed them
+    static void Apply(const nlmsghdr* message, LinkMap& links,
+            std::vector<NetworkInterfaceEvent>& events);
+
+    // Rebuilds the list and indexes from mLinks, with the write lock held
+    void Rebuild();
+
+    void Notify(const std::vector<NetworkInterfaceEvent>& events);
+
+    static void* MonitorProc(void* param);
+    void Monitor();
+
+private:
+    NetworkInterfaceMonitor(const NetworkInterfaceMonitor&);
+    NetworkInterfaceMonitor& operator =(const NetworkInterfaceMonitor&);
+
+private:
+    // Serializes Start() and Stop()
+    CriticalSection mStartLock;
+    bool mRunning;
+    volatile bool mStopping;
+    pthread_t mThread;
+    int mSocket;
+    // Written by Stop() to wake the monitor thread
+    int mWakeFd;
+    UInt32 mSequence;
+    UInt64 mChangeCount;
+
+    // Guards the table, the list and the indexes
+    mutable RWLock mTableLock;
+    LinkMap mLinks;
+    // The table being loaded, used by Start() and the monitor thread only
+    LinkMap mLoading;
+    std::vector<NetworkInterface> mList;
+    std::map<std::string, int> mByName;
+    // Position in mList of the entry of an address, and of the first entry of an index
+    std::map<IPAddress, size_t> mByAddress;
+    std::map<int, size_t> mByIndex;
+
+    // Held while listeners are called, so RemoveListener() waits for running callbacks
+    CriticalSection mListenerLock;
+    std::vector<Listener> mListeners;
+};
+
+#endif // NetworkInterfaceMonitor_INCLUDED
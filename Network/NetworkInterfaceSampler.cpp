@@ -0,0 +1,381 @@
+//////////////////////////////////////////////////////////////////////////
+// NetworkInterfaceSampler.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "NetworkInterfaceSampler.h"
+#include "Timestamp.h"
+#include "Statistic.h"
+#include "Log.h"
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// /proc/net/dev is read in one go, it takes about 100 bytes per interface
+static const size_t READ_BUFFER_SIZE = 65536;
+
+NetworkInterfaceSampler::NetworkInterfaceSampler(const std::string& path) :
+    mPath(path), mInterval(Timespan::Second), mHistory(60), mStatistic(NULL),
+    mRunning(false), mStopping(false), mThread(0)
+{
+}
+
+NetworkInterfaceSampler::~NetworkInterfaceSampler()
+{
+    Stop();
+    for (std::map<std::string, Ring*>::iterator it = mRings.begin(); it != mRings.end(); ++it)
+    {
+        delete it->second;
+    }
+}
+
+void NetworkInterfaceSampler::SetStatistic(Statistic* statistic, const std::string& prefix)
+{
+    AutoCriticalSection lock(&mStatisticLock);
+    mStatistic = statistic;
+    mPrefix = prefix;
+}
+
+bool NetworkInterfaceSampler::Start()
+{
+    AutoCriticalSection lock(&mThreadLock);
+    if (mRunning)
+    {
+        return true;
+    }
+
+    mStopping = false;
+    if (pthread_create(&mThread, NULL, SamplerProc, this) != 0)
+    {
+        LOG(LogError, "Failed to start interface sampler thread");
+        return false;
+    }
+    mRunning = true;
+    return true;
+}
+
+void NetworkInterfaceSampler::Stop()
+{
+    {
+        AutoCriticalSection lock(&mThreadLock);
+        if (!mRunning)
+        {
+            return;
+        }
+        mStopping = true;
+        mStopCondition.Broadcast();
+    }
+
+    pthread_join(mThread, NULL);
+    AutoCriticalSection lock(&mThreadLock);
+    mRunning = false;
+}
+
+bool NetworkInterfaceSampler::Parse(const char* text, size_t length,
+        std::vector<std::pair<std::string, InterfaceSample> >& samples)
+{
+    const char* end = text + length;
+    const char* line = text;
+    int lineNumber = 0;
+    while (line < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (lineEnd == NULL)
+        {
+            lineEnd = end;
+        }
+
+        // The first two lines are headers
+        if (++lineNumber > 2)
+        {
+            const char* colon = static_cast<const char*>(memchr(line, ':', lineEnd - line));
+            if (colon == NULL)
+            {
+                return false;
+            }
+            const char* name = line;
+            while (name < colon && *name == ' ')
+            {
+                name++;
+            }
+
+            // bytes packets errs drop fifo frame compressed multicast, then for transmit
+            // bytes packets errs drop fifo colls carrier compressed
+            UInt64 values[16];
+            const char* p = colon + 1;
+            for (int i = 0; i < 16; i++)
+            {
+                char* next;
+                values[i] = strtoull(p, &next, 10);
+                if (next == p || next > lineEnd)
+                {
+                    return false;
+                }
+                p = next;
+            }
+
+            InterfaceSample sample;
+            sample.time = 0;
+            sample.rxBytes = values[0];
+            sample.rxPackets = values[1];
+            sample.rxErrors = values[2];
+            sample.rxDrops = values[3];
+            sample.txBytes = values[8];
+            sample.txPackets = values[9];
+            sample.txErrors = values[10];
+            sample.txDrops = values[11];
+            samples.push_back(std::make_pair(std::string(name, colon - name), sample));
+        }
+        line = lineEnd + 1;
+    }
+    return lineNumber >= 2;
+}
+
+bool NetworkInterfaceSampler::Sample()
+{
+    AutoCriticalSection sampleLock(&mSampleLock);
+    int fd = open(mPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG(LogError, "Failed to open %s: %d", mPath.c_str(), errno);
+        return false;
+    }
+
+    // procfs files are read until read() returns 0, the content is generated per read
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    size_t length = 0;
+    for (;;)
+    {
+        if (length == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t count = read(fd, &buffer[length], buffer.size() - length);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        length += count;
+    }
+    close(fd);
+
+    Timestamp now;
+    std::vector<std::pair<std::string, InterfaceSample> > samples;
+    if (!Parse(&buffer[0], length, samples))
+    {
+        LOG(LogError, "Failed to parse %s", mPath.c_str());
+        return false;
+    }
+
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        Ring* ring;
+        {
+            AutoReadLock lock(mRingsLock);
+            std::map<std::string, Ring*>::const_iterator it = mRings.find(samples[i].first);
+            ring = it != mRings.end() ? it->second : NULL;
+        }
+        if (ring == NULL)
+        {
+            // A slot more than the history, for the sample being written
+            ring = new Ring(mHistory + 1);
+            AutoWriteLock lock(mRingsLock);
+            mRings[samples[i].first] = ring;
+        }
+
+        // The slot is written before the count is published. A reader copying the
+        // oldest slot meanwhile sees the count moved past it and drops the copy.
+        UInt64 count = ring->count;
+        samples[i].second.time = now.GetEpochMicroseconds();
+        ring->samples[count % ring->samples.size()] = samples[i].second;
+        __atomic_store_n(&ring->count, count + 1, __ATOMIC_RELEASE);
+    }
+
+    AutoCriticalSection lock(&mStatisticLock);
+    if (mStatistic != NULL)
+    {
+        Export(*mStatistic, mPrefix);
+    }
+    return true;
+}
+
+std::vector<std::string> NetworkInterfaceSampler::GetInterfaces() const
+{
+    AutoReadLock lock(mRingsLock);
+    std::vector<std::string> names;
+    for (std::map<std::string, Ring*>::const_iterator it = mRings.begin(); it != mRings.end(); ++it)
+    {
+        names.push_back(it->first);
+    }
+    return names;
+}
+
+const NetworkInterfaceSampler::Ring* NetworkInterfaceSampler::FindRing(const std::string& name) const
+{
+    // Rings are never deleted before the sampler, so the pointer stays valid without the lock
+    AutoReadLock lock(mRingsLock);
+    std::map<std::string, Ring*>::const_iterator it = mRings.find(name);
+    return it != mRings.end() ? it->second : NULL;
+}
+
+bool NetworkInterfaceSampler::Read(const Ring& ring, size_t n, std::vector<InterfaceSample>& samples)
+{
+    size_t capacity = ring.samples.size();
+    for (;;)
+    {
+        UInt64 count = __atomic_load_n(&ring.count, __ATOMIC_ACQUIRE);
+        if (count < n)
+        {
+            return false;
+        }
+
+        samples.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            samples[i] = ring.samples[(count - n + i) % capacity];
+        }
+
+        // The copies are good if the sampler did not start overwriting the first one:
+        // it writes sample number latest while latest is the published count
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        UInt64 latest = __atomic_load_n(&ring.count, __ATOMIC_ACQUIRE);
+        if (latest - (count - n) < capacity)
+        {
+            return true;
+        }
+    }
+}
+
+bool NetworkInterfaceSampler::GetLatest(const std::string& name, InterfaceSample& sample) const
+{
+    const Ring* ring = FindRing(name);
+    std::vector<InterfaceSample> samples;
+    if (ring == NULL || !Read(*ring, 1, samples))
+    {
+        return false;
+    }
+    sample = samples[0];
+    return true;
+}
+
+bool NetworkInterfaceSampler::GetHistory(const std::string& name,
+        std::vector<InterfaceSample>& samples) const
+{
+    const Ring* ring = FindRing(name);
+    if (ring == NULL)
+    {
+        return false;
+    }
+
+    // As many as there are, up to the history
+    UInt64 count = __atomic_load_n(&ring->count, __ATOMIC_ACQUIRE);
+    size_t n = count < ring->samples.size() - 1 ? size_t(count) : ring->samples.size() - 1;
+    return Read(*ring, n, samples);
+}
+
+// Per second increase from first to last, 0 if the counter went down
+static double GetRate(UInt64 first, UInt64 last, Int64 microseconds)
+{
+    return last >= first ? double(last - first) * 1000000 / microseconds : 0;
+}
+
+bool NetworkInterfaceSampler::GetRates(const std::string& name, InterfaceRates& rates,
+        int intervals) const
+{
+    const Ring* ring = FindRing(name);
+    std::vector<InterfaceSample> samples;
+    if (intervals < 1 || ring == NULL || size_t(intervals) + 1 >= ring->samples.size() ||
+            !Read(*ring, intervals + 1, samples))
+    {
+        return false;
+    }
+
+    const InterfaceSample& first = samples.front();
+    const InterfaceSample& last = samples.back();
+    Int64 elapsed = last.time - first.time;
+    if (elapsed <= 0)
+    {
+        return false;
+    }
+    rates.rxBytes = GetRate(first.rxBytes, last.rxBytes, elapsed);
+    rates.rxPackets = GetRate(first.rxPackets, last.rxPackets, elapsed);
+    rates.rxErrors = GetRate(first.rxErrors, last.rxErrors, elapsed);
+    rates.rxDrops = GetRate(first.rxDrops, last.rxDrops, elapsed);
+    rates.txBytes = GetRate(first.txBytes, last.txBytes, elapsed);
+    rates.txPackets = GetRate(first.txPackets, last.txPackets, elapsed);
+    rates.txErrors = GetRate(first.txErrors, last.txErrors, elapsed);
+    rates.txDrops = GetRate(first.txDrops, last.txDrops, elapsed);
+    return true;
+}
+
+void NetworkInterfaceSampler::Export(Statistic& statistic, const std::string& prefix) const
+{
+    std::vector<std::string> names = GetInterfaces();
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        std::string key = prefix + names[i];
+        InterfaceSample sample;
+        if (GetLatest(names[i], sample))
+        {
+            statistic.Set(key + ".rx_bytes", long(sample.rxBytes));
+            statistic.Set(key + ".rx_packets", long(sample.rxPackets));
+            statistic.Set(key + ".rx_errors", long(sample.rxErrors));
+            statistic.Set(key + ".rx_drops", long(sample.rxDrops));
+            statistic.Set(key + ".tx_bytes", long(sample.txBytes));
+            statistic.Set(key + ".tx_packets", long(sample.txPackets));
+            statistic.Set(key + ".tx_errors", long(sample.txErrors));
+            statistic.Set(key + ".tx_drops", long(sample.txDrops));
+        }
+
+        InterfaceRates rates;
+        if (GetRates(names[i], rates))
+        {
+            statistic.Set(key + ".rx_bytes_per_sec", long(rates.rxBytes));
+            statistic.Set(key + ".rx_packets_per_sec", long(rates.rxPackets));
+            statistic.Set(key + ".rx_errors_per_sec", long(rates.rxErrors));
+            statistic.Set(key + ".rx_drops_per_sec", long(rates.rxDrops));
+            statistic.Set(key + ".tx_bytes_per_sec", long(rates.txBytes));
+            statistic.Set(key + ".tx_packets_per_sec", long(rates.txPackets));
+            statistic.Set(key + ".tx_errors_per_sec", long(rates.txErrors));
+            statistic.Set(key + ".tx_drops_per_sec", long(rates.txDrops));
+        }
+    }
+}
+
+void* NetworkInterfaceSampler::SamplerProc(void* param)
+{
+    static_cast<NetworkInterfaceSampler*>(param)->Run();
+    return NULL;
+}
+
+void NetworkInterfaceSampler::Run()
+{
+    // Samples are taken at multiples of the interval from the start, not drifting with the sampling time
+    Timestamp next;
+    for (;;)
+    {
+        Sample();
+        next += mInterval;
+
+        AutoCriticalSection lock(&mThreadLock);
+        while (!mStopping)
+        {
+            Timestamp now;
+            if (now >= next)
+            {
+                break;
+            }
+            mStopCondition.Wait(mThreadLock, long((next - now + 999) / 1000));
+        }
+        if (mStopping)
+        {
+            return;
+        }
+    }
+}
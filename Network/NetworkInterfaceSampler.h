@@ -0,0 +1,163 @@
+//////////////////////////////////////////////////////////////////////////
+// NetworkInterfaceSampler.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef NetworkInterfaceSampler_INCLUDED
+#define NetworkInterfaceSampler_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Types.h"
+#include "Timespan.h"
+#include "RWLock.h"
+#include "CriticalSection.h"
+#include "Condition.h"
+
+class Statistic;
+
+// The counters of an interface at one time, as totals since the interface was created
+struct InterfaceSample
+{
+    // Microseconds since the epoch
+    Int64 time;
+    UInt64 rxBytes;
+    UInt64 rxPackets;
+    UInt64 rxErrors;
+    UInt64 rxDrops;
+    UInt64 txBytes;
+    UInt64 txPackets;
+    UInt64 txErrors;
+    UInt64 txDrops;
+};
+
+// The counters of an interface per second, between two samples
+struct InterfaceRates
+{
+    double rxBytes;
+    double rxPackets;
+    double rxErrors;
+    double rxDrops;
+    double txBytes;
+    double txPackets;
+    double txErrors;
+    double txDrops;
+};
+
+// Samples the counters of all network interfaces from /proc/net/dev at an interval,
+// and keeps the last samples of each interface in a ring.
+// One thread samples, with Start() or by calling Sample(); readers do not take a lock
+// on the rings, they copy samples and check the sampler did not overwrite them meanwhile.
+// A lock is only taken to find the ring of an interface, and for writing when an interface
+// is first seen. Rings of interfaces which went away are kept, with their last samples.
+// Rates can be exported after each sample to a Statistic, as
+// "<prefix><interface>.rx_bytes_per_sec" and so on, with totals as "<prefix><interface>.rx_bytes".
+class NetworkInterfaceSampler
+{
+public:
+    explicit NetworkInterfaceSampler(const std::string& path = "/proc/net/dev");
+
+    // Stops the sampling thread, see Stop().
+    ~NetworkInterfaceSampler();
+
+    // Time between samples. Default is 1 second.
+    void SetInterval(const Timespan& interval)
+    {
+        mInterval = interval.GetTotalMicroseconds();
+    }
+
+    // Samples kept per interface, at least 2. Default is 60.
+    // Only applies to interfaces not seen yet.
+    void SetHistory(int samples)
+    {
+        mHistory = samples > 2 ? samples : 2;
+    }
+
+    // Exports the rates and totals to statistic after each sample, NULL to stop.
+    // The statistic must outlive the sampler, or the export be stopped first.
+    void SetStatistic(Statistic* statistic, const std::string& prefix = "net.");
+
+    // Starts a thread sampling at the interval, taking a first sample right away.
+    bool Start();
+
+    // Stops the sampling thread. Samples are kept.
+    void Stop();
+
+    // Reads the counters of all interfaces and adds a sample to their rings.
+    // Returns false if the file can not be read or parsed.
+    bool Sample();
+
+    // Names of the interfaces sampled so far
+    std::vector<std::string> GetInterfaces() const;
+
+    // Copies the last sample of the interface. Returns false if it was not sampled.
+    bool GetLatest(const std::string& name, InterfaceSample& sample) const;
+
+    // Copies the samples kept for the interface, the oldest first.
+    bool GetHistory(const std::string& name, std::vector<InterfaceSample>& samples) const;
+
+    // Computes the rates over the last intervals samples, 1 for the last interval.
+    // Counters which went down (the interface was recreated) count as 0.
+    // Returns false if there are not that many samples yet.
+    bool GetRates(const std::string& name, InterfaceRates& rates, int intervals = 1) const;
+
+    // Writes the last rates and totals of all interfaces to statistic
+    void Export(Statistic& statistic, const std::string& prefix = "net.") const;
+
+    // Parses the content of /proc/net/dev, adding an entry per interface to samples,
+    // with time left to the caller.
+    static bool Parse(const char* text, size_t length,
+            std::vector<std::pair<std::string, InterfaceSample> >& samples);
+
+private:
+    struct Ring
+    {
+        explicit Ring(int capacity) : samples(capacity), count(0)
+        {
+        }
+
+        std::vector<InterfaceSample> samples;
+        // Samples written so far, the last one is at (count - 1) % capacity
+        volatile UInt64 count;
+    };
+
+    // Copies the last n samples of ring to samples, the oldest first, n below the capacity.
+    // Returns false if the ring has less.
+    static bool Read(const Ring& ring, size_t n, std::vector<InterfaceSample>& samples);
+
+    const Ring* FindRing(const std::string& name) const;
+
+    static void* SamplerProc(void* param);
+    void Run();
+
+private:
+    NetworkInterfaceSampler(const NetworkInterfaceSampler&);
+    NetworkInterfaceSampler& operator =(const NetworkInterfaceSampler&);
+
+private:
+    std::string mPath;
+    Int64 mInterval;
+    int mHistory;
+
+    // Serializes Sample(), the only writer of the rings
+    CriticalSection mSampleLock;
+    // Guards mRings, written only when an interface is first seen
+    mutable RWLock mRingsLock;
+    std::map<std::string, Ring*> mRings;
+
+    // Guards the export settings
+    mutable CriticalSection mStatisticLock;
+    Statistic* mStatistic;
+    std::string mPrefix;
+
+    // Guards the thread state, and wakes the thread when stopping
+    CriticalSection mThreadLock;
+    Condition mStopCondition;
+    bool mRunning;
+    bool mStopping;
+    pthread_t mThread;
+};
+
+#endif // NetworkInterfaceSampler_INCLUDED
@@ -0,0 +1,488 @@
+//////////////////////////////////////////////////////////////////////////
+// PingSweeper.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "PingSweeper.h"
+#include "PingUtilities.h"
+#include "DNSResolver.h"
+#include "Timestamp.h"
+#include "Log.h"
+#include <netinet/in_systm.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <poll.h>
+#include <cstring>
+#include <cstdlib>
+
+// Payload of a probe, echoed back by the target
+struct ProbePayload
+{
+    UInt32 runID;
+    UInt32 target;
+    UInt32 probe;
+    Int64 sendTime;
+} __attribute__((packed));
+
+static const int MIN_PAYLOAD_SIZE = sizeof(ProbePayload);
+// IP header with options, ICMP header and largest payload
+static const size_t MAX_REPLY = 60 + ICMP_MINLEN + 65507;
+// Replies may come in bursts of thousands
+static const int SOCKET_BUFFER_SIZE = 4 * 1024 * 1024;
+// Probes sent in a burst before reading the replies
+static const UInt64 RECEIVE_EVERY = 64;
+// Ancillary data of a received message, room for its timestamps and error
+static const size_t CONTROL_SIZE = 512;
+
+// Returns the kernel time in the ancillary data of msg, in microseconds, or 0 if none
+static Int64 GetKernelTime(msghdr& msg)
+{
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+        {
+            continue;
+        }
+        // The software time comes first, hardware ones follow if enabled
+        const timespec* ts = NULL;
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS || cmsg->cmsg_type == SCM_TIMESTAMPING)
+        {
+            ts = reinterpret_cast<const timespec*>(CMSG_DATA(cmsg));
+        }
+        if (ts != NULL && (ts->tv_sec != 0 || ts->tv_nsec != 0))
+        {
+            return Int64(ts->tv_sec) * Timespan::Second + ts->tv_nsec / 1000;
+        }
+    }
+    return 0;
+}
+
+PingSweeper::PingSweeper() :
+    mSockfd(-1), mDatagram(false), mID(UInt16(getpid())), mRunID(0), mCount(3),
+    mInterval(Timespan::Second), mTimeout(Timespan::Second), mRate(1000), mPayloadSize(56),
+    mKernelTimestamps(true), mTargetHistograms(false), mReceiveTimestamps(false),
+    mSendTimestamps(false), mReceived(0)
+{
+    mRunID = UInt32(Timestamp().GetEpochMicroseconds()) ^ (UInt32(getpid()) << 16);
+}
+
+PingSweeper::~PingSweeper()
+{
+    Close();
+}
+
+bool PingSweeper::AddTarget(const IPAddress& address)
+{
+    if (address.GetFamily() != IPAddress::IPv4)
+    {
+        LOG(LogError, "Only IPv4 targets can be pinged: %s", address.ToString().c_str());
+        return false;
+    }
+    mTargets.push_back(*static_cast<const in_addr*>(address.GetAddr()));
+    return true;
+}
+
+bool PingSweeper::AddTarget(const std::string& target)
+{
+    IPAddress address;
+    if (!IPAddress::Parse(target, address) && !DNSResolver::GetDefault().ResolveOne(target, address))
+    {
+        LOG(LogError, "Unknown ping target: %s", target.c_str());
+        return false;
+    }
+    return AddTarget(address);
+}
+
+bool PingSweeper::AddSubnet(const IPAddress& network, int prefixLength)
+{
+    if (network.GetFamily() != IPAddress::IPv4 || prefixLength < 0 || prefixLength > 32)
+    {
+        return false;
+    }
+
+    UInt32 mask = prefixLength == 0 ? 0 : ~UInt32(0) << (32 - prefixLength);
+    UInt32 first = ntohl(static_cast<const in_addr*>(network.GetAddr())->s_addr) & mask;
+    UInt32 last = first | ~mask;
+    if (prefixLength < 31)
+    {
+        first++;
+        last--;
+    }
+
+    mTargets.reserve(mTargets.size() + (last - first + 1));
+    for (UInt64 host = first; host <= last; host++)
+    {
+        in_addr addr;
+        addr.s_addr = htonl(UInt32(host));
+        mTargets.push_back(addr);
+    }
+    return true;
+}
+
+void PingSweeper::ClearTargets()
+{
+    mTargets.clear();
+}
+
+void PingSweeper::SetPayloadSize(int size)
+{
+    mPayloadSize = size < MIN_PAYLOAD_SIZE ? MIN_PAYLOAD_SIZE : size;
+    if (size_t(mPayloadSize) > MAX_REPLY - 60 - ICMP_MINLEN)
+    {
+        mPayloadSize = int(MAX_REPLY - 60 - ICMP_MINLEN);
+    }
+}
+
+bool PingSweeper::Run()
+{
+    size_t targets = mTargets.size();
+    mResults.assign(targets, PingResult());
+    mLastRtt.assign(targets, -1);
+    mAnswered.assign(targets * mCount, false);
+    mHistogram.Clear();
+    mHistograms.clear();
+    if (mTargetHistograms)
+    {
+        mHistograms.resize(targets);
+    }
+    for (size_t i = 0; i < targets; i++)
+    {
+        bool hasError;
+        mResults[i].address = IPAddress(&mTargets[i], sizeof(in_addr), hasError);
+    }
+    if (targets == 0)
+    {
+        return true;
+    }
+    if (!Open())
+    {
+        return false;
+    }
+    mRunID++;
+
+    // Probe n goes out in round n / targets, no earlier than its rate slot
+    // nor than the start of its round
+    UInt64 total = UInt64(targets) * mCount;
+    UInt64 next = 0;
+    mReceived = 0;
+    Timestamp start;
+    Timestamp lastSend = start;
+    Timestamp now;
+    while (true)
+    {
+        now.Update();
+        Int64 wait = -1;
+        while (next < total)
+        {
+            int probe = int(next / targets);
+            Int64 due = probe * mInterval;
+            if (mRate > 0 && Int64(next * Timespan::Second / mRate) > due)
+            {
+                due = Int64(next * Timespan::Second / mRate);
+            }
+            Int64 early = due - (now - start);
+            if (early > 0)
+            {
+                wait = early;
+                break;
+            }
+            if (!Send(size_t(next % targets), probe))
+            {
+                // Socket buffer full, give the interface time to drain
+                wait = Timespan::Millisecond;
+                break;
+            }
+            next++;
+            lastSend = now;
+            // Replies are read between bursts, before they overflow the socket buffer
+            if (next % RECEIVE_EVERY == 0)
+            {
+                Receive();
+                now.Update();
+            }
+        }
+
+        if (next == total)
+        {
+            Int64 left = mTimeout - (now - lastSend);
+            if (mReceived == total || left <= 0)
+            {
+                break;
+            }
+            wait = left;
+        }
+
+        pollfd pfd;
+        pfd.fd = mSockfd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        // Rounded up, so a wait does not end just short of its deadline
+        int rc = poll(&pfd, 1, int((wait + Timespan::Millisecond - 1) / Timespan::Millisecond));
+        if (rc > 0)
+        {
+            Receive();
+        }
+    }
+
+    Close();
+    LOG(LogDebug, "Pinged %u targets, %llu of %llu probes answered", unsigned(targets),
+            (unsigned long long)mReceived, (unsigned long long)total);
+    return true;
+}
+
+bool PingSweeper::Open()
+{
+    if (mSockfd >= 0)
+    {
+        return true;
+    }
+
+    mSockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+    mDatagram = mSockfd >= 0;
+    if (!mDatagram)
+    {
+        mSockfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+        if (mSockfd < 0)
+        {
+            LOG(LogError, "Failed to open ICMP socket, errno %d", errno);
+            return false;
+        }
+    }
+
+    int size = SOCKET_BUFFER_SIZE;
+    setsockopt(mSockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(mSockfd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    mPacket.resize(MAX_REPLY);
+
+    mReceiveTimestamps = false;
+    mSendTimestamps = false;
+    mSendKeys.clear();
+    mSendTimes.clear();
+    if (mKernelTimestamps)
+    {
+        int on = 1;
+        mReceiveTimestamps = setsockopt(mSockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+        // Send times come back on the error queue, numbered by the kernel from 0
+        int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        mSendTimestamps = setsockopt(mSockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                sizeof(flags)) == 0;
+        if (mSendTimestamps)
+        {
+            SendTime none = { 0, 0, 0 };
+            mSendTimes.assign(mTargets.size() * mCount, none);
+        }
+        if (!mReceiveTimestamps || !mSendTimestamps)
+        {
+            LOG(LogDebug, "Kernel timestamps not supported, errno %d", errno);
+        }
+    }
+    return true;
+}
+
+void PingSweeper::Close()
+{
+    if (mSockfd >= 0)
+    {
+        close(mSockfd);
+        mSockfd = -1;
+    }
+}
+
+bool PingSweeper::Send(size_t target, int probe)
+{
+    size_t length = ICMP_MINLEN + mPayloadSize;
+    char* packet = &mPacket[0];
+    memset(packet, 0, length);
+
+    icmp* icmpHdr = reinterpret_cast<icmp*>(packet);
+    icmpHdr->icmp_type = ICMP_ECHO;
+    icmpHdr->icmp_code = 0;
+    icmpHdr->icmp_id = htons(mID);
+    icmpHdr->icmp_seq = htons(UInt16(UInt64(probe) * mTargets.size() + target));
+
+    ProbePayload payload;
+    payload.runID = mRunID;
+    payload.target = UInt32(target);
+    payload.probe = UInt32(probe);
+    payload.sendTime = Timestamp().GetEpochMicroseconds();
+    size_t index = target * mCount + probe;
+    memcpy(packet + ICMP_MINLEN, &payload, sizeof(payload));
+    icmpHdr->icmp_cksum = PingUtilities::CalChecksum(reinterpret_cast<unsigned short*>(packet),
+            (unsigned int)length);
+
+    sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr = mTargets[target];
+    ssize_t rc = sendto(mSockfd, packet, length, MSG_DONTWAIT,
+            reinterpret_cast<sockaddr*>(&to), sizeof(to));
+    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS))
+    {
+        return false;
+    }
+
+    // A probe that can not be sent, e.g. to an unreachable network, is lost
+    mResults[target].sent++;
+    if (rc >= 0 && mSendTimestamps)
+    {
+        mSendTimes[index].before = payload.sendTime;
+        mSendTimes[index].after = Timestamp().GetEpochMicroseconds();
+        mSendKeys.push_back(UInt32(index));
+    }
+    return true;
+}
+
+void PingSweeper::ReceiveSendTimes()
+{
+    char data[64];
+    char control[CONTROL_SIZE];
+    while (true)
+    {
+        iovec iov;
+        iov.iov_base = data;
+        iov.iov_len = sizeof(data);
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(mSockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            return;
+        }
+
+        const sock_extended_err* err = NULL;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+            {
+                err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+            }
+        }
+        Int64 time = GetKernelTime(msg);
+        if (err == NULL || err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING || time == 0
+                || err->ee_data >= mSendKeys.size())
+        {
+            continue;
+        }
+
+        // The kernel may count a send that failed, the numbers of the probes sent after
+        // are off then. A time out of the window of the system call is not used.
+        SendTime& sendTime = mSendTimes[mSendKeys[err->ee_data]];
+        if (time >= sendTime.before && time <= sendTime.after)
+        {
+            sendTime.kernel = time;
+        }
+    }
+}
+
+void PingSweeper::Receive()
+{
+    // Send times are reported right after the send, before any reply to it
+    if (mSendTimestamps)
+    {
+        ReceiveSendTimes();
+    }
+
+    char* packet = &mPacket[0];
+    char control[CONTROL_SIZE];
+    while (true)
+    {
+        sockaddr_in from;
+        iovec iov;
+        iov.iov_base = packet;
+        iov.iov_len = mPacket.size();
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t rc = recvmsg(mSockfd, &msg, MSG_DONTWAIT);
+        if (rc < 0)
+        {
+            return;
+        }
+        Int64 receiveTime = mReceiveTimestamps ? GetKernelTime(msg) : 0;
+        if (receiveTime == 0)
+        {
+            receiveTime = Timestamp().GetEpochMicroseconds();
+        }
+
+        // Raw sockets get the IP header too
+        size_t offset = 0;
+        if (!mDatagram)
+        {
+            if (rc < int(sizeof(ip)))
+            {
+                continue;
+            }
+            offset = reinterpret_cast<ip*>(packet)->ip_hl * 4;
+        }
+        if (size_t(rc) < offset + ICMP_MINLEN + sizeof(ProbePayload))
+        {
+            continue;
+        }
+
+        // Raw sockets get all ICMP messages, datagram sockets only replies to their ID
+        const icmp* icmpHdr = reinterpret_cast<const icmp*>(packet + offset);
+        if (icmpHdr->icmp_type != ICMP_ECHOREPLY || (!mDatagram && ntohs(icmpHdr->icmp_id) != mID))
+        {
+            continue;
+        }
+
+        ProbePayload payload;
+        memcpy(&payload, packet + offset + ICMP_MINLEN, sizeof(payload));
+        size_t target = payload.target;
+        if (payload.runID != mRunID || target >= mTargets.size() || payload.probe >= UInt32(mCount)
+                || from.sin_addr.s_addr != mTargets[target].s_addr
+                || ntohs(icmpHdr->icmp_seq) != UInt16(UInt64(payload.probe) * mTargets.size() + target))
+        {
+            continue;
+        }
+
+        // Duplicates and replies past the timeout do not count
+        size_t index = target * mCount + payload.probe;
+        std::vector<bool>::reference answered = mAnswered[index];
+        Int64 sendTime = payload.sendTime;
+        if (mSendTimestamps && mSendTimes[index].kernel != 0)
+        {
+            sendTime = mSendTimes[index].kernel;
+        }
+        Int64 rtt = receiveTime - sendTime;
+        if (answered || rtt < 0 || rtt > mTimeout)
+        {
+            continue;
+        }
+        answered = true;
+
+        PingResult& result = mResults[target];
+        if (result.received == 0 || rtt < result.minRtt)
+        {
+            result.minRtt = rtt;
+        }
+        if (rtt > result.maxRtt)
+        {
+            result.maxRtt = rtt;
+        }
+        result.totalRtt += rtt;
+        if (mLastRtt[target] >= 0)
+        {
+            result.totalJitter += std::abs(rtt - mLastRtt[target]);
+        }
+        mLastRtt[target] = rtt;
+        result.received++;
+        mReceived++;
+        mHistogram.Add(rtt);
+        if (mTargetHistograms)
+        {
+            mHistograms[target].Add(rtt);
+        }
+    }
+}
@@ -0,0 +1,199 @@
+//////////////////////////////////////////////////////////////////////////
+// PingSweeper.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef PingSweeper_INCLUDED
+#define PingSweeper_INCLUDED
+
+#include <string>
+#include <vector>
+#include "Types.h"
+#include "IPAddress.h"
+#include "Timespan.h"
+#include "LatencyHistogram.h"
+
+// Round trip statistics of one target, times in microseconds
+struct PingResult
+{
+    PingResult() : sent(0), received(0), minRtt(0), maxRtt(0), totalRtt(0), totalJitter(0)
+    {
+    }
+
+    // Whether the target answered at least once
+    bool IsAlive() const
+    {
+        return received > 0;
+    }
+
+    // Lost probes, from 0 to 1
+    double GetLoss() const
+    {
+        return sent > 0 ? double(sent - received) / sent : 0;
+    }
+
+    double GetAverageRtt() const
+    {
+        return received > 0 ? double(totalRtt) / received : 0;
+    }
+
+    // Mean difference between the round trips of successive replies
+    double GetJitter() const
+    {
+        return received > 1 ? double(totalJitter) / (received - 1) : 0;
+    }
+
+    IPAddress address;
+    int sent;
+    int received;
+    Int64 minRtt;
+    Int64 maxRtt;
+    Int64 totalRtt;
+    Int64 totalJitter;
+};
+
+// Pings many IPv4 targets at once from a single ICMP socket.
+// Probes go out round by round, one to each target per round, as fast as the rate
+// limit allows; replies are matched to their probe by sequence, source and payload
+// as they come, so a sweep takes about count * interval plus the timeout,
+// whatever the number of targets.
+// An unprivileged ICMP datagram socket is used where the system allows it
+// (net.ipv4.ping_group_range), a raw socket otherwise.
+// A PingSweeper is not thread-safe.
+class PingSweeper
+{
+public:
+    PingSweeper();
+    ~PingSweeper();
+
+    // Adds a target by address, or by name resolved through DNSResolver.
+    bool AddTarget(const IPAddress& address);
+    bool AddTarget(const std::string& target);
+
+    // Adds the hosts of a subnet, e.g. 10.1.0.0 and 16.
+    // Network and broadcast addresses are left out of subnets larger than /31.
+    bool AddSubnet(const IPAddress& network, int prefixLength);
+
+    void ClearTargets();
+
+    // Probes sent to each target. Default is 3.
+    void SetCount(int count)
+    {
+        mCount = count > 0 ? count : 1;
+    }
+
+    // Time between the probes to the same target. Default is 1 second.
+    void SetInterval(const Timespan& interval)
+    {
+        mInterval = interval.GetTotalMicroseconds();
+    }
+
+    // Time to wait for a reply before the probe is lost. Default is 1 second.
+    void SetTimeout(const Timespan& timeout)
+    {
+        mTimeout = timeout.GetTotalMicroseconds();
+    }
+
+    // Probes sent per second over all targets, 0 for no limit. Default is 1000.
+    void SetRate(int probesPerSecond)
+    {
+        mRate = probesPerSecond > 0 ? probesPerSecond : 0;
+    }
+
+    // Bytes of payload after the ICMP header, at least 20. Default is 56.
+    void SetPayloadSize(int size);
+
+    // Takes the send and receive times of probes from the kernel (SO_TIMESTAMPING
+    // and SO_TIMESTAMPNS) rather than around the system calls, so round trips
+    // do not include the time the process took to get scheduled.
+    // Times are taken in user space where the system does not support it. Default is on.
+    void SetKernelTimestamps(bool enabled)
+    {
+        mKernelTimestamps = enabled;
+    }
+
+    // Keeps a histogram of round trips per target. Default is off.
+    void SetTargetHistograms(bool enabled)
+    {
+        mTargetHistograms = enabled;
+    }
+
+    // Sends all the probes and waits for their replies.
+    // Returns false if the ICMP socket can not be opened.
+    bool Run();
+
+    // Statistics of the last run, in the order targets were added
+    const std::vector<PingResult>& GetResults() const
+    {
+        return mResults;
+    }
+
+    // Round trips of all the replies of the last run
+    const LatencyHistogram& GetHistogram() const
+    {
+        return mHistogram;
+    }
+
+    // Round trips per target, in the order of GetResults(); empty unless enabled
+    const std::vector<LatencyHistogram>& GetTargetHistograms() const
+    {
+        return mHistograms;
+    }
+
+private:
+    bool Open();
+    void Close();
+    // Sends probe number probe of target.
+    // Returns false if the socket buffer is full and it should be sent again later.
+    bool Send(size_t target, int probe);
+    // Reads the replies arrived
+    void Receive();
+    // Reads the send times reported by the kernel
+    void ReceiveSendTimes();
+
+private:
+    PingSweeper(const PingSweeper&);
+    PingSweeper& operator =(const PingSweeper&);
+
+private:
+    // Times of a sent probe: around the system call, and from the kernel if reported
+    struct SendTime
+    {
+        Int64 before;
+        Int64 after;
+        Int64 kernel;
+    };
+
+    int mSockfd;
+    // Datagram sockets carry ICMP without the IP header, the kernel sets the ID
+    bool mDatagram;
+    UInt16 mID;
+    // Tells the probes of this run from those of earlier ones
+    UInt32 mRunID;
+
+    int mCount;
+    Int64 mInterval;
+    Int64 mTimeout;
+    int mRate;
+    int mPayloadSize;
+    bool mKernelTimestamps;
+    bool mTargetHistograms;
+    // What the socket got of the kernel timestamps asked
+    bool mReceiveTimestamps;
+    bool mSendTimestamps;
+
+    std::vector<in_addr> mTargets;
+    std::vector<PingResult> mResults;
+    // Round trip of the last reply per target, for jitter, and the probes answered
+    std::vector<Int64> mLastRtt;
+    std::vector<bool> mAnswered;
+    UInt64 mReceived;
+    // The kernel numbers the sends it reports times of, these are the probes sent in order
+    std::vector<UInt32> mSendKeys;
+    std::vector<SendTime> mSendTimes;
+    LatencyHistogram mHistogram;
+    std::vector<LatencyHistogram> mHistograms;
+    std::vector<char> mPacket;
+};
+
+#endif // PingSweeper_INCLUDED
@@ -7,11 +7,15 @@
 #define PingUtilities_INCLUDED
 
 #include <string>
+#include "Types.h"
 
 class PingUtilities
 {
 public:
     static bool Ping(const std::string& target, int maxCount = 4);
+    // Same as above, rtt is set to the round trip in microseconds,
+    // measured with kernel timestamps where the system supports them.
+    static bool Ping(const std::string& target, int maxCount, Int64& rtt);
     static unsigned short CalChecksum(unsigned short* addr, unsigned int len);
 };
 
@@ -10,6 +10,9 @@
 #include <algorithm>
 #include <string.h>
 #include <iostream>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 
 Socket::Socket(int socketType)
 {
@@ -216,6 +219,194 @@ ErrorCode Socket::ConnectNB(const SocketAddress& address)
     return ret;
 }
 
+ErrorCode Socket::ConnectAny(const HostEntry& hostEntry, UInt16 port,
+        const Timespan& timeout, const Timespan& attemptDelay)
+{
+    const std::vector<IPAddress>& addresses = hostEntry.GetAddresses();
+    if (addresses.empty())
+    {
+        SetErrorCode(ErrorNetworkNoAddrFound);
+        return ErrorNetworkNoAddrFound;
+    }
+
+    // Interleave the address families, keeping the resolver's order within a family.
+    // The family of the first (preferred) address is tried first.
+    std::vector<IPAddress> preferred;
+    std::vector<IPAddress> others;
+    for (std::vector<IPAddress>::const_iterator it = addresses.begin();
+            it != addresses.end(); ++it)
+    {
+        if (it->GetFamily() == addresses[0].GetFamily())
+        {
+            preferred.push_back(*it);
+        }
+        else
+        {
+            others.push_back(*it);
+        }
+    }
+    std::vector<IPAddress> ordered;
+    for (size_t i = 0; i < preferred.size() || i < others.size(); i++)
+    {
+        if (i < preferred.size())
+        {
+            ordered.push_back(preferred[i]);
+        }
+        if (i < others.size())
+        {
+            ordered.push_back(others[i]);
+        }
+    }
+
+    Close();
+
+    std::vector<Socket*> attempts;
+    std::vector<pollfd> fds;
+    size_t next = 0;
+    ErrorCode ret = ErrorNetworkTimeout;
+    Timestamp start;
+    Timestamp nextAttempt = start;
+    Socket* winner = NULL;
+
+    while (winner == NULL)
+    {
+        Timestamp now;
+        Int64 remaining = timeout.GetTotalMicroseconds() - (now - start);
+        if (remaining <= 0)
+        {
+            break;
+        }
+
+        // Start the next attempt if it's time to, or nothing else is in flight
+        if (next < ordered.size() && (now >= nextAttempt || fds.empty()))
+        {
+            bool hasError = false;
+            SocketAddress address(ordered[next++], port, hasError);
+            if (hasError)
+            {
+                continue;
+            }
+
+            Socket* sock = new Socket(mSockType);
+            ErrorCode rc = sock->ConnectNB(address);
+            if (rc != ErrorOK)
+            {
+                // Failed immediately (e.g. no route), go for the next one
+                ret = rc;
+                delete sock;
+                continue;
+            }
+
+            attempts.push_back(sock);
+            pollfd pfd;
+            pfd.fd = sock->Sockfd();
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            fds.push_back(pfd);
+            nextAttempt = now + attemptDelay.GetTotalMicroseconds();
+        }
+
+        if (fds.empty())
+        {
+            // All addresses have failed
+            break;
+        }
+
+        // Wait until a connect completes, or it's time for the next attempt
+        Int64 wait = remaining;
+        if (next < ordered.size() && (nextAttempt - now) < wait)
+        {
+            wait = nextAttempt - now;
+        }
+        if (wait < 0)
+        {
+            wait = 0;
+        }
+
+        int rc = ::poll(&fds[0], fds.size(), int((wait + 999) / 1000));
+        if (rc < 0)
+        {
+            if (LastError() == SOCKET_ERROR_INTR)
+            {
+                continue;
+            }
+            ret = HandleError();
+            break;
+        }
+
+        for (size_t i = 0; i < fds.size() && winner == NULL;)
+        {
+            if (fds[i].revents == 0)
+            {
+                ++i;
+                continue;
+            }
+
+            int err = attempts[i]->GetSocketError();
+            if (err == 0)
+            {
+                winner = attempts[i];
+                attempts.erase(attempts.begin() + i);
+                break;
+            }
+
+            LOG(LogDebug, "Connect attempt failed: %s",
+                    attempts[i]->GetPeerAddress().ToString().c_str());
+            ret = HandleError(err);
+            delete attempts[i];
+            attempts.erase(attempts.begin() + i);
+            fds.erase(fds.begin() + i);
+            // Do not wait for the delay, start the next attempt at once
+            nextAttempt = Timestamp(0);
+        }
+    }
+
+    // Cancel the attempts still in flight
+    for (size_t i = 0; i < attempts.size(); i++)
+    {
+        delete attempts[i];
+    }
+
+    if (winner == NULL)
+    {
+        if (ret == ErrorNetworkTimeout)
+        {
+            LOG(LogError, "Connect timed out: %s", hostEntry.GetName().c_str());
+        }
+        SetErrorCode(ret);
+        return ret;
+    }
+
+    // Take over the connected descriptor
+    mSockfd = winner->mSockfd;
+    winner->mSockfd = INVALID_SOCKET_T;
+    delete winner;
+    SetBlocking(true);
+    SetErrorCode(ErrorOK);
+
+    return ErrorOK;
+}
+
+// Returns true if path is a local socket which no server accepts on any more:
+// connecting to it is refused. Anything else at path is left alone.
+static bool IsStaleLocalSocket(const SocketAddress& address, int socketType)
+{
+    struct stat st;
+    if (lstat(address.GetPath().c_str(), &st) != 0 || !S_ISSOCK(st.st_mode))
+    {
+        return false;
+    }
+
+    int fd = ::socket(AF_UNIX, socketType | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool refused = ::connect(fd, address.GetAddr(), address.GetLength()) != 0 && errno == ECONNREFUSED;
+    ::close(fd);
+    return refused;
+}
+
 ErrorCode Socket::Bind(const SocketAddress& address, bool reuseAddress)
 {
     ErrorCode ret = ErrorOK;
@@ -228,7 +419,19 @@ ErrorCode Socket::Bind(const SocketAddress& address, bool reuseAddress)
     {
         Init(address.GetAF());
     }
-    if (reuseAddress)
+    if (reuseAddress && address.IsLocal())
+    {
+        // A local socket file is left behind when its server exits,
+        // and binding to an existing path fails. Only a stale socket is removed:
+        // the bind fails with ErrorNetworkAddrInUse if a server still runs there
+        // or the path is not a socket.
+        std::string path = address.GetPath();
+        if (!path.empty() && path[0] != '@' && IsStaleLocalSocket(address, mSockType))
+        {
+            ::unlink(path.c_str());
+        }
+    }
+    else if (reuseAddress)
     {
         SetReuseAddress(true);
         SetReusePort(true);
@@ -334,6 +537,44 @@ int Socket::SendData(const void* buffer, int length, int flags)
     return sent;
 }
 
+Int64 Socket::SendFile(int fileFd, Int64& offset, Int64 count)
+{
+    // sendfile() transfers at most about 2GB at once
+    const Int64 MAX_CHUNK = 1 << 30;
+    bool blocking = GetBlocking();
+    Int64 sent = 0;
+    while (sent < count)
+    {
+        off_t off = offset;
+        ssize_t rc = sendfile(mSockfd, fileFd, &off, size_t(std::min(count - sent, MAX_CHUNK)));
+        if (rc < 0)
+        {
+            if (LastError() == SOCKET_ERROR_INTR)
+            {
+                continue;
+            }
+            if (sent > 0)
+            {
+                break;
+            }
+            HandleError();
+            return rc;
+        }
+        if (rc == 0)
+        {
+            // End of file
+            break;
+        }
+        offset = off;
+        sent += rc;
+        if (!blocking)
+        {
+            break;
+        }
+    }
+    return sent;
+}
+
 int Socket::ReceiveBytes(void* buffer, int length, int flags)
 {
     int rc;
@@ -537,6 +778,135 @@ int Socket::SendUrgent(unsigned char data)
     return rc;
 }
 
+int Socket::SendDescriptors(const int* fds, int count, const void* buffer, int length)
+{
+    if (count <= 0 || length <= 0)
+    {
+        SetErrorCode(ErrorInvalidArgument);
+        return -1;
+    }
+
+    iovec iov;
+    iov.iov_base = const_cast<void*>(buffer);
+    iov.iov_len = length;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * count), 0);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control[0];
+    msg.msg_controllen = control.size();
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    int rc;
+    do
+    {
+        rc = sendmsg(mSockfd, &msg, MSG_NOSIGNAL);
+    }
+    while (rc < 0 && LastError() == SOCKET_ERROR_INTR);
+
+    if (rc < 0)
+    {
+        HandleError();
+    }
+
+    return rc;
+}
+
+int Socket::ReceiveDescriptors(int* fds, int maxCount, int& count, void* buffer, int length)
+{
+    count = 0;
+    if (maxCount <= 0 || length <= 0)
+    {
+        SetErrorCode(ErrorInvalidArgument);
+        return -1;
+    }
+
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = length;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * maxCount), 0);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control[0];
+    msg.msg_controllen = control.size();
+
+    int rc;
+    do
+    {
+        rc = recvmsg(mSockfd, &msg, MSG_CMSG_CLOEXEC);
+    }
+    while (rc < 0 && LastError() == SOCKET_ERROR_INTR);
+
+    if (rc < 0)
+    {
+        if (LastError() == SOCKET_ERROR_AGAIN || LastError() == SOCKET_ERROR_TIMEDOUT)
+        {
+            SetErrorCode(ErrorNetworkTimeout);
+            return -1;
+        }
+        HandleError();
+        return rc;
+    }
+
+    // Descriptors which did not fit in the control buffer are closed by the kernel
+    if (msg.msg_flags & MSG_CTRUNC)
+    {
+        LOG(LogError, "Descriptors received are truncated to %d", maxCount);
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        {
+            continue;
+        }
+
+        int received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+        for (int i = 0; i < received; i++)
+        {
+            if (count < maxCount)
+            {
+                fds[count++] = data[i];
+            }
+            else
+            {
+                ::close(data[i]);
+            }
+        }
+    }
+
+    return rc;
+}
+
+ErrorCode Socket::CreatePair(Socket& first, Socket& second, int socketType)
+{
+    first.Close();
+    second.Close();
+
+    int fds[2];
+    if (socketpair(AF_UNIX, socketType | SOCK_CLOEXEC, 0, fds) != 0)
+    {
+        return first.HandleError();
+    }
+
+    first.mSockType = socketType;
+    first.Attach(fds[0]);
+    second.mSockType = socketType;
+    second.Attach(fds[1]);
+    return ErrorOK;
+}
+
 int Socket::Select(std::vector<Socket>& readList, std::vector<Socket>& writeList,
         std::vector<Socket>& exceptList, const Timespan& timeout)
 {
@@ -674,41 +1044,39 @@ int Socket::Select(std::vector<Socket>& readList, std::vector<Socket>& writeList
     return rc;
 }
 
-// Determines the status of the socket, using a call to select().
+// Determines the status of the socket, using a call to poll(),
+// which is not limited to descriptors below FD_SETSIZE.
 // The mode argument is constructed by combining the values
 // of the SelectMode enumeration.
 // Returns true if the next operation corresponding to
 // mode will not block, false otherwise.
 bool Socket::Poll(const Timespan& timeout, int mode)
 {
-    fd_set fdRead;
-    fd_set fdWrite;
-    fd_set fdExcept;
-    FD_ZERO(&fdRead);
-    FD_ZERO(&fdWrite);
-    FD_ZERO(&fdExcept);
+    pollfd pfd;
+    pfd.fd = mSockfd;
+    pfd.events = 0;
+    pfd.revents = 0;
     if (mode & SELECT_READ)
     {
-        FD_SET(mSockfd, &fdRead);
+        pfd.events |= POLLIN;
     }
     if (mode & SELECT_WRITE)
     {
-        FD_SET(mSockfd, &fdWrite);
+        pfd.events |= POLLOUT;
     }
     if (mode & SELECT_ERROR)
     {
-        FD_SET(mSockfd, &fdExcept);
+        pfd.events |= POLLPRI;
     }
 
     Timespan remainingTime(timeout);
     int rc;
     do
     {
-        timeval tv;
-        tv.tv_sec = (long)remainingTime.GetTotalSeconds();
-        tv.tv_usec = (long)remainingTime.GetUseconds();
+        // Round up, so that a sub-millisecond timeout does not become a busy poll
+        int ms = int((remainingTime.GetTotalMicroseconds() + 999) / 1000);
         Timestamp start;
-        rc = select(int(mSockfd) + 1, &fdRead, &fdWrite, &fdExcept, &tv);
+        rc = poll(&pfd, 1, ms);
         if (rc < 0 && LastError() == SOCKET_ERROR_INTR)
         {
             Timestamp end;
@@ -729,6 +1097,7 @@ bool Socket::Poll(const Timespan& timeout, int mode)
     {
         HandleError();
     }
+    // Like select(), a socket with a pending error or hung up counts as ready
     return (rc > 0);
 }
 
@@ -10,6 +10,7 @@
 #include "SocketDefs.h"
 #include "IPAddress.h"
 #include "SocketAddress.h"
+#include "HostEntry.h"
 #include "Timespan.h"
 #include "ErrorCodes.h"
 #include <vector>
@@ -94,10 +95,21 @@ public:
     // Prior to opening the connection the socket is set to nonblocking mode.
     virtual ErrorCode ConnectNB(const SocketAddress& address);
 
+    // Establishes a connection to the first reachable address of the host (Happy Eyeballs, RFC 8305).
+    // Non-blocking connects are started one by one, alternating IPv6/IPv4 addresses,
+    // the next one is started after attemptDelay or as soon as the previous one fails.
+    // The first established connection wins, the other attempts are closed.
+    // Gives up after timeout. Any socket previously initialized is closed first.
+    virtual ErrorCode ConnectAny(const HostEntry& hostEntry, UInt16 port,
+            const Timespan& timeout,
+            const Timespan& attemptDelay = Timespan(0, 250000));
+
     // Initializes and binds a local address to the socket.
     // This is usually only done when establishing a server socket.
     // TCP clients should not bind a socket to specific address.
     // If reuseAddress is true, sets the SO_REUSEADDR socket option.
+    // For a local (Unix domain) path, reuseAddress removes a stale socket file instead:
+    // one no server accepts on. Any other file at the path makes the bind fail.
     virtual ErrorCode Bind(const SocketAddress& address, bool reuseAddress = false);
 
     // Puts the socket into listening state.
@@ -123,6 +135,13 @@ public:
     // Returns the number of bytes sent, which may be less than the number of bytes specified.
     virtual int SendData(const void* buffer, int length, int flags = 0);
 
+    // Sends count bytes of the open file fileFd, starting at offset, through the
+    // stream socket with sendfile(), so the data is not copied to user space.
+    // offset is advanced past the bytes sent.
+    // Returns the number of bytes sent, which may be less than count at the end of the file
+    // or if the socket is non-blocking, or a negative value if nothing could be sent.
+    Int64 SendFile(int fileFd, Int64& offset, Int64 count);
+
     // Receives data from the socket and stores it
     // in buffer. Up to length bytes are received.
     // Returns the number of bytes received.
@@ -150,6 +169,22 @@ public:
     // The preferred way for a socket to receive urgent data is by enabling the SO_OOBINLINE option.
     virtual int SendUrgent(unsigned char data);
 
+    // Sends file descriptors through a local (Unix domain) socket (SCM_RIGHTS),
+    // together with the contents of buffer, which must hold at least one byte.
+    // The descriptors stay open in the sending process.
+    // Returns the number of bytes sent, or -1 on error.
+    int SendDescriptors(const int* fds, int count, const void* buffer, int length);
+
+    // Receives data and up to maxCount file descriptors from a local (Unix domain) socket.
+    // The received descriptors are close-on-exec, and owned by the caller.
+    // count returns the number of descriptors received, extra descriptors are discarded.
+    // Returns the number of bytes received, or -1 on error.
+    int ReceiveDescriptors(int* fds, int maxCount, int& count, void* buffer, int length);
+
+    // Creates a pair of connected local (Unix domain) sockets.
+    // Any socket previously initialized in first or second is closed first.
+    static ErrorCode CreatePair(Socket& first, Socket& second, int socketType = SOCK_STREAM);
+
     // Determines the status of one or more sockets, using a call to select().
     // ReadList contains the list of sockets which should be checked for readability.
     // WriteList contains the list of sockets which should be checked for write-ability.
@@ -165,10 +200,12 @@ public:
     // select() runs, select will return immediately. However,
     // the closed socket will not be included in any list.
     // In this case, the return value may be greater than the sum of all sockets in all list.
+    // select() cannot handle descriptors above FD_SETSIZE (1024),
+    // use SocketPoller to wait for many sockets.
     int Select(std::vector<Socket>& readList, std::vector<Socket>& writeList,
             std::vector<Socket>& exceptList, const Timespan& timeout);
 
-    // Determines the status of the socket, using a call to select().
+    // Determines the status of the socket, using a call to poll().
     // The mode argument is constructed by combining the values of the SelectMode enumeration.
     // Returns true if the next operation corresponding to mode will not block, false otherwise.
     bool Poll(const Timespan& timeout, int mode);
@@ -8,9 +8,9 @@
 #include "DNS.h"
 #include "RefCountedObject.h"
 #include "NumberParser.h"
-#include "NumberFormatter.h"
 #include <algorithm>
 #include <cstring>
+#include <cstddef>
 #include <assert.h>
 
 // SocketAddressImpl
@@ -139,6 +139,60 @@ private:
     sockaddr_in6 mAddr;
 };
 
+class LocalSocketAddressImpl: public SocketAddressImpl
+{
+public:
+    // The path is copied as is, a leading '\0' makes it an abstract name.
+    LocalSocketAddressImpl(const char* path, std::size_t length)
+    {
+        std::memset(&mAddr, 0, sizeof(mAddr));
+        mAddr.sun_family = AF_UNIX;
+        std::memcpy(mAddr.sun_path, path, length);
+        mLength = offsetof(sockaddr_un, sun_path) + length;
+        if (length > 0 && path[0] != '\0')
+        {
+            // Count the terminating null of a file system path, like SUN_LEN()
+            mLength++;
+        }
+    }
+
+    LocalSocketAddressImpl(const sockaddr_un* addr, SOCKET_LENGTH_t length)
+    {
+        std::memset(&mAddr, 0, sizeof(mAddr));
+        std::memcpy(&mAddr, addr, length);
+        mLength = length;
+    }
+
+    bool GetHost(IPAddress& ipAddr) const
+    {
+        return false;
+    }
+
+    UInt16 GetPort() const
+    {
+        return 0;
+    }
+
+    SOCKET_LENGTH_t GetLength() const
+    {
+        return mLength;
+    }
+
+    const sockaddr* GetAddr() const
+    {
+        return reinterpret_cast<const sockaddr*>(&mAddr);
+    }
+
+    int GetAF() const
+    {
+        return mAddr.sun_family;
+    }
+
+private:
+    sockaddr_un mAddr;
+    SOCKET_LENGTH_t mLength;
+};
+
 // SocketAddress
 SocketAddress::SocketAddress() : mImpl(NULL)
 {
@@ -167,11 +221,19 @@ SocketAddress::SocketAddress(const std::string& addr, const std::string& port,
 SocketAddress::SocketAddress(const std::string& hostAndPort, bool& hasError) : mImpl(NULL)
 {
     hasError = false;
+    IPAddress ip;
+    UInt16 number;
+    if (Parse(hostAndPort.data(), hostAndPort.size(), ip, number))
+    {
+        hasError = !Init(ip, number);
+        return;
+    }
+
     std::string host;
     std::string port;
     std::string::const_iterator it = hostAndPort.begin();
     std::string::const_iterator end = hostAndPort.end();
-    if (*it == '[')
+    if (it != end && *it == '[')
     {
         ++it;
         while (it != end && *it != ']')
@@ -212,6 +274,29 @@ SocketAddress::SocketAddress(const std::string& hostAndPort, bool& hasError) : m
     hasError = !ret;
 }
 
+SocketAddress::SocketAddress(LocalTag tag, const std::string& path, bool& hasError) : mImpl(NULL)
+{
+    hasError = false;
+    // One byte is kept for the terminating null of file system paths
+    if (path.empty() || path.size() >= sizeof(((sockaddr_un*)0)->sun_path))
+    {
+        hasError = true;
+        assert("Invalid local socket path");
+        return;
+    }
+
+    if (path[0] == '@')
+    {
+        std::string name(path);
+        name[0] = '\0';
+        mImpl = new LocalSocketAddressImpl(name.data(), name.size());
+    }
+    else
+    {
+        mImpl = new LocalSocketAddressImpl(path.data(), path.size());
+    }
+}
+
 SocketAddress::SocketAddress(const SocketAddress& addr) : mImpl(NULL)
 {
     mImpl = addr.mImpl;
@@ -225,7 +310,14 @@ SocketAddress::SocketAddress(const sockaddr* addr,
         SOCKET_LENGTH_t length, bool& hasError) : mImpl(NULL)
 {
     hasError = false;
-    if (length == sizeof(sockaddr_in))
+    if (length >= SOCKET_LENGTH_t(sizeof(sa_family_t)) && addr->sa_family == AF_UNIX &&
+            length <= SOCKET_LENGTH_t(sizeof(sockaddr_un)))
+    {
+        // Unnamed local sockets (e.g. the client of an accepted connection)
+        // have an address made of the family only
+        mImpl = new LocalSocketAddressImpl(reinterpret_cast<const sockaddr_un*>(addr), length);
+    }
+    else if (length == sizeof(sockaddr_in))
     {
         mImpl = new IPv4SocketAddressImpl(reinterpret_cast<const sockaddr_in*>(addr));
     }
@@ -309,30 +401,135 @@ int SocketAddress::GetAF() const
     return mImpl->GetAF();
 }
 
+std::string SocketAddress::GetPath() const
+{
+    if (!IsLocal())
+    {
+        return "";
+    }
+
+    if (GetLength() <= offsetof(sockaddr_un, sun_path))
+    {
+        return "";
+    }
+
+    const sockaddr_un* addr = reinterpret_cast<const sockaddr_un*>(GetAddr());
+    std::size_t length = GetLength() - offsetof(sockaddr_un, sun_path);
+
+    if (addr->sun_path[0] == '\0')
+    {
+        // Abstract name, which is not null terminated and may contain nulls
+        return "@" + std::string(addr->sun_path + 1, length - 1);
+    }
+
+    return std::string(addr->sun_path, strnlen(addr->sun_path, length));
+}
+
 std::string SocketAddress::ToString() const
 {
-    std::string result;
-    bool ret = true;
+    if (IsLocal())
+    {
+        return GetPath();
+    }
+
+    char buffer[MAX_STRING_LENGTH];
+    return std::string(buffer, Format(buffer, sizeof(buffer)));
+}
+
+bool SocketAddress::Parse(const char* text, size_t length, IPAddress& host, UInt16& port)
+{
+    const char* end = text + length;
+    const char* colon;
+    IPAddress ip;
+    if (length > 0 && text[0] == '[')
+    {
+        const char* close = static_cast<const char*>(memchr(text, ']', length));
+        if (close == NULL || close + 1 == end || close[1] != ':' ||
+                !IPAddress::Parse(text + 1, close - text - 1, ip) ||
+                ip.GetFamily() != IPAddress::IPv6)
+        {
+            return false;
+        }
+        colon = close + 1;
+    }
+    else
+    {
+        // An IPv6 address needs brackets, so the first colon ends the address
+        colon = static_cast<const char*>(memchr(text, ':', length));
+        if (colon == NULL || !IPAddress::Parse(text, colon - text, ip) ||
+                ip.GetFamily() != IPAddress::IPv4)
+        {
+            return false;
+        }
+    }
+
+    const char* p = colon + 1;
+    if (p == end || end - p > 5)
+    {
+        return false;
+    }
+    unsigned int value = 0;
+    for (; p < end; p++)
+    {
+        if (*p < '0' || *p > '9')
+        {
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+    }
+    if (value > 0xFFFF)
+    {
+        return false;
+    }
+    host = ip;
+    port = UInt16(value);
+    return true;
+}
+
+size_t SocketAddress::Format(char* buffer, size_t size) const
+{
     IPAddress ipAddr;
-    ret = GetHost(ipAddr);
-    if(!ret)
+    if (!GetHost(ipAddr))
     {
-        return "";
+        return 0;
+    }
+
+    char text[MAX_STRING_LENGTH];
+    char* p = text;
+    bool bracket = ipAddr.GetFamily() == IPAddress::IPv6;
+    if (bracket)
+    {
+        *p++ = '[';
+    }
+    p += ipAddr.Format(p, IPAddress::MAX_STRING_LENGTH);
+    if (bracket)
+    {
+        *p++ = ']';
     }
+    *p++ = ':';
 
-    if (ipAddr.GetFamily() == IPAddress::IPv6)
+    char digits[5];
+    int count = 0;
+    unsigned int port = GetPort();
+    do
     {
-        result.append("[");
+        digits[count++] = char('0' + port % 10);
+        port /= 10;
+    }
+    while (port != 0);
+    while (count > 0)
+    {
+        *p++ = digits[--count];
     }
-    result.append(ipAddr.ToString());
 
-    if (ipAddr.GetFamily() == IPAddress::IPv6)
+    size_t length = p - text;
+    if (length >= size)
     {
-        result.append("]");
+        return 0;
     }
-    result.append(":");
-    NumberFormatter::Append(result, GetPort());
-    return result;
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    return length;
 }
 
 bool SocketAddress::Init(const IPAddress& host, UInt16 port)
@@ -15,9 +15,16 @@ class SocketAddressImpl;
 // This class represents an internet (IP) endpoint/socket address.
 // The address can belong either to the IPv4 or the IPv6 address family
 // and consists of a host address and a port number.
+// It can also be a local (Unix domain, AF_UNIX) address, which consists of a path only.
 class SocketAddress
 {
 public:
+    // Tag selecting the local (Unix domain) address constructor.
+    enum LocalTag
+    {
+        Local
+    };
+
     // Creates a wild card (all zero) IPv4 SocketAddress.
     SocketAddress();
 
@@ -44,6 +51,13 @@ public:
     //     www.appinf.com:8080
     explicit SocketAddress(const std::string& hostAndPort, bool& hasError);
 
+    // Creates a local (Unix domain) SocketAddress from a file system path.
+    // A path starting with '@' denotes a name in the Linux abstract namespace,
+    // which has no file system entry and goes away with the last socket using it.
+    // Example:
+    //     SocketAddress addr(SocketAddress::Local, "/run/app.sock", hasError);
+    SocketAddress(LocalTag tag, const std::string& path, bool& hasError);
+
     // Creates a SocketAddress by copying another one.
     SocketAddress(const SocketAddress& addr);
 
@@ -68,13 +82,35 @@ public:
     // Returns a pointer to the internal native socket address.
     const sockaddr* GetAddr() const;
 
-    // Returns the address family (AF_INET or AF_INET6) of the address.
+    // Returns the address family (AF_INET, AF_INET6 or AF_UNIX) of the address.
     int GetAF() const;
 
+    // Returns true if this is a local (Unix domain) address.
+    bool IsLocal() const
+    {
+        return GetAF() == AF_UNIX;
+    }
+
+    // Returns the path of a local address, with a leading '@' for abstract names.
+    // Returns an empty string for unnamed local addresses and for IP addresses.
+    std::string GetPath() const;
+
     // Returns a string representation of the address.
+    // For local addresses, this is the path.
     std::string ToString() const;
 
+    // Parses a numeric "address:port" or "[IPv6 address]:port" from the length chars
+    // of text, without allocating or resolving. Returns false for host names,
+    // service names and forms IPAddress::Parse(text, length, result) refuses.
+    static bool Parse(const char* text, size_t length, IPAddress& host, UInt16& port);
+
+    // Writes the address as ToString() does, null terminated, to buffer, without allocating.
+    // Returns the length written, or 0 if size is too small or this is a local address.
+    // MAX_STRING_LENGTH is enough.
+    size_t Format(char* buffer, size_t size) const;
+
     // Returns the address family of the host's address.
+    // Only meaningful for IP addresses.
     IPAddress::IPFamily GetFamily() const
     {
         IPAddress ipAddr;
@@ -85,7 +121,10 @@ public:
     // Maximum length in bytes of a socket address.
     enum
     {
-        MAX_ADDRESS_LENGTH = sizeof(sockaddr_in6) //sizeof(struct sockaddr_in)
+        // sockaddr_un is the largest one, sockaddr_in6 or sockaddr_in are smaller
+        MAX_ADDRESS_LENGTH = sizeof(sockaddr_un),
+        // Brackets, ':' and 5 port digits around the address
+        MAX_STRING_LENGTH = IPAddress::MAX_STRING_LENGTH + 8
     };
 
 protected:
@@ -63,6 +63,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/select.h>
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////
+// SocketPoller.cpp
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "SocketPoller.h"
+#include "Log.h"
+#include <errno.h>
+#include <time.h>
+
+SocketPoller::SocketPoller()
+{
+}
+
+SocketPoller::~SocketPoller()
+{
+}
+
+int SocketPoller::Add(Socket* sock, int mode)
+{
+    pollfd pfd;
+    pfd.fd = sock->Sockfd();
+    pfd.events = ToPollEvents(mode);
+    pfd.revents = 0;
+    mPollFds.push_back(pfd);
+    mSockets.push_back(sock);
+    return int(mSockets.size()) - 1;
+}
+
+void SocketPoller::Remove(int index)
+{
+    if (index < 0 || index >= int(mSockets.size()))
+    {
+        return;
+    }
+
+    mPollFds[index] = mPollFds.back();
+    mPollFds.pop_back();
+    mSockets[index] = mSockets.back();
+    mSockets.pop_back();
+}
+
+bool SocketPoller::Remove(Socket* sock)
+{
+    for (size_t i = 0; i < mSockets.size(); i++)
+    {
+        if (mSockets[i] == sock)
+        {
+            Remove(int(i));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SocketPoller::Clear()
+{
+    mPollFds.clear();
+    mSockets.clear();
+}
+
+void SocketPoller::SetMode(int index, int mode)
+{
+    mPollFds[index].events = ToPollEvents(mode);
+}
+
+int SocketPoller::GetReady(int index) const
+{
+    short revents = mPollFds[index].revents;
+    int mode = 0;
+    if (revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        mode |= Socket::SELECT_READ;
+    }
+    if (revents & POLLOUT)
+    {
+        mode |= Socket::SELECT_WRITE;
+    }
+    if (revents & (POLLPRI | POLLERR | POLLHUP | POLLNVAL))
+    {
+        mode |= Socket::SELECT_ERROR;
+    }
+
+    return mode;
+}
+
+int SocketPoller::Poll(const Timespan& timeout)
+{
+    if (timeout < 0)
+    {
+        return PollNanoseconds(-1);
+    }
+
+    return PollNanoseconds(timeout.GetTotalMicroseconds() * 1000);
+}
+
+int SocketPoller::PollNanoseconds(Int64 timeout)
+{
+    // Sockets may have been (re)connected or closed since they were added
+    for (size_t i = 0; i < mPollFds.size(); i++)
+    {
+        SOCKET_t fd = mSockets[i]->Sockfd();
+        // A negative descriptor is ignored by poll()
+        mPollFds[i].fd = (fd == INVALID_SOCKET_T || mPollFds[i].events == 0) ? -1 : fd;
+        mPollFds[i].revents = 0;
+    }
+
+    timespec deadline;
+    if (timeout >= 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        Int64 ns = Int64(deadline.tv_nsec) + timeout;
+        deadline.tv_sec += time_t(ns / 1000000000);
+        deadline.tv_nsec = long(ns % 1000000000);
+    }
+
+    int rc;
+    for (;;)
+    {
+        timespec remaining;
+        timespec* ts = NULL;
+        if (timeout >= 0)
+        {
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            Int64 ns = Int64(deadline.tv_sec - now.tv_sec) * 1000000000 +
+                    (deadline.tv_nsec - now.tv_nsec);
+            if (ns < 0)
+            {
+                ns = 0;
+            }
+            remaining.tv_sec = time_t(ns / 1000000000);
+            remaining.tv_nsec = long(ns % 1000000000);
+            ts = &remaining;
+        }
+
+        rc = ppoll(mPollFds.empty() ? NULL : &mPollFds[0], mPollFds.size(), ts, NULL);
+        if (rc >= 0 || errno != EINTR)
+        {
+            break;
+        }
+    }
+
+    if (rc < 0)
+    {
+        LOG(LogError, "Failed to poll %d sockets: %d", int(mPollFds.size()), errno);
+    }
+
+    return rc;
+}
+
+short SocketPoller::ToPollEvents(int mode)
+{
+    short events = 0;
+    if (mode & Socket::SELECT_READ)
+    {
+        events |= POLLIN;
+    }
+    if (mode & Socket::SELECT_WRITE)
+    {
+        events |= POLLOUT;
+    }
+    if (mode & Socket::SELECT_ERROR)
+    {
+        events |= POLLPRI;
+    }
+
+    return events;
+}
@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////////
+// SocketPoller.h
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef SocketPoller_INCLUDED
+#define SocketPoller_INCLUDED
+
+#include <vector>
+#include <poll.h>
+#include "Types.h"
+#include "Socket.h"
+#include "Timespan.h"
+
+// Waits for the readiness of many sockets at once, using poll()/ppoll().
+// Unlike Socket::Select(), descriptors are not limited by FD_SETSIZE,
+// the cost does not depend on the highest descriptor, and sockets are not copied:
+// the poller keeps pointers to them, which must stay valid while they are added.
+// The entry array is kept between calls, so a poller is set up once and polled repeatedly.
+// Results are returned in place: after Poll(), GetReady(index) tells the ready modes of each entry.
+// Modes are combinations of Socket::SelectMode values.
+// A SocketPoller is not thread-safe.
+class SocketPoller
+{
+public:
+    SocketPoller();
+    ~SocketPoller();
+
+    // Adds a socket to wait for, with the modes to wait for.
+    // Returns the index of the entry, which stays valid until an entry is removed.
+    int Add(Socket* sock, int mode);
+
+    // Removes the entry at index. The last entry is moved to index.
+    void Remove(int index);
+
+    // Removes the entry of the socket, returns false if not found.
+    bool Remove(Socket* sock);
+
+    // Removes all the entries.
+    void Clear();
+
+    // Changes the modes to wait for of the entry at index.
+    // A zero mode keeps the entry, but it is skipped by Poll().
+    void SetMode(int index, int mode);
+
+    int GetCount() const
+    {
+        return int(mSockets.size());
+    }
+
+    Socket* GetSocket(int index) const
+    {
+        return mSockets[index];
+    }
+
+    // Returns the modes the entry at index was found ready for by the last Poll().
+    // A socket with a pending error or hung up is reported as SELECT_ERROR and SELECT_READ,
+    // the following read returns the error or end of stream.
+    int GetReady(int index) const;
+
+    // Waits up to timeout for at least one entry to become ready.
+    // A negative timeout waits forever, a zero one only checks the current state.
+    // Returns the number of ready entries, 0 on timeout, or -1 on error.
+    int Poll(const Timespan& timeout);
+
+    // Same as Poll(), with the timeout in nanoseconds.
+    int PollNanoseconds(Int64 timeout);
+
+private:
+    SocketPoller(const SocketPoller&);
+    SocketPoller& operator =(const SocketPoller&);
+
+    static short ToPollEvents(int mode);
+
+private:
+    // Parallel arrays, pollfd entries are handed to the kernel as is
+    std::vector<pollfd> mPollFds;
+    std::vector<Socket*> mSockets;
+};
+
+#endif // SocketPoller_INCLUDED
@@ -4,6 +4,7 @@
  */
 
 #include "RESTEndPoint.h"
+#include <cstring>
 
 EndPointHandler EndPointHandler::mDefaultHandler;
 
@@ -72,7 +73,179 @@ const std::list<std::string> &EndPointHandler::GetAllowedMethods() const
     return mAllowedMethod;
 }
 
-EndPoint::EndPoint(const EndPointHandler &handler) : mEpHandler(handler)
+EndPointMetrics::Request::Request(EndPointMetrics &metrics, Method method) :
+        mMetrics(metrics), mMethod(method), mStatus(500)
+{
+    mMetrics.Begin();
+}
+
+EndPointMetrics::Request::~Request()
+{
+    mMetrics.End(mMethod, mStatus, mStart.GetElapsed());
+}
+
+EndPointMetrics::EndPointMetrics(const std::list<std::string> &methods)
+{
+    memset(mShards, 0, sizeof(mShards));
+    for (int method = 0; method < METHOD_COUNT; method++)
+    {
+        bool allowed = false;
+        for (std::list<std::string>::const_iterator citer = methods.begin();
+                citer != methods.end();
+                citer++)
+        {
+            if (*citer == GetMethodName(Method(method)))
+            {
+                allowed = true;
+            }
+        }
+        if (!allowed)
+        {
+            continue;
+        }
+
+        for (int shard = 0; shard < SHARDS; shard++)
+        {
+            mShards[shard].methods[method] = new Stats();
+        }
+    }
+}
+
+EndPointMetrics::~EndPointMetrics()
+{
+    for (int shard = 0; shard < SHARDS; shard++)
+    {
+        for (int method = 0; method < METHOD_COUNT; method++)
+        {
+            delete mShards[shard].methods[method];
+        }
+    }
+}
+
+int EndPointMetrics::GetShard()
+{
+    // Threads are given shards in turn the first time they record
+    static int nextShard = 0;
+    static __thread int shard = -1;
+    if (shard < 0)
+    {
+        shard = __sync_fetch_and_add(&nextShard, 1) % SHARDS;
+    }
+    return shard;
+}
+
+void EndPointMetrics::Begin()
+{
+    __sync_fetch_and_add(&mShards[GetShard()].inFlight, 1);
+}
+
+void EndPointMetrics::End(Method method, int status, Int64 microseconds)
+{
+    // Ended on the shard it began on, as the thread is the same
+    Shard &shard = mShards[GetShard()];
+    __sync_fetch_and_sub(&shard.inFlight, 1);
+    Stats *stats = shard.methods[method];
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    if (status < 0 || status >= MAX_STATUS)
+    {
+        status = 0;
+    }
+    if (microseconds < 0)
+    {
+        microseconds = 0;
+    }
+    // Atomic, as more threads than shards may share one
+    __sync_fetch_and_add(&stats->latencies[LatencyHistogram::GetBucket(microseconds)], 1);
+    __sync_fetch_and_add(&stats->statuses[status], 1);
+    __sync_fetch_and_add(&stats->totalMicroseconds, UInt64(microseconds));
+}
+
+Int64 EndPointMetrics::GetInFlight() const
+{
+    Int64 inFlight = 0;
+    for (int shard = 0; shard < SHARDS; shard++)
+    {
+        inFlight += mShards[shard].inFlight;
+    }
+    return inFlight;
+}
+
+UInt64 EndPointMetrics::GetCount(Method method) const
+{
+    UInt64 count = 0;
+    for (int shard = 0; shard < SHARDS; shard++)
+    {
+        const Stats *stats = mShards[shard].methods[method];
+        for (int status = 0; stats && status < MAX_STATUS; status++)
+        {
+            count += stats->statuses[status];
+        }
+    }
+    return count;
+}
+
+void EndPointMetrics::GetStatusCounts(Method method,
+        std::vector<std::pair<int, UInt64> > &counts) const
+{
+    counts.clear();
+    for (int status = 0; status < MAX_STATUS; status++)
+    {
+        UInt64 count = 0;
+        for (int shard = 0; shard < SHARDS; shard++)
+        {
+            const Stats *stats = mShards[shard].methods[method];
+            count += stats ? stats->statuses[status] : 0;
+        }
+        if (count != 0)
+        {
+            counts.push_back(std::make_pair(status, count));
+        }
+    }
+}
+
+void EndPointMetrics::GetLatencies(Method method, UInt64 counts[LatencyHistogram::BUCKETS]) const
+{
+    // Not through a LatencyHistogram, its 32 bit counts would wrap
+    for (int bucket = 0; bucket < LatencyHistogram::BUCKETS; bucket++)
+    {
+        counts[bucket] = 0;
+    }
+    for (int shard = 0; shard < SHARDS; shard++)
+    {
+        const Stats *stats = mShards[shard].methods[method];
+        for (int bucket = 0; stats && bucket < LatencyHistogram::BUCKETS; bucket++)
+        {
+            counts[bucket] += stats->latencies[bucket];
+        }
+    }
+}
+
+UInt64 EndPointMetrics::GetTotalMicroseconds(Method method) const
+{
+    UInt64 total = 0;
+    for (int shard = 0; shard < SHARDS; shard++)
+    {
+        const Stats *stats = mShards[shard].methods[method];
+        total += stats ? stats->totalMicroseconds : 0;
+    }
+    return total;
+}
+
+const char *EndPointMetrics::GetMethodName(Method method)
+{
+    static const char *NAMES[METHOD_COUNT] =
+    {
+        "GET", "POST", "PUT", "DELETE", "HEAD", "TRACE", "OPTIONS", "CONNECT"
+    };
+    return NAMES[method];
+}
+
+EndPoint::EndPoint(const EndPointHandler &handler) : mEpHandler(handler),
+        mMetrics(handler.GetAllowedMethods())
 {
     // Configure allowed Methods
     disallow_all();
@@ -95,12 +268,17 @@ void EndPoint::SetValidators(const std::list<EndPointValidator *> &validators)
 }
 
 #define RENDER_TEMPLET(method) \
+EndPointMetrics::Request metricsRequest(mMetrics, EndPointMetrics::METHOD_##method);\
 http_response_builder failedResp("");\
 if (!Validate(req, *this, failedResp)) \
 {\
-    return failedResp;\
+    const http_response resp = failedResp;\
+    metricsRequest.SetStatus(resp.get_response_code());\
+    return resp;\
 }\
-return mEpHandler.handle_##method(req, *this);
+const http_response resp = mEpHandler.handle_##method(req, *this);\
+metricsRequest.SetStatus(resp.get_response_code());\
+return resp;
 
 const http_response EndPoint::render_GET(const http_request& req)
 {
@@ -8,7 +8,11 @@
 
 #include <list>
 #include <string>
+#include <vector>
 #include <httpserver.hpp>
+#include "Types.h"
+#include "Timestamp.h"
+#include "LatencyHistogram.h"
 using namespace httpserver; // Fix me: use namespace in header file is not good
 
 class EndPoint;
@@ -49,6 +53,98 @@ public:
             http_response_builder& failedResp) const = 0;
 };
 
+// Request counts, status codes, requests in flight and latency histograms of an EndPoint,
+// per method. Each thread records into one of SHARDS shards, so threads handling requests
+// do not share counters; they are summed when read. Recording takes no lock.
+// Only the methods allowed when the EndPoint is created are recorded.
+class EndPointMetrics
+{
+public:
+    enum Method
+    {
+        METHOD_GET, METHOD_POST, METHOD_PUT, METHOD_DELETE,
+        METHOD_HEAD, METHOD_TRACE, METHOD_OPTIONS, METHOD_CONNECT,
+        METHOD_COUNT
+    };
+
+    enum
+    {
+        SHARDS = 16,
+        // Status codes are counted from 0 to 599, others as 0
+        MAX_STATUS = 600
+    };
+
+    // Records a request from its creation to its destruction,
+    // with status 500 if SetStatus() is not called (the handler threw).
+    class Request
+    {
+    public:
+        Request(EndPointMetrics &metrics, Method method);
+        ~Request();
+
+        void SetStatus(int status)
+        {
+            mStatus = status;
+        }
+
+    private:
+        EndPointMetrics &mMetrics;
+        Method mMethod;
+        int mStatus;
+        Timestamp mStart;
+    };
+
+    explicit EndPointMetrics(const std::list<std::string> &methods);
+    ~EndPointMetrics();
+
+    bool IsRecorded(Method method) const
+    {
+        return mShards[0].methods[method] != NULL;
+    }
+
+    Int64 GetInFlight() const;
+    UInt64 GetCount(Method method) const;
+
+    // Lists the status codes answered, with their counts
+    void GetStatusCounts(Method method, std::vector<std::pair<int, UInt64> > &counts) const;
+
+    // Sums the latency counts of all shards, by LatencyHistogram bucket
+    void GetLatencies(Method method, UInt64 counts[LatencyHistogram::BUCKETS]) const;
+
+    UInt64 GetTotalMicroseconds(Method method) const;
+
+    static const char *GetMethodName(Method method);
+
+private:
+    struct Stats
+    {
+        UInt64 latencies[LatencyHistogram::BUCKETS];
+        UInt64 statuses[MAX_STATUS];
+        UInt64 totalMicroseconds;
+    };
+
+    struct Shard
+    {
+        Stats *methods[METHOD_COUNT];
+        Int64 inFlight;
+        // Keeps the in flight counters of shards on their own cache lines
+        char padding[64];
+    };
+
+    void Begin();
+    void End(Method method, int status, Int64 microseconds);
+
+    // The shard of the calling thread
+    static int GetShard();
+
+private:
+    EndPointMetrics(const EndPointMetrics &);
+    EndPointMetrics &operator =(const EndPointMetrics &);
+
+private:
+    Shard mShards[SHARDS];
+};
+
 class EndPoint : public http_resource
 {
 public:
@@ -58,6 +154,11 @@ public:
 
     void SetValidators(const std::list<EndPointValidator *> &validators);
 
+    const EndPointMetrics &GetMetrics() const
+    {
+        return mMetrics;
+    }
+
 private:
     virtual const http_response render_GET(const http_request& req);
     virtual const http_response render_POST(const http_request& req);
@@ -74,6 +175,7 @@ private:
 private:
     const EndPointHandler &mEpHandler;
     std::list<EndPointValidator *> mEpValidators;
+    EndPointMetrics mMetrics;
 };
 
 #endif /* ENDPOINT_H_ */
@@ -5,11 +5,65 @@
 
 #include "RESTServer.h"
 #include "SocketAddress.h"
+#include "NumberFormatter.h"
+#include <unistd.h>
 
 using namespace httpserver;
 
+// Upper bounds of the latency histogram buckets exported, in microseconds and as labels
+static const Int64 METRICS_BUCKETS[] =
+{
+    500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000
+};
+static const char *METRICS_BUCKET_LABELS[] =
+{
+    "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5",
+    "1", "2.5", "5", "10"
+};
+static const int METRICS_BUCKET_COUNT = sizeof(METRICS_BUCKETS) / sizeof(METRICS_BUCKETS[0]);
+
+// Escapes a label value: backslash, double quote and line feed
+static std::string EscapeLabel(const std::string &value)
+{
+    std::string result;
+    for (std::string::size_type i = 0; i < value.size(); i++)
+    {
+        switch (value[i])
+        {
+        case '\\':
+            result += "\\\\";
+            break;
+        case '"':
+            result += "\\\"";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        default:
+            result += value[i];
+            break;
+        }
+    }
+    return result;
+}
+
+MetricsEndPointHandler::MetricsEndPointHandler(const RESTServer &server) : mServer(server)
+{
+    AddAllowedMethod("GET");
+}
+
+const http_response MetricsEndPointHandler::handle_GET(const http_request &req, const EndPoint &ep) const
+{
+    return http_response_builder(mServer.GetMetrics(), 200,
+            "text/plain; version=0.0.4").string_response();
+}
+
 RESTServer::RESTServer(int port, const std::string &ip) :
-        mPort(port), mIp(ip), mSockAddr(NULL), mServerImpl(NULL)
+        mPort(port), mIp(ip), mThreadingModel(ThreadPool), mThreads(0),
+        mMaxConnections(0), mPerIPConnections(0), mConnectionTimeout(180),
+        mListenBacklog(1024), mMetricsHandler(*this),
+        mServerImpl(NULL)
 {
     //;
 }
@@ -21,11 +75,6 @@ RESTServer::~RESTServer()
         delete mServerImpl;
     }
 
-    if (mSockAddr)
-    {
-        delete mSockAddr;
-    }
-
     for (std::map<std::string, EndPoint *>::iterator iter = mEndPoints.begin();
             iter != mEndPoints.end(); iter++)
     {
@@ -37,53 +86,196 @@ RESTServer::~RESTServer()
     }
 }
 
-bool RESTServer::Start()
+void RESTServer::SetThreadingModel(ThreadingModel model, int threads)
+{
+    mThreadingModel = model;
+    mThreads = threads > 0 ? threads : 0;
+}
+
+void RESTServer::SetConnectionLimits(int maxConnections, int perIPConnections)
+{
+    mMaxConnections = maxConnections > 0 ? maxConnections : 0;
+    mPerIPConnections = perIPConnections > 0 ? perIPConnections : 0;
+}
+
+void RESTServer::SetConnectionTimeout(int seconds)
+{
+    mConnectionTimeout = seconds > 0 ? seconds : 0;
+}
+
+void RESTServer::SetListenBacklog(int backlog)
 {
-    // Construct mSockAddr
-    if (mSockAddr)
+    mListenBacklog = backlog > 0 ? backlog : SOMAXCONN;
+}
+
+void RESTServer::SetMetricsPath(const std::string &path)
+{
+    mMetricsPath = path;
+}
+
+std::string RESTServer::GetMetrics() const
+{
+    std::string result;
+    result += "# HELP rest_requests_total Requests answered, by resource, method and status code.\n"
+            "# TYPE rest_requests_total counter\n";
+    for (std::map<std::string, EndPoint *>::const_iterator iter = mEndPoints.begin();
+            iter != mEndPoints.end(); iter++)
+    {
+        const EndPointMetrics &metrics = iter->second->GetMetrics();
+        for (int method = 0; method < EndPointMetrics::METHOD_COUNT; method++)
+        {
+            EndPointMetrics::Method m = EndPointMetrics::Method(method);
+            std::vector<std::pair<int, UInt64> > counts;
+            metrics.GetStatusCounts(m, counts);
+            for (size_t i = 0; i < counts.size(); i++)
+            {
+                result += "rest_requests_total{resource=\"" + EscapeLabel(iter->first) +
+                        "\",method=\"" + EndPointMetrics::GetMethodName(m) + "\",code=\"";
+                NumberFormatter::Append(result, counts[i].first);
+                result += "\"} ";
+                NumberFormatter::Append(result, counts[i].second);
+                result += "\n";
+            }
+        }
+    }
+
+    result += "# HELP rest_requests_in_flight Requests being handled, by resource.\n"
+            "# TYPE rest_requests_in_flight gauge\n";
+    for (std::map<std::string, EndPoint *>::const_iterator iter = mEndPoints.begin();
+            iter != mEndPoints.end(); iter++)
     {
-        delete mSockAddr;
-        mSockAddr = NULL;
+        result += "rest_requests_in_flight{resource=\"" + EscapeLabel(iter->first) + "\"} ";
+        NumberFormatter::Append(result, iter->second->GetMetrics().GetInFlight());
+        result += "\n";
     }
 
-    bool hasError = false;
-    SocketAddress sa(mIp, mPort, hasError);
-    if (!hasError && (mSockAddr = new sockaddr()))
+    result += "# HELP rest_request_duration_seconds Time to handle requests, by resource and method.\n"
+            "# TYPE rest_request_duration_seconds histogram\n";
+    for (std::map<std::string, EndPoint *>::const_iterator iter = mEndPoints.begin();
+            iter != mEndPoints.end(); iter++)
     {
-        memcpy(mSockAddr, sa.GetAddr(), sizeof(sockaddr));
+        const EndPointMetrics &metrics = iter->second->GetMetrics();
+        for (int method = 0; method < EndPointMetrics::METHOD_COUNT; method++)
+        {
+            EndPointMetrics::Method m = EndPointMetrics::Method(method);
+            if (!metrics.IsRecorded(m))
+            {
+                continue;
+            }
+
+            UInt64 latencies[LatencyHistogram::BUCKETS];
+            metrics.GetLatencies(m, latencies);
+            std::string labels = "{resource=\"" + EscapeLabel(iter->first) +
+                    "\",method=\"" + EndPointMetrics::GetMethodName(m) + "\"";
+            UInt64 count = 0;
+            int bucket = 0;
+            for (int i = 0; i <= METRICS_BUCKET_COUNT; i++)
+            {
+                // The last one is +Inf
+                while (bucket < LatencyHistogram::BUCKETS && (i == METRICS_BUCKET_COUNT ||
+                        LatencyHistogram::GetUpperBound(bucket) <= METRICS_BUCKETS[i]))
+                {
+                    count += latencies[bucket++];
+                }
+                result += "rest_request_duration_seconds_bucket" + labels + ",le=\"" +
+                        (i < METRICS_BUCKET_COUNT ? METRICS_BUCKET_LABELS[i] : "+Inf") + "\"} ";
+                NumberFormatter::Append(result, count);
+                result += "\n";
+            }
+            result += "rest_request_duration_seconds_sum" + labels + "} ";
+            NumberFormatter::Append(result, metrics.GetTotalMicroseconds(m) / 1000000.0, 6);
+            result += "\nrest_request_duration_seconds_count" + labels + "} ";
+            NumberFormatter::Append(result, count);
+            result += "\n";
+        }
+    }
+    return result;
+}
+
+bool RESTServer::Start()
+{
+    if (mServerImpl)
+    {
+        delete mServerImpl;
+        mServerImpl = NULL;
     }
 
-    if (!mSockAddr)
+    // The daemon takes over the socket, and closes it when stopped
+    int listenFd = Listen();
+    if (listenFd < 0)
     {
         return false;
     }
 
     // Create web server
     create_webserver creater;
-    creater.bind_address(mSockAddr)
-            .start_method(http::http_utils::INTERNAL_SELECT)
-            .max_threads(5);
+    creater.bind_socket(listenFd)
+            .max_connections(mMaxConnections)
+            .per_IP_connection_limit(mPerIPConnections)
+            .connection_timeout(mConnectionTimeout);
+    if (mThreadingModel == ThreadPerConnection)
+    {
+        creater.start_method(http::http_utils::THREAD_PER_CONNECTION);
+    }
+    else
+    {
+        int threads = mThreads;
+        if (threads == 0)
+        {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = cpus > 0 ? int(cpus) : 1;
+        }
+        creater.start_method(http::http_utils::INTERNAL_SELECT)
+                .max_threads(threads);
+    }
 
     mServerImpl = new webserver(creater);
 
-    if (!mServerImpl)
+    // The metrics EndPoint is kept from a previous Start(), and does not replace one
+    // configured on the same path
+    if (!mServerImpl || !ConfigEndPoints() ||
+            (!mMetricsPath.empty() && mEndPoints.find(mMetricsPath) == mEndPoints.end() &&
+                    !AddEndPoint(mMetricsPath, mMetricsHandler, 0)) ||
+            !RegisterEndPoints())
     {
+        close(listenFd);
         return false;
     }
 
-    if (!ConfigEndPoints())
+    // A daemon which did not start does not own the socket
+    if (!mServerImpl->start())
     {
+        close(listenFd);
         return false;
     }
 
-    if (!RegisterEndPoints())
+    return true;
+}
+
+int RESTServer::Listen()
+{
+    bool hasError = false;
+    SocketAddress sa(mIp, mPort, hasError);
+    if (hasError)
     {
-        return false;
+        return -1;
     }
 
-    mServerImpl->start();
+    // Non-blocking, as the pool threads all accept on it
+    int fd = socket(sa.GetAF(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
 
-    return true;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, sa.GetAddr(), sa.GetLength()) != 0 || listen(fd, mListenBacklog) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
 bool RESTServer::Stop()
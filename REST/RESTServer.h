@@ -10,12 +10,68 @@
 #include <string>
 #include "RESTEndPoint.h"
 
+class RESTServer;
+
+// Answers GET with the metrics of all the EndPoints of a RESTServer
+class MetricsEndPointHandler : public EndPointHandler
+{
+public:
+    MetricsEndPointHandler(const RESTServer &server);
+
+    virtual const http_response handle_GET(const http_request &req, const EndPoint &ep) const;
+
+private:
+    const RESTServer &mServer;
+};
+
+// Serves the EndPoints configured by ConfigEndPoints() with libhttpserver.
+// How requests are spread over threads is chosen with SetThreadingModel() before Start():
+//   * ThreadPool: a fixed pool of threads, each polling its share of the connections
+//     (libhttpserver INTERNAL_SELECT).
+//     Threads are not tied to connections, so idle keep-alive connections cost no thread;
+//     a handler blocking long holds up the other connections of its thread.
+//     Suits many connections and short handlers; one thread per CPU is a good start.
+//   * ThreadPerConnection: a thread is started for each connection and blocks on it
+//     (libhttpserver THREAD_PER_CONNECTION). Slow handlers only delay their own connection,
+//     but each connection costs a thread, so bound it with SetConnectionLimits().
+//     Suits few connections with handlers waiting on other services.
 class RESTServer
 {
 public:
+    enum ThreadingModel
+    {
+        ThreadPool,
+        ThreadPerConnection
+    };
+
     RESTServer(int port, const std::string &ip = "0.0.0.0");
     virtual ~RESTServer();
 
+    // threads is the size of the pool for ThreadPool, 0 for one per CPU; ignored for
+    // ThreadPerConnection. Default is ThreadPool with one thread per CPU.
+    void SetThreadingModel(ThreadingModel model, int threads = 0);
+
+    // Connections beyond maxConnections, or beyond perIPConnections from one client address,
+    // are refused. 0 means no limit. Defaults are no limits.
+    void SetConnectionLimits(int maxConnections, int perIPConnections = 0);
+
+    // Connections idle for this long are closed, in seconds, 0 for never. Default is 180 seconds.
+    void SetConnectionTimeout(int seconds);
+
+    // Connections waiting to be accepted beyond this are refused by the kernel. Default is 1024.
+    void SetListenBacklog(int backlog);
+
+    // Serves GetMetrics() at path, e.g. "/metrics", from the next Start(); empty for none.
+    // Off by default, as the metrics are served without authentication.
+    // An EndPoint configured on the same path by ConfigEndPoints() is kept instead.
+    void SetMetricsPath(const std::string &path);
+
+    // Returns the request counts by status code, the requests in flight and the latency
+    // histograms of all EndPoints, in the Prometheus text format. Latency buckets are
+    // approximate: each latency is counted in the first bucket at least the upper bound
+    // of its LatencyHistogram bucket, which is within 1/8 of the latency.
+    std::string GetMetrics() const;
+
     bool Start();
     bool Stop();
 
@@ -30,10 +86,20 @@ private:
     bool RegisterEndPoints();
     void UnregisterEndPoints();
 
+    // Creates the listening socket, with the backlog libhttpserver does not let set
+    int Listen();
+
 private:
     int mPort;
     std::string mIp;
-    sockaddr *mSockAddr;
+    ThreadingModel mThreadingModel;
+    int mThreads;
+    int mMaxConnections;
+    int mPerIPConnections;
+    int mConnectionTimeout;
+    int mListenBacklog;
+    std::string mMetricsPath;
+    MetricsEndPointHandler mMetricsHandler;
     webserver *mServerImpl;
     std::map<std::string, EndPoint *> mEndPoints;
 };